@@ -0,0 +1,325 @@
+/*
+    Copyright (C) 2014 Aseman
+    http://aseman.co
+
+    This project is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This project is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define ID3_HEADER_SIZE 10
+#define ID3_FRONT_COVER 3
+#define MP4_MAX_MOOV_SIZE (64*1024*1024)
+
+#include "audiocoverextractor.h"
+
+#include <QFile>
+#include <QList>
+
+static inline quint32 readUInt32(const uchar *d)
+{
+    return (quint32(d[0])<<24) | (quint32(d[1])<<16) | (quint32(d[2])<<8) | quint32(d[3]);
+}
+
+static inline quint32 readSyncSafe(const uchar *d)
+{
+    return ((d[0]&0x7f)<<21) | ((d[1]&0x7f)<<14) | ((d[2]&0x7f)<<7) | (d[3]&0x7f);
+}
+
+static QByteArray resynchronise(const QByteArray &data)
+{
+    QByteArray result;
+    result.reserve(data.size());
+    for(int i=0; i<data.size(); i++)
+    {
+        result += data.at(i);
+        if(uchar(data.at(i)) == 0xff && i+1 < data.size() && data.at(i+1) == 0)
+            i++;
+    }
+
+    return result;
+}
+
+QByteArray AudioCoverExtractor::extract(const QString &path)
+{
+    QFile file(path);
+    if(!file.open(QFile::ReadOnly))
+        return QByteArray();
+
+    const QByteArray &magic = file.peek(12);
+    if(magic.startsWith("ID3"))
+        return readId3(file);
+    if(magic.mid(4, 4) == "ftyp")
+        return readMp4(file);
+
+    return QByteArray();
+}
+
+QImage AudioCoverExtractor::extractImage(const QString &path)
+{
+    const QByteArray &data = extract(path);
+    if(data.isEmpty())
+        return QImage();
+
+    return QImage::fromData(data);
+}
+
+QByteArray AudioCoverExtractor::readId3(QFile &file)
+{
+    const QByteArray &header = file.read(ID3_HEADER_SIZE);
+    if(header.size() < ID3_HEADER_SIZE)
+        return QByteArray();
+
+    const uchar *h = reinterpret_cast<const uchar*>(header.constData());
+    const int version = h[3];
+    const int flags = h[5];
+    qint64 tagSize = readSyncSafe(h + 6);
+    if(version < 2 || version > 4)
+        return QByteArray();
+    if(version == 2 && (flags & 0x40)) // Compressed v2.2 tag, no known encoder writes these
+        return QByteArray();
+
+    tagSize = qMin(tagSize, file.size() - ID3_HEADER_SIZE);
+    if(tagSize <= 0)
+        return QByteArray();
+
+    uchar *mapped = file.map(ID3_HEADER_SIZE, tagSize);
+    QByteArray tag;
+    if(mapped)
+        tag = QByteArray::fromRawData(reinterpret_cast<const char*>(mapped), tagSize);
+    else
+        tag = file.read(tagSize);
+
+    if((flags & 0x80) && version < 4)
+        tag = resynchronise(tag);
+
+    int offset = 0;
+    if((flags & 0x40) && tag.size() >= 4)
+    {
+        const uchar *e = reinterpret_cast<const uchar*>(tag.constData());
+        offset = (version == 3)? readUInt32(e) + 4 : readSyncSafe(e);
+    }
+
+    QByteArray result;
+    if(offset < tag.size())
+        result = readId3Frames(tag.mid(offset), version);
+
+    // Detach from the mapped region before it goes away.
+    result = QByteArray(result.constData(), result.size());
+    if(mapped)
+        file.unmap(mapped);
+
+    return result;
+}
+
+QByteArray AudioCoverExtractor::readId3Frames(const QByteArray &tag, int version)
+{
+    const int headerSize = (version == 2)? 6 : 10;
+    const QByteArray frameId = (version == 2)? "PIC" : "APIC";
+
+    QByteArray best;
+    int bestType = -1;
+    int pos = 0;
+    while(pos + headerSize <= tag.size())
+    {
+        const uchar *d = reinterpret_cast<const uchar*>(tag.constData()) + pos;
+        if(d[0] == 0) // Padding
+            break;
+
+        quint32 size = 0;
+        int frameFlags = 0;
+        if(version == 2)
+            size = (quint32(d[3])<<16) | (quint32(d[4])<<8) | quint32(d[5]);
+        else
+        {
+            size = (version == 4)? readSyncSafe(d + 4) : readUInt32(d + 4);
+            frameFlags = d[9];
+        }
+
+        const QByteArray id = tag.mid(pos, headerSize == 6? 3 : 4);
+        pos += headerSize;
+        if(size > quint32(tag.size() - pos))
+            break;
+
+        // Compressed and encrypted frames are skipped, the flag bits moved in v2.4.
+        const int skipFlags = (version == 4)? 0x0c : 0xc0;
+        if(id == frameId && !(frameFlags & skipFlags))
+        {
+            QByteArray frame = tag.mid(pos, size);
+            if(version == 3 && (frameFlags & 0x20)) // Group id
+                frame = frame.mid(1);
+            if(version == 4 && (frameFlags & 0x40)) // Group id
+                frame = frame.mid(1);
+            if(version == 4 && (frameFlags & 0x01)) // Data length indicator
+                frame = frame.mid(4);
+            if(version == 4 && (frameFlags & 0x02))
+                frame = resynchronise(frame);
+
+            int type = -1;
+            const QByteArray &image = readApic(frame, version, &type);
+            if(!image.isEmpty() && (best.isEmpty() || (type == ID3_FRONT_COVER && bestType != ID3_FRONT_COVER)))
+            {
+                best = image;
+                bestType = type;
+            }
+            if(bestType == ID3_FRONT_COVER)
+                break;
+        }
+
+        pos += size;
+    }
+
+    return best;
+}
+
+QByteArray AudioCoverExtractor::readApic(const QByteArray &frame, int version, int *pictureType)
+{
+    if(frame.size() < 4)
+        return QByteArray();
+
+    const int encoding = frame.at(0);
+    int pos = 1;
+    if(version == 2)
+        pos += 3; // Image format, e.g. "JPG"
+    else
+    {
+        const int end = frame.indexOf('\0', pos); // Mime type
+        if(end == -1)
+            return QByteArray();
+        pos = end + 1;
+    }
+
+    if(pos >= frame.size())
+        return QByteArray();
+
+    *pictureType = uchar(frame.at(pos));
+    pos++;
+
+    if(encoding == 1 || encoding == 2)
+    {
+        while(pos+1 < frame.size() && (frame.at(pos) || frame.at(pos+1)))
+            pos += 2;
+        pos += 2;
+    }
+    else
+    {
+        const int end = frame.indexOf('\0', pos);
+        if(end == -1)
+            return QByteArray();
+        pos = end + 1;
+    }
+
+    if(pos >= frame.size())
+        return QByteArray();
+
+    return frame.mid(pos);
+}
+
+QByteArray AudioCoverExtractor::readMp4(QFile &file)
+{
+    const qint64 fileSize = file.size();
+    qint64 pos = 0;
+    while(pos + 8 <= fileSize)
+    {
+        if(!file.seek(pos))
+            break;
+
+        const QByteArray &header = file.read(16);
+        if(header.size() < 8)
+            break;
+
+        const uchar *h = reinterpret_cast<const uchar*>(header.constData());
+        quint64 size = readUInt32(h);
+        qint64 headerSize = 8;
+        if(size == 1)
+        {
+            if(header.size() < 16)
+                break;
+            size = (quint64(readUInt32(h + 8))<<32) | readUInt32(h + 12);
+            headerSize = 16;
+        }
+        else
+        if(size == 0)
+            size = fileSize - pos;
+
+        if(size < quint64(headerSize))
+            break;
+
+        if(header.mid(4, 4) != "moov")
+        {
+            pos += size;
+            continue;
+        }
+
+        if(size > MP4_MAX_MOOV_SIZE || pos + qint64(size) > fileSize)
+            break;
+
+        const qint64 bodySize = size - headerSize;
+        uchar *mapped = file.map(pos + headerSize, bodySize);
+        QByteArray buffer;
+        const uchar *body = mapped;
+        if(!mapped)
+        {
+            file.seek(pos + headerSize);
+            buffer = file.read(bodySize);
+            body = reinterpret_cast<const uchar*>(buffer.constData());
+        }
+
+        const QList<QByteArray> path = QList<QByteArray>() << "udta" << "meta" << "ilst" << "covr" << "data";
+        const QByteArray &data = findMp4Atom(body, buffer.isEmpty()? bodySize : buffer.size(), path);
+        // The data atom starts with a type indicator and a locale.
+        const QByteArray result = data.size() > 8? data.mid(8) : QByteArray();
+
+        if(mapped)
+            file.unmap(mapped);
+
+        return result;
+    }
+
+    return QByteArray();
+}
+
+QByteArray AudioCoverExtractor::findMp4Atom(const uchar *data, qint64 size, const QList<QByteArray> &path)
+{
+    qint64 pos = 0;
+    while(pos + 8 <= size)
+    {
+        qint64 atomSize = readUInt32(data + pos);
+        const QByteArray type(reinterpret_cast<const char*>(data + pos + 4), 4);
+        if(atomSize == 0)
+            atomSize = size - pos;
+        if(atomSize < 8 || pos + atomSize > size)
+            break;
+
+        if(type == path.first())
+        {
+            const uchar *body = data + pos + 8;
+            qint64 bodySize = atomSize - 8;
+            if(path.count() == 1)
+                return QByteArray(reinterpret_cast<const char*>(body), bodySize);
+
+            // meta is a full atom with version and flags, except in some
+            // QuickTime files where it is a plain container.
+            if(type == "meta" && bodySize >= 4 && readUInt32(body) == 0)
+            {
+                body += 4;
+                bodySize -= 4;
+            }
+
+            return findMp4Atom(body, bodySize, path.mid(1));
+        }
+
+        pos += atomSize;
+    }
+
+    return QByteArray();
+}
@@ -0,0 +1,49 @@
+/*
+    Copyright (C) 2014 Aseman
+    http://aseman.co
+
+    This project is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This project is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef AUDIOCOVEREXTRACTOR_H
+#define AUDIOCOVEREXTRACTOR_H
+
+#include <QByteArray>
+#include <QString>
+#include <QImage>
+
+#include "telegramqml_global.h"
+
+class QFile;
+
+/*!
+ * Reads embedded cover art from ID3v2 (mp3) and MP4/M4A tags. Only the tag
+ * region of the file is mapped, the audio stream itself is never read.
+ * Safe to use from any thread.
+ */
+class TELEGRAMQMLSHARED_EXPORT AudioCoverExtractor
+{
+public:
+    static QByteArray extract(const QString &path);
+    static QImage extractImage(const QString &path);
+
+private:
+    static QByteArray readId3(QFile &file);
+    static QByteArray readId3Frames(const QByteArray &tag, int version);
+    static QByteArray readApic(const QByteArray &frame, int version, int *pictureType);
+    static QByteArray readMp4(QFile &file);
+    static QByteArray findMp4Atom(const uchar *data, qint64 size, const QList<QByteArray> &path);
+};
+
+#endif // AUDIOCOVEREXTRACTOR_H
@@ -1,15 +1,23 @@
 #include "backgroundmanager.h"
+#include "telegramthumbnailer.h"
+#include "telegramqml.h"
 #include "objects/types.h"
 
 #include <QPointer>
+#include <QDateTime>
+#include <QCryptographicHash>
 #include <QFile>
 #include <QFileInfo>
 #include <QDir>
 #include <QStringList>
+#include <QImageReader>
+#include <QGuiApplication>
+#include <QScreen>
 
 class BackgroundManagerPrivate
 {
 public:
+    QPointer<TelegramQml> telegram;
     QUrl directory;
     QPointer<DialogObject> dialog;
     QUrl background;
@@ -21,6 +29,20 @@ BackgroundManager::BackgroundManager(QObject *parent) :
     p = new BackgroundManagerPrivate;
 }
 
+void BackgroundManager::setTelegram(TelegramQml *tg)
+{
+    if(p->telegram == tg)
+        return;
+
+    p->telegram = tg;
+    Q_EMIT telegramChanged();
+}
+
+TelegramQml *BackgroundManager::telegram() const
+{
+    return p->telegram;
+}
+
 void BackgroundManager::setDirectory(const QUrl &path)
 {
     if(p->directory == path)
@@ -86,27 +108,63 @@ void BackgroundManager::setBackground(const QString &filePath)
         return;
     }
 
-    const QString dIdStr = QString::number(dId);
     const QStringList &files = QDir(p->directory.toLocalFile()).entryList(QDir::Files);
     Q_FOREACH(const QString &f, files)
-    {
-        const QString path = p->directory.toLocalFile() + "/" + f;
-        QFileInfo info(path);
-        if(info.baseName() != dIdStr)
-            continue;
-
-        QFile::remove(path);
-    }
+        if(isBackgroundOf(f, dId))
+            QFile::remove(p->directory.toLocalFile() + "/" + f);
 
     if(!filePath.isEmpty())
     {
         QFileInfo inf(filePath);
-        QFile::copy(filePath, p->directory.toLocalFile() + "/" + dIdStr + "." + inf.suffix());
+        QScreen *screen = QGuiApplication::primaryScreen();
+        const QByteArray &format = QImageReader::imageFormat(filePath);
+        if(screen && p->telegram && !format.isEmpty())
+        {
+            // Keep a screen sized copy instead of the full camera resolution,
+            // scaled on the thumbnailer's worker threads.
+            const QSize &screenSize = screen->size() * screen->devicePixelRatio();
+#ifdef TG_THUMBNAILER_CPP11
+            QPointer<BackgroundManager> manager = this;
+            TelegramThumbnailer_Callback callback = [manager](){
+                if(manager)
+                    manager->refresh();
+            };
+#else
+            TelegramThumbnailer_Callback callback;
+            callback.object = this;
+            callback.method = "refresh";
+#endif
+            // Formats that may carry transparency keep it.
+            const QString suffix = (format == "jpeg" || format == "jpg")? "jpg" : "png";
+            p->telegram->thumbnailer()->createThumbnail(filePath, p->directory.toLocalFile() + "/" + backgroundName(filePath, dId, suffix),
+                                                        callback, qMax(screenSize.width(), screenSize.height()));
+            return;
+        }
+
+        QFile::copy(filePath, p->directory.toLocalFile() + "/" + backgroundName(filePath, dId, inf.suffix()));
     }
 
     refresh();
 }
 
+bool BackgroundManager::isBackgroundOf(const QString &fileName, qint64 dId) const
+{
+    const QString &base = QFileInfo(fileName).baseName();
+    const QString dIdStr = QString::number(dId);
+    return base == dIdStr || base.startsWith(dIdStr + "_");
+}
+
+QString BackgroundManager::backgroundName(const QString &filePath, qint64 dId, const QString &suffix) const
+{
+    // A new name per source, so image caches don't keep the previous one.
+    const QFileInfo info(filePath);
+    const QString fingerprint = QString("%1:%2:%3").arg(info.absoluteFilePath())
+                                                   .arg(info.size())
+                                                   .arg(info.lastModified().toMSecsSinceEpoch());
+    const QByteArray &hash = QCryptographicHash::hash(fingerprint.toUtf8(), QCryptographicHash::Md5).toHex().left(8);
+    return QString::number(dId) + "_" + QString::fromLatin1(hash) + "." + suffix;
+}
+
 void BackgroundManager::refresh()
 {
     const qint64 dId = dialogId();
@@ -118,16 +176,13 @@ void BackgroundManager::refresh()
     }
 
     QString filePath;
-    const QString dIdStr = QString::number(dId);
     const QStringList &files = QDir(p->directory.toLocalFile()).entryList(QDir::Files);
     Q_FOREACH(const QString &f, files)
     {
-        const QString path = p->directory.toLocalFile() + "/" + f;
-        QFileInfo info(path);
-        if(info.baseName() != dIdStr)
+        if(!isBackgroundOf(f, dId))
             continue;
 
-        filePath = path;
+        filePath = p->directory.toLocalFile() + "/" + f;
         break;
     }
 
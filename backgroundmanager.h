@@ -6,11 +6,13 @@
 #include <QObject>
 #include <QUrl>
 
+class TelegramQml;
 class DialogObject;
 class BackgroundManagerPrivate;
 class TELEGRAMQMLSHARED_EXPORT BackgroundManager : public QObject
 {
     Q_OBJECT
+    Q_PROPERTY(TelegramQml* telegram READ telegram WRITE setTelegram NOTIFY telegramChanged)
     Q_PROPERTY(QUrl directory READ directory WRITE setDirectory NOTIFY directoryChanged)
     Q_PROPERTY(DialogObject* dialog READ dialog WRITE setDialog NOTIFY dialogChanged)
     Q_PROPERTY(QUrl background READ background NOTIFY backgroundChanged)
@@ -19,6 +21,9 @@ public:
     BackgroundManager(QObject *parent = 0);
     ~BackgroundManager();
 
+    void setTelegram(TelegramQml *tg);
+    TelegramQml *telegram() const;
+
     void setDirectory(const QUrl &path);
     QUrl directory() const;
 
@@ -32,13 +37,18 @@ public Q_SLOTS:
     void setBackground(const QString &filePath);
 
 Q_SIGNALS:
+    void telegramChanged();
     void directoryChanged();
     void dialogChanged();
     void backgroundChanged();
 
-private:
+private Q_SLOTS:
     void refresh();
 
+private:
+    bool isBackgroundOf(const QString &fileName, qint64 dId) const;
+    QString backgroundName(const QString &filePath, qint64 dId, const QString &suffix) const;
+
 private:
     BackgroundManagerPrivate *p;
 };
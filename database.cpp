@@ -16,6 +16,7 @@ Database::Database(QObject *parent) :
     this->thread = 0;
     this->core = 0;
     this->internal_encrypter = 0;
+    this->lastRequestId = 0;
 }
 
 void Database::setPhoneNumber(const QString &phoneNumber)
@@ -113,6 +114,12 @@ void Database::insertMediaEncryptedKeys(qint64 mediaId, const QByteArray &key, c
     QMetaObject::invokeMethod(this->core, "insertMediaEncryptedKeys", Qt::QueuedConnection, Q_ARG(qint64,mediaId), Q_ARG(QByteArray,key), Q_ARG(QByteArray,iv));
 }
 
+void Database::insertCache(int type, const QString &key, qint64 date, const QByteArray &data)
+{
+    FIRST_CHECK;
+    QMetaObject::invokeMethod(this->core, "insertCache", Qt::QueuedConnection, Q_ARG(int,type), Q_ARG(QString,key), Q_ARG(qint64,date), Q_ARG(QByteArray,data));
+}
+
 void Database::updateUnreadCount(qint64 chatId, int unreadCount)
 {
     FIRST_CHECK;
@@ -131,6 +138,31 @@ void Database::markMessagesAsReadFromMaxDate(qint32 chatId, qint32 maxDate)
     QMetaObject::invokeMethod(this->core, "markMessagesAsReadFromMaxDate", Qt::QueuedConnection, Q_ARG(qint32, chatId), Q_ARG(qint32, maxDate));
 }
 
+void Database::readCache(qint64 minDate)
+{
+    FIRST_CHECK;
+    QMetaObject::invokeMethod(this->core, "readCache", Qt::QueuedConnection, Q_ARG(qint64,minDate));
+}
+
+void Database::readValue(const QString &key)
+{
+    FIRST_CHECK;
+    QMetaObject::invokeMethod(this->core, "readValue", Qt::QueuedConnection, Q_ARG(QString,key));
+}
+
+void Database::readSharedMedia(qint64 dialogId, int type, qint32 beforeDate, qint32 beforeId, int limit)
+{
+    FIRST_CHECK;
+    QMetaObject::invokeMethod(this->core, "readSharedMedia", Qt::QueuedConnection, Q_ARG(qint64,dialogId), Q_ARG(int,type),
+                              Q_ARG(qint32,beforeDate), Q_ARG(qint32,beforeId), Q_ARG(int,limit));
+}
+
+void Database::setValue(const QString &key, const QString &value)
+{
+    FIRST_CHECK;
+    QMetaObject::invokeMethod(this->core, "setValue", Qt::QueuedConnection, Q_ARG(QString,key), Q_ARG(QString,value));
+}
+
 void Database::markMessagesAsRead(const qint32 msgId, const Peer &peer)
 {
     FIRST_CHECK;
@@ -140,13 +172,43 @@ void Database::markMessagesAsRead(const qint32 msgId, const Peer &peer)
     QMetaObject::invokeMethod(this->core, "markMessagesAsRead", Qt::QueuedConnection, Q_ARG(qint32, msgId), Q_ARG(DbPeer, dpeer));
 }
 
-void Database::readMessages(const Peer &peer, int offset, int limit)
+qint64 Database::readMessages(const Peer &peer, int offset, int limit)
 {
-    FIRST_CHECK;
+    if(!this->core)
+        return 0;
+
+    DbPeer dpeer;
+    dpeer.peer = peer;
+
+    // The page arrives as messageFounded() signals followed by requestFinished().
+    const qint64 requestId = ++this->lastRequestId;
+    this->pendingRequests.insert(requestId);
+    QMetaObject::invokeMethod(this->core, "readMessagesPage", Qt::QueuedConnection, Q_ARG(qint64, requestId),
+                              Q_ARG(DbPeer, dpeer), Q_ARG(int,offset), Q_ARG(int,limit) );
+    return requestId;
+}
+
+qint64 Database::readMessagesAvailable(const Peer &peer)
+{
+    if(!this->core)
+        return 0;
+
     DbPeer dpeer;
     dpeer.peer = peer;
 
-    QMetaObject::invokeMethod(this->core, "readMessages", Qt::QueuedConnection, Q_ARG(DbPeer, dpeer), Q_ARG(int,offset), Q_ARG(int,limit) );
+    const qint64 requestId = ++this->lastRequestId;
+    this->pendingRequests.insert(requestId);
+    QMetaObject::invokeMethod(this->core, "readMessagesAvailable", Qt::QueuedConnection, Q_ARG(qint64, requestId), Q_ARG(DbPeer, dpeer));
+    return requestId;
+}
+
+void Database::cancelRequest(qint64 requestId)
+{
+    if(!this->pendingRequests.remove(requestId))
+        return;
+
+    if(this->core)
+        this->core->cancelRequest(requestId);
 }
 
 void Database::deleteMessage(qint64 msgId)
@@ -161,6 +223,12 @@ void Database::deleteDialog(qint64 dlgId)
     QMetaObject::invokeMethod(this->core, "deleteDialog", Qt::QueuedConnection, Q_ARG(qint64,dlgId));
 }
 
+void Database::deleteCache(const QString &key)
+{
+    FIRST_CHECK;
+    QMetaObject::invokeMethod(this->core, "deleteCache", Qt::QueuedConnection, Q_ARG(QString,key));
+}
+
 void Database::deleteHistory(qint64 dlgId)
 {
     FIRST_CHECK;
@@ -204,6 +272,26 @@ void Database::messageFounded_slt(const DbMessage &message)
     Q_EMIT messageFounded(message.message);
 }
 
+void Database::messagesPageFounded_slt(qint64 requestId, const QList<DbMessage> &messages)
+{
+    // Cancelled while the page was on its way, nothing of it is wanted anymore.
+    if(!this->pendingRequests.remove(requestId))
+        return;
+
+    Q_FOREACH(const DbMessage &message, messages)
+        Q_EMIT messageFounded(message.message);
+
+    Q_EMIT requestFinished(requestId, messages.count());
+}
+
+void Database::messagesAvailableFounded_slt(qint64 requestId, int count)
+{
+    if(!this->pendingRequests.remove(requestId))
+        return;
+
+    Q_EMIT messagesAvailableFounded(requestId, count);
+}
+
 void Database::contactFounded_slt(const DbContact &contact)
 {
     Q_EMIT contactFounded(contact.contact);
@@ -221,6 +309,7 @@ void Database::refresh()
         this->core = 0;
     }
 
+    this->pendingRequests.clear();
     if(this->internal_phoneNumber.isEmpty() || this->internal_configPath.isEmpty())
         return;
 
@@ -245,9 +334,19 @@ void Database::refresh()
     connect(this->core, SIGNAL(userFounded(DbUser))         , SLOT(userFounded_slt(DbUser))         , Qt::QueuedConnection );
     connect(this->core, SIGNAL(dialogFounded(DbDialog,bool)), SLOT(dialogFounded_slt(DbDialog,bool)), Qt::QueuedConnection );
     connect(this->core, SIGNAL(messageFounded(DbMessage))   , SLOT(messageFounded_slt(DbMessage))   , Qt::QueuedConnection );
+    connect(this->core, SIGNAL(messagesPageFounded(qint64,QList<DbMessage>)),
+            SLOT(messagesPageFounded_slt(qint64,QList<DbMessage>)), Qt::QueuedConnection );
+    connect(this->core, SIGNAL(messagesAvailableFounded(qint64,int)),
+            SLOT(messagesAvailableFounded_slt(qint64,int)), Qt::QueuedConnection );
     connect(this->core, SIGNAL(contactFounded(DbContact))   , SLOT(contactFounded_slt(DbContact))   , Qt::QueuedConnection );
     connect(this->core, SIGNAL(mediaKeyFounded(qint64,QByteArray,QByteArray)),
             SIGNAL(mediaKeyFounded(qint64,QByteArray,QByteArray)), Qt::QueuedConnection );
+    connect(this->core, SIGNAL(cacheFounded(int,QString,qint64,QByteArray)),
+            SIGNAL(cacheFounded(int,QString,qint64,QByteArray)), Qt::QueuedConnection );
+    connect(this->core, SIGNAL(valueFounded(QString,QString)),
+            SIGNAL(valueFounded(QString,QString)), Qt::QueuedConnection );
+    connect(this->core, SIGNAL(sharedMediaFounded(qint64,int,QVariantList)),
+            SIGNAL(sharedMediaFounded(qint64,int,QVariantList)), Qt::QueuedConnection );
 }
 
 Database::~Database()
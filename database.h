@@ -2,6 +2,7 @@
 #define DATABASE_H
 
 #include <QObject>
+#include <QSet>
 
 #include "telegramqml_global.h"
 #include "databaseabstractencryptor.h"
@@ -46,16 +47,24 @@ public Q_SLOTS:
     void insertContact(const Contact &contact);
     void insertMessage(const Message &message, bool encrypted);
     void insertMediaEncryptedKeys(qint64 mediaId, const QByteArray &key, const QByteArray &iv);
+    void insertCache(int type, const QString &key, qint64 date, const QByteArray &data);
 
     void updateUnreadCount(qint64 chatId, int unreadCount);
 
     void readFullDialogs();
-    void readMessages(const Peer &peer, int offset, int limit);
+    qint64 readMessages(const Peer &peer, int offset, int limit);
+    qint64 readMessagesAvailable(const Peer &peer);
+    void cancelRequest(qint64 requestId);
     void markMessagesAsRead(const qint32 msgId, const Peer &peer);
     void markMessagesAsReadFromMaxDate(qint32 chatId, qint32 maxDate);
+    void readCache(qint64 minDate);
+    void readValue(const QString &key);
+    void readSharedMedia(qint64 dialogId, int type, qint32 beforeDate, qint32 beforeId, int limit);
+    void setValue(const QString &key, const QString &value);
 
     void deleteMessage(qint64 msgId);
     void deleteDialog(qint64 dlgId);
+    void deleteCache(const QString &key);
     void deleteHistory(qint64 dlgId);
 
     void blockUser(qint64 userId);
@@ -68,7 +77,12 @@ Q_SIGNALS:
     void dialogFounded(const Dialog &dialog, bool encrypted);
     void contactFounded(const Contact &contact);
     void messageFounded(const Message &message);
+    void requestFinished(qint64 requestId, int count);
+    void messagesAvailableFounded(qint64 requestId, int count);
     void mediaKeyFounded(qint64 mediaId, const QByteArray &key, const QByteArray &iv);
+    void cacheFounded(int type, const QString &key, qint64 date, const QByteArray &data);
+    void valueFounded(const QString &key, const QString &value);
+    void sharedMediaFounded(qint64 dialogId, int type, const QVariantList &items);
     void phoneNumberChanged();
     void configPathChanged();
 
@@ -77,6 +91,8 @@ private Q_SLOTS:
     void chatFounded_slt(const DbChat &chat);
     void dialogFounded_slt(const DbDialog &dialog, bool encrypted);
     void messageFounded_slt(const DbMessage &message);
+    void messagesPageFounded_slt(qint64 requestId, const QList<DbMessage> &messages);
+    void messagesAvailableFounded_slt(qint64 requestId, int count);
     void contactFounded_slt(const DbContact &contact);
 
 private:
@@ -93,6 +109,9 @@ private:
     QString internal_phoneNumber;
     QString internal_configPath;
 
+    qint64 lastRequestId;
+    QSet<qint64> pendingRequests;
+
 };
 
 #endif // DATABASE_H
@@ -1,5 +1,6 @@
 #include "databasecore.h"
 #include "telegramqml_macros.h"
+#include "utils.h"
 
 
 #include <QSqlDatabase>
@@ -37,6 +38,7 @@ DatabaseCore::DatabaseCore(const QString &path, const QString &configPath, const
     qRegisterMetaType<DbContact>("DbContact");
     qRegisterMetaType<DbMessage>("DbMessage");
     qRegisterMetaType<DbPeer>("DbPeer");
+    qRegisterMetaType< QList<DbMessage> >("QList<DbMessage>");
 }
 
 void DatabaseCore::setEncrypter(DatabaseAbstractEncryptor *encrypter)
@@ -207,6 +209,7 @@ void DatabaseCore::insertMessage(const DbMessage &dmessage, bool encrypted)
         toId =  message.toId().userId();
         query.bindValue(":toId", toId);
     query.bindValue(":toPeerType",message.toId().classType() );
+    const qint64 dialogId = (message.toId().classType()==Peer::typePeerUser && !(message.flags()&0x2))? message.fromId() : toId;
     query.bindValue(":unread", (message.flags()&0x1?true:false) );
     query.bindValue(":fromId",message.fromId() );
     query.bindValue(":out", (message.flags()&0x2?true:false) );
@@ -246,6 +249,102 @@ void DatabaseCore::insertMessage(const DbMessage &dmessage, bool encrypted)
     insertDocument(media.document());
     insertGeo(message.id(), media.geo());
     insertPhoto(media.photo());
+    insertSharedMedia(message, dialogId);
+}
+
+void DatabaseCore::insertSharedMedia(const Message &message, qint64 dialogId)
+{
+    const MessageMedia &media = message.media();
+
+    int type = SharedMediaNone;
+    QString fileKey;
+    QString fileName;
+    QString mimeType;
+    QString url;
+    qint32 size = 0;
+    switch(static_cast<int>(media.classType()))
+    {
+    case MessageMedia::typeMessageMediaPhoto:
+    {
+        // Named after the largest size, the same one TelegramQml downloads.
+        type = SharedMediaPhoto;
+        PhotoSize largest;
+        Q_FOREACH(const PhotoSize &psize, media.photo().sizes())
+            if(psize.w() >= largest.w())
+                largest = psize;
+
+        fileKey = QString("%1_%2").arg(largest.location().volumeId()).arg(largest.location().localId());
+        size = largest.size();
+        mimeType = "image/jpeg";
+    }
+        break;
+
+    case MessageMedia::typeMessageMediaDocument:
+    {
+        const Document &document = media.document();
+        type = SharedMediaDocument;
+        Q_FOREACH(const DocumentAttribute &attr, document.attributes())
+        {
+            if(attr.classType() == DocumentAttribute::typeDocumentAttributeSticker)
+                return;
+            else
+            if(attr.classType() == DocumentAttribute::typeDocumentAttributeVideo)
+                type = SharedMediaVideo;
+            else
+            if(attr.classType() == DocumentAttribute::typeDocumentAttributeAudio)
+                type = SharedMediaAudio;
+            else
+            if(attr.classType() == DocumentAttribute::typeDocumentAttributeFilename)
+                fileName = attr.fileName();
+        }
+
+        fileKey = QString::number(document.id());
+        size = document.size();
+        mimeType = document.mimeType();
+    }
+        break;
+
+    case MessageMedia::typeMessageMediaWebPage:
+        type = SharedMediaLink;
+        url = media.webpage().url();
+        break;
+    }
+
+    if(type == SharedMediaNone)
+    {
+        Q_FOREACH(const MessageEntity &entity, message.entities())
+        {
+            if(entity.classType() == MessageEntity::typeMessageEntityTextUrl)
+                url = entity.url();
+            else
+            if(entity.classType() == MessageEntity::typeMessageEntityUrl)
+                url = message.message().mid(entity.offset(), entity.length());
+            else
+                continue;
+
+            type = SharedMediaLink;
+            break;
+        }
+    }
+
+    if(type == SharedMediaNone)
+        return;
+
+    QSqlQuery query(db);
+    query.prepare("INSERT OR REPLACE INTO SharedMedia (dialogId, msgId, type, date, fileKey, fileName, mimeType, size, url) "
+                  "VALUES (:dialogId, :msgId, :type, :date, :fileKey, :fileName, :mimeType, :size, :url);");
+    query.bindValue(":dialogId", dialogId);
+    query.bindValue(":msgId", message.id());
+    query.bindValue(":type", type);
+    query.bindValue(":date", message.date());
+    query.bindValue(":fileKey", fileKey);
+    query.bindValue(":fileName", fileName);
+    query.bindValue(":mimeType", mimeType);
+    query.bindValue(":size", size);
+    query.bindValue(":url", url);
+
+    if(!query.exec())
+        qDebug() << __FUNCTION__ << query.lastError();
 }
 
 void DatabaseCore::insertMediaEncryptedKeys(qint64 mediaId, const QByteArray &key, const QByteArray &iv)
@@ -266,6 +365,25 @@ void DatabaseCore::insertMediaEncryptedKeys(qint64 mediaId, const QByteArray &ke
     }
 }
 
+void DatabaseCore::insertCache(int type, const QString &key, qint64 date, const QByteArray &data)
+{
+    begin();
+
+    QSqlQuery query(db);
+    query.prepare("INSERT OR REPLACE INTO ResponseCache (key, type, date, data) VALUES (:key, :type, :date, :data);");
+    query.bindValue(":key" ,key );
+    query.bindValue(":type",type );
+    query.bindValue(":date",date );
+    query.bindValue(":data",data );
+
+    bool res = query.exec();
+    if(!res)
+    {
+        qDebug() << __FUNCTION__ << query.lastError();
+        return;
+    }
+}
+
 void DatabaseCore::updateUnreadCount(qint64 chatId, int unreadCount)
 {
     begin();
@@ -327,6 +445,66 @@ void DatabaseCore::markMessagesAsRead(const qint32 msgId, const DbPeer &dpeer)
 
 void DatabaseCore::readMessages(const DbPeer &dpeer, int offset, int limit)
 {
+    Q_FOREACH(const DbMessage &dmsg, queryMessages(dpeer, offset, limit))
+    {
+        Q_EMIT messageFounded(dmsg);
+        readMessageKeys(dmsg.message.id());
+    }
+}
+
+void DatabaseCore::readMessagesPage(qint64 requestId, const DbPeer &dpeer, int offset, int limit)
+{
+    if(takeCancelled(requestId))
+        return;
+
+    const QList<DbMessage> &messages = queryMessages(dpeer, offset, limit, requestId);
+    if(takeCancelled(requestId))
+        return;
+
+    Q_EMIT messagesPageFounded(requestId, messages);
+    Q_FOREACH(const DbMessage &dmsg, messages)
+        readMessageKeys(dmsg.message.id());
+}
+
+void DatabaseCore::readMessagesAvailable(qint64 requestId, const DbPeer &dpeer)
+{
+    if(takeCancelled(requestId))
+        return;
+
+    Q_EMIT messagesAvailableFounded(requestId, getMessagesAvailable(dpeer.peer));
+}
+
+void DatabaseCore::cancelRequest(qint64 requestId)
+{
+    // Called from the gui thread, the read checks it before and while running.
+    QMutexLocker locker(&cancelMutex);
+    cancelled.insert(requestId);
+}
+
+bool DatabaseCore::takeCancelled(qint64 requestId)
+{
+    QMutexLocker locker(&cancelMutex);
+    const bool res = cancelled.contains(requestId);
+
+    // Requests run in order, older marks can not match anything anymore.
+    QMutableSetIterator<qint64> i(cancelled);
+    while(i.hasNext())
+        if(i.next() < requestId)
+            i.remove();
+
+    return res;
+}
+
+void DatabaseCore::readMessageKeys(qint64 msgId)
+{
+    const QPair<QByteArray, QByteArray> & keys = readMediaKey(msgId);
+    if(!keys.first.isNull())
+        Q_EMIT mediaKeyFounded(msgId, keys.first, keys.second);
+}
+
+QList<DbMessage> DatabaseCore::queryMessages(const DbPeer &dpeer, int offset, int limit, qint64 requestId)
+{
+    QList<DbMessage> result;
     const Peer & peer = dpeer.peer;
     QSqlQuery query(db);
     if( peer.classType() == Peer::typePeerChat || peer.classType() == Peer::typePeerChannel )
@@ -345,11 +523,18 @@ void DatabaseCore::readMessages(const DbPeer &dpeer, int offset, int limit)
     if(!res)
     {
         qDebug() << __FUNCTION__ << query.lastError();
-        return;
+        return result;
     }
 
     while(query.next())
     {
+        if(requestId)
+        {
+            QMutexLocker locker(&cancelMutex);
+            if(cancelled.contains(requestId))
+                break;
+        }
+
         const QSqlRecord &record = query.record();
 
         MessageAction action( static_cast<MessageAction::MessageActionClassType>(record.value("actionType").toLongLong()) );
@@ -398,13 +583,70 @@ void DatabaseCore::readMessages(const DbPeer &dpeer, int offset, int limit)
         message.setViews(record.value("views").toLongLong());
         DbMessage dmsg;
         dmsg.message = message;
+        result << dmsg;
+    }
 
-        Q_EMIT messageFounded(dmsg);
+    return result;
+}
+
+void DatabaseCore::readCache(qint64 minDate)
+{
+    QSqlQuery expire_query(db);
+    expire_query.prepare("DELETE FROM ResponseCache WHERE date<:minDate");
+    expire_query.bindValue(":minDate", minDate);
+    expire_query.exec();
+
+    QSqlQuery query(db);
+    query.prepare("SELECT key, type, date, data FROM ResponseCache");
+    if(!query.exec())
+    {
+        qDebug() << __FUNCTION__ << query.lastError();
+        return;
+    }
+
+    while(query.next())
+    {
+        const QSqlRecord &record = query.record();
+        Q_EMIT cacheFounded(record.value("type").toInt(), record.value("key").toString(),
+                            record.value("date").toLongLong(), record.value("data").toByteArray());
+    }
+}
+
+void DatabaseCore::readValue(const QString &key)
+{
+    Q_EMIT valueFounded(key, general.value(key));
+}
+
+void DatabaseCore::readSharedMedia(qint64 dialogId, int type, qint32 beforeDate, qint32 beforeId, int limit)
+{
+    // Keyset paging, each page continues below the last (date, msgId) seen.
+    QSqlQuery query(db);
+    query.prepare("SELECT msgId, date, fileKey, fileName, mimeType, size, url FROM SharedMedia "
+                  "WHERE dialogId=:dialogId AND type=:type AND (:beforeDate=0 OR date<:beforeDate OR (date=:beforeDate AND msgId<:beforeId)) "
+                  "ORDER BY date DESC, msgId DESC LIMIT :limit");
+    query.bindValue(":dialogId", dialogId);
+    query.bindValue(":type", type);
+    query.bindValue(":beforeDate", beforeDate);
+    query.bindValue(":beforeId", beforeId);
+    query.bindValue(":limit", limit);
+    if(!query.exec())
+    {
+        qDebug() << __FUNCTION__ << query.lastError();
+        return;
+    }
+
+    QVariantList items;
+    while(query.next())
+    {
+        const QSqlRecord &record = query.record();
+        QVariantMap item;
+        for(int i=0; i<record.count(); i++)
+            item[record.fieldName(i)] = record.value(i);
 
-        const QPair<QByteArray, QByteArray> & keys = readMediaKey(message.id());
-        if(!keys.first.isNull())
-            Q_EMIT mediaKeyFounded(message.id(), keys.first, keys.second);
+        items << item;
     }
+
+    Q_EMIT sharedMediaFounded(dialogId, type, items);
 }
 
 void DatabaseCore::setValue(const QString &key, const QString &value)
@@ -426,14 +668,53 @@ QString DatabaseCore::value(const QString &key) const
 
 void DatabaseCore::deleteMessage(qint64 msgId)
 {
+    // Channel message ids are per channel, their keys carry the channel id.
+    const qint32 channelId = QmlUtils::getSeparatePeerId(msgId);
+    const qint32 id = QmlUtils::getSeparateMessageId(msgId);
+
     begin();
+    qint64 dialogId = channelId;
+    if(!dialogId)
+    {
+        QSqlQuery dialog_query( db );
+        dialog_query.prepare("SELECT toId, toPeerType, fromId, out FROM Messages WHERE id=:id AND toPeerType<>:chtype" );
+        dialog_query.bindValue( ":id" , id );
+        dialog_query.bindValue( ":chtype", static_cast<qint64>(Peer::typePeerChannel) );
+        if(!dialog_query.exec())
+            qDebug() << __FUNCTION__ << dialog_query.lastError();
+        else
+        if(dialog_query.next())
+        {
+            const QSqlRecord &record = dialog_query.record();
+            const bool toUser = record.value("toPeerType").toLongLong() == Peer::typePeerUser;
+            dialogId = (toUser && !record.value("out").toBool())? record.value("fromId").toLongLong() : record.value("toId").toLongLong();
+        }
+    }
+
     QSqlQuery query( db );
-    query.prepare("DELETE FROM Messages WHERE id=:id" );
-    query.bindValue( ":id" , msgId );
+    if(channelId)
+    {
+        query.prepare("DELETE FROM Messages WHERE id=:id AND toId=:peer AND toPeerType=:chtype" );
+        query.bindValue( ":peer" , channelId );
+    }
+    else
+        query.prepare("DELETE FROM Messages WHERE id=:id AND toPeerType<>:chtype" );
+    query.bindValue( ":id" , id );
+    query.bindValue( ":chtype", static_cast<qint64>(Peer::typePeerChannel) );
 
     bool res = query.exec();
     if(!res)
         qDebug() << __FUNCTION__ << query.lastError();
+
+    if(!dialogId)
+        return;
+
+    QSqlQuery media_query( db );
+    media_query.prepare("DELETE FROM SharedMedia WHERE dialogId=:peer AND msgId=:id" );
+    media_query.bindValue( ":peer" , dialogId );
+    media_query.bindValue( ":id" , id );
+    if(!media_query.exec())
+        qDebug() << __FUNCTION__ << media_query.lastError();
 }
 
 void DatabaseCore::deleteDialog(qint64 dlgId)
@@ -448,6 +729,18 @@ void DatabaseCore::deleteDialog(qint64 dlgId)
         qDebug() << __FUNCTION__ << query.lastError();
 }
 
+void DatabaseCore::deleteCache(const QString &key)
+{
+    begin();
+    QSqlQuery query( db );
+    query.prepare("DELETE FROM ResponseCache WHERE key=:key" );
+    query.bindValue( ":key" , key );
+
+    bool res = query.exec();
+    if(!res)
+        qDebug() << __FUNCTION__ << query.lastError();
+}
+
 void DatabaseCore::deleteHistory(qint64 dlgId)
 {
     begin();
@@ -461,6 +754,12 @@ void DatabaseCore::deleteHistory(qint64 dlgId)
     bool res = query.exec();
     if(!res)
         qDebug() << __FUNCTION__ << query.lastError();
+
+    QSqlQuery media_query( db );
+    media_query.prepare("DELETE FROM SharedMedia WHERE dialogId=:peer" );
+    media_query.bindValue( ":peer" , dlgId );
+    if(!media_query.exec())
+        qDebug() << __FUNCTION__ << media_query.lastError();
 }
 
 void DatabaseCore::blockUser(qint64 userId)
@@ -873,6 +1172,40 @@ void DatabaseCore::update_db()
         db_version = 12;
     }
 
+    if (db_version == 12)
+    {
+        qWarning() << "Databasecore: updating db to version 13...";
+        QSqlQuery query(db);
+        query.prepare("CREATE TABLE IF NOT EXISTS ResponseCache ("
+                      "key TEXT PRIMARY KEY NOT NULL,"
+                      "type INT NOT NULL,"
+                      "date BIGINT NOT NULL,"
+                      "data BLOB NOT NULL)");
+        query.exec();
+        db_version = 13;
+    }
+
+    if (db_version == 13)
+    {
+        qWarning() << "Databasecore: updating db to version 14...";
+        QSqlQuery query(db);
+        query.prepare("CREATE TABLE IF NOT EXISTS SharedMedia ("
+                      "dialogId BIGINT NOT NULL,"
+                      "msgId BIGINT NOT NULL,"
+                      "type INT NOT NULL,"
+                      "date BIGINT NOT NULL,"
+                      "fileKey TEXT,"
+                      "fileName TEXT,"
+                      "mimeType TEXT,"
+                      "size BIGINT,"
+                      "url TEXT,"
+                      "PRIMARY KEY (dialogId, msgId))");
+        query.exec();
+        query.prepare("create index sharedMedia_idx on SharedMedia (dialogId, type, date, msgId)");
+        query.exec();
+        db_version = 14;
+    }
+
     qWarning() << "Databasecore: updating db was successful!";
     setValue("version", QString::number(db_version) );
 }
@@ -6,6 +6,8 @@
 
 #include <QObject>
 #include <QSqlDatabase>
+#include <QMutex>
+#include <QSet>
 #include <telegram/types/types.h>
 
 class TELEGRAMQMLSHARED_EXPORT DbChat { public: DbChat(): chat(Chat::typeChatEmpty){} Chat chat; };
@@ -26,10 +28,20 @@ class TELEGRAMQMLSHARED_EXPORT DatabaseCore : public QObject
 {
     Q_OBJECT
 public:
+    enum SharedMediaType {
+        SharedMediaNone = 0,
+        SharedMediaPhoto,
+        SharedMediaVideo,
+        SharedMediaDocument,
+        SharedMediaAudio,
+        SharedMediaLink
+    };
+
     DatabaseCore(const QString &path, const QString &configPath, const QString &phoneNumber, QObject *parent = 0);
     ~DatabaseCore();
 
     int getMessagesAvailable(const Peer &peer);
+    void cancelRequest(qint64 requestId);
 
 public Q_SLOTS:
     void setEncrypter(DatabaseAbstractEncryptor *encrypter);
@@ -44,19 +56,26 @@ public Q_SLOTS:
     void insertContact(const DbContact &contact);
     void insertMessage(const DbMessage &message, bool encrypted);
     void insertMediaEncryptedKeys(qint64 mediaId, const QByteArray &key, const QByteArray &iv);
+    void insertCache(int type, const QString &key, qint64 date, const QByteArray &data);
 
     void updateUnreadCount(qint64 chatId, int unreadCount);
 
     void readFullDialogs();
     void readMessages(const DbPeer &peer, int offset, int limit);
+    void readMessagesPage(qint64 requestId, const DbPeer &peer, int offset, int limit);
+    void readMessagesAvailable(qint64 requestId, const DbPeer &peer);
     void markMessagesAsRead(const qint32 maxId, const DbPeer &dpeer);
     void markMessagesAsReadFromMaxDate(qint32 chatId, qint32 maxDate);
+    void readCache(qint64 minDate);
+    void readValue(const QString &key);
+    void readSharedMedia(qint64 dialogId, int type, qint32 beforeDate, qint32 beforeId, int limit);
 
     void setValue(const QString &key, const QString &value);
     QString value(const QString &key) const;
 
     void deleteMessage(qint64 msgId);
     void deleteDialog(qint64 dlgId);
+    void deleteCache(const QString &key);
     void deleteHistory(qint64 dlgId);
 
     void blockUser(qint64 userId);
@@ -68,8 +87,13 @@ Q_SIGNALS:
     void dialogFounded(const DbDialog &dialog, bool encrypted);
     void contactFounded(const DbContact &contact);
     void messageFounded(const DbMessage &message);
+    void messagesPageFounded(qint64 requestId, const QList<DbMessage> &messages);
+    void messagesAvailableFounded(qint64 requestId, int count);
     void mediaKeyFounded(qint64 mediaId, const QByteArray &key, const QByteArray &iv);
+    void cacheFounded(int type, const QString &key, qint64 date, const QByteArray &data);
     void valueChanged(const QString &value);
+    void valueFounded(const QString &key, const QString &value);
+    void sharedMediaFounded(qint64 dialogId, int type, const QVariantList &items);
 
 protected:
     void timerEvent(QTimerEvent *e);
@@ -79,6 +103,9 @@ private:
     void readUsers();
     void readChats();
     void readContacts();
+    QList<DbMessage> queryMessages(const DbPeer &peer, int offset, int limit, qint64 requestId = 0);
+    void readMessageKeys(qint64 msgId);
+    bool takeCancelled(qint64 requestId);
 
     void init_buffer();
     void update_db();
@@ -91,6 +118,7 @@ private:
     QList<qint32> stringToUsers(const QString &str);
     QString usersToString( const QList<qint32> &users );
 
+    void insertSharedMedia(const Message &message, qint64 dialogId);
     void insertDocument(const Document &document);
     void insertGeo(int id, const GeoPoint &geo);
     void insertPhoto(const Photo &photo);
@@ -118,6 +146,8 @@ private:
     QHash<QString,QString> general;
     int commit_timer;
 
+    QMutex cancelMutex;
+    QSet<qint64> cancelled;
 };
 
 Q_DECLARE_METATYPE(DbUser)
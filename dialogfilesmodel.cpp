@@ -1,8 +1,14 @@
+#define SHARED_MEDIA_PAGE 60
+
 #include "dialogfilesmodel.h"
 #include "telegramqml.h"
+#include "database.h"
 #include "objects/types.h"
 
 #include <QPointer>
+#include <QMimeDatabase>
+#include <QMimeType>
+#include <QFileInfo>
 
 class DialogFilesModelPrivate
 {
@@ -10,6 +16,13 @@ public:
     QStringList list;
     QPointer<TelegramQml> telegram;
     DialogObject *dialog;
+    QMimeDatabase mime_db;
+
+    int mediaType;
+    QHash<QString, QVariantMap> items;
+    QHash<QString, QString> files;
+    bool loading;
+    bool hasMore;
 };
 
 DialogFilesModel::DialogFilesModel(QObject *parent) :
@@ -18,6 +31,9 @@ DialogFilesModel::DialogFilesModel(QObject *parent) :
     p = new DialogFilesModelPrivate;
     p->telegram = 0;
     p->dialog = 0;
+    p->mediaType = AllFiles;
+    p->loading = false;
+    p->hasMore = false;
 }
 
 TelegramQml *DialogFilesModel::telegram() const
@@ -30,7 +46,15 @@ void DialogFilesModel::setTelegram(TelegramQml *tg)
     if(p->telegram == tg)
         return;
 
+    if(p->telegram && p->telegram->database())
+        disconnect(p->telegram->database(), SIGNAL(sharedMediaFounded(qint64,int,QVariantList)),
+                   this, SLOT(sharedMediaFounded(qint64,int,QVariantList)));
+
     p->telegram = tg;
+    if(p->telegram && p->telegram->database())
+        connect(p->telegram->database(), SIGNAL(sharedMediaFounded(qint64,int,QVariantList)),
+                this, SLOT(sharedMediaFounded(qint64,int,QVariantList)));
+
     Q_EMIT telegramChanged();
 
     refresh();
@@ -52,6 +76,27 @@ void DialogFilesModel::setDialog(DialogObject *dlg)
     refresh();
 }
 
+int DialogFilesModel::mediaType() const
+{
+    return p->mediaType;
+}
+
+void DialogFilesModel::setMediaType(int type)
+{
+    if(p->mediaType == type)
+        return;
+
+    p->mediaType = type;
+    Q_EMIT mediaTypeChanged();
+
+    beginResetModel();
+    p->list.clear();
+    p->items.clear();
+    endResetModel();
+
+    refresh();
+}
+
 QString DialogFilesModel::id(const QModelIndex &index) const
 {
     return p->list.at(index.row());
@@ -65,11 +110,70 @@ int DialogFilesModel::rowCount(const QModelIndex &parent) const
 
 QVariant DialogFilesModel::data(const QModelIndex &index, int role) const
 {
-    const QString &fileName = id(index);
+    QString fileName = id(index);
     QVariant res;
     if(!p->telegram || !p->dialog)
         return res;
 
+    if(p->mediaType != AllFiles)
+    {
+        const QString rowId = fileName;
+        const QVariantMap &item = p->items.value(rowId);
+        fileName = indexedFile(item);
+
+        switch(role)
+        {
+        case Qt::DisplayRole:
+        case NameRole:
+            if(p->mediaType == Links)
+                res = item.value("url");
+            else
+            if(!item.value("fileName").toString().isEmpty())
+                res = item.value("fileName");
+            else
+                res = fileName;
+            break;
+
+        case PathRole:
+            res = fileName.isEmpty()? QString() : dirPath() + "/" + fileName;
+            break;
+
+        case ThumbnailRole:
+            res = fileName.isEmpty()? QString() : thumbnail(fileName, rowId);
+            break;
+
+        case SuffixRole:
+            res = QFileInfo(item.value("fileName").toString()).suffix();
+            break;
+
+        case MessageIdRole:
+            res = QmlUtils::getUnifiedMessageKey(item.value("msgId").toLongLong(), p->dialog->peer()->channelId());
+            break;
+
+        case DateRole:
+            res = item.value("date");
+            break;
+
+        case DownloadedRole:
+            res = !fileName.isEmpty();
+            break;
+
+        case UrlRole:
+            res = item.value("url");
+            break;
+
+        case SizeRole:
+            res = item.value("size");
+            break;
+
+        case MimeTypeRole:
+            res = item.value("mimeType");
+            break;
+        }
+
+        return res;
+    }
+
     switch(role)
     {
     case Qt::DisplayRole:
@@ -78,10 +182,13 @@ QVariant DialogFilesModel::data(const QModelIndex &index, int role) const
         break;
 
     case PathRole:
-    case ThumbnailRole:
         res = dirPath() + "/" + fileName;
         break;
 
+    case ThumbnailRole:
+        res = thumbnail(fileName, fileName);
+        break;
+
     case SuffixRole:
         res = "";
         break;
@@ -90,6 +197,47 @@ QVariant DialogFilesModel::data(const QModelIndex &index, int role) const
     return res;
 }
 
+QString DialogFilesModel::indexedFile(const QVariantMap &item) const
+{
+    const QString &fileKey = item.value("fileKey").toString();
+    return fileKey.isEmpty()? QString() : p->files.value(fileKey);
+}
+
+QString DialogFilesModel::thumbnail(const QString &fileName, const QString &rowId) const
+{
+    const QString &path = dirPath() + "/" + fileName;
+    const QMimeType &t = p->mime_db.mimeTypeForFile(path, QMimeDatabase::MatchExtension);
+    if(!t.name().startsWith("image/"))
+        return path;
+
+    // Grid tiles never need the full resolution photo. The row is refreshed
+    // when the scaled copy is ready.
+#ifdef TG_THUMBNAILER_CPP11
+    QPointer<DialogFilesModel> model = const_cast<DialogFilesModel*>(this);
+    TelegramThumbnailer_Callback callback = [model, rowId](){
+        if(model)
+            model->thumbnailCreated(rowId);
+    };
+#else
+    TelegramThumbnailer_Callback callback;
+    callback.object = const_cast<DialogFilesModel*>(this);
+    callback.method = "thumbnailCreated";
+    callback.args << rowId;
+#endif
+
+    return p->telegram->imageThumbLocation(path, callback);
+}
+
+void DialogFilesModel::thumbnailCreated(const QString &rowId)
+{
+    const int row = p->list.indexOf(rowId);
+    if(row == -1)
+        return;
+
+    const QModelIndex &idx = index(row);
+    Q_EMIT dataChanged(idx, idx, QVector<int>() << ThumbnailRole);
+}
+
 QHash<qint32, QByteArray> DialogFilesModel::roleNames() const
 {
     static QHash<qint32, QByteArray> *res = 0;
@@ -101,6 +249,12 @@ QHash<qint32, QByteArray> DialogFilesModel::roleNames() const
     res->insert( PathRole, "path");
     res->insert( ThumbnailRole, "thumbnail");
     res->insert( SuffixRole, "suffix");
+    res->insert( MessageIdRole, "messageId");
+    res->insert( DateRole, "date");
+    res->insert( DownloadedRole, "downloaded");
+    res->insert( UrlRole, "url");
+    res->insert( SizeRole, "size");
+    res->insert( MimeTypeRole, "mimeType");
     return *res;
 }
 
@@ -109,7 +263,96 @@ int DialogFilesModel::count() const
     return p->list.count();
 }
 
+bool DialogFilesModel::canFetchMore(const QModelIndex &parent) const
+{
+    if(parent.isValid() || p->mediaType == AllFiles)
+        return false;
+
+    return p->hasMore && !p->loading;
+}
+
+void DialogFilesModel::fetchMore(const QModelIndex &parent)
+{
+    if(!canFetchMore(parent) || !p->telegram || !p->dialog || !p->telegram->database())
+        return;
+
+    // Continues below the oldest row, new media does not shift the pages.
+    qint32 beforeDate = 0;
+    qint32 beforeId = 0;
+    if(!p->list.isEmpty())
+    {
+        const QVariantMap &last = p->items.value(p->list.last());
+        beforeDate = last.value("date").toInt();
+        beforeId = last.value("msgId").toInt();
+    }
+
+    p->loading = true;
+    p->telegram->database()->readSharedMedia(dialogId(), p->mediaType, beforeDate, beforeId, SHARED_MEDIA_PAGE);
+}
+
+void DialogFilesModel::sharedMediaFounded(qint64 dId, int type, const QVariantList &items)
+{
+    if(!p->loading || !p->dialog || dId != dialogId() || type != p->mediaType)
+        return;
+
+    p->loading = false;
+    p->hasMore = (items.count() == SHARED_MEDIA_PAGE);
+
+    QStringList rows;
+    Q_FOREACH(const QVariant &var, items)
+    {
+        const QVariantMap &item = var.toMap();
+        const QString &rowId = item.value("msgId").toString();
+        if(p->items.contains(rowId))
+            continue;
+
+        p->items[rowId] = item;
+        rows << rowId;
+    }
+
+    if(!rows.isEmpty())
+    {
+        beginInsertRows(QModelIndex(), p->list.count(), p->list.count()+rows.count()-1);
+        p->list << rows;
+        endInsertRows();
+    }
+
+    Q_EMIT countChanged();
+}
+
 void DialogFilesModel::refresh()
+{
+    if(p->mediaType == AllFiles)
+        refreshFiles();
+    else
+        refreshIndex();
+}
+
+void DialogFilesModel::refreshIndex()
+{
+    beginResetModel();
+    p->list.clear();
+    p->items.clear();
+    endResetModel();
+
+    // Downloaded files are matched to the index by the id in their name.
+    p->files.clear();
+    if(p->dialog && p->telegram)
+        Q_FOREACH(const QString &file, QDir(dirPath()).entryList(QDir::Files))
+        {
+            const int idx = file.lastIndexOf("_-_");
+            const QString &key = file.mid(idx==-1? 0 : idx+3).section('.', 0, 0);
+            p->files[key] = file;
+        }
+
+    p->hasMore = true;
+    p->loading = false;
+    Q_EMIT countChanged();
+
+    fetchMore(QModelIndex());
+}
+
+void DialogFilesModel::refreshFiles()
 {
     QStringList list;
     if(p->dialog && p->telegram)
@@ -171,13 +414,18 @@ QString DialogFilesModel::dirPath() const
     if(!p->telegram || !p->dialog)
         return QString();
 
+    return p->telegram->downloadPath() + "/" + QString::number(dialogId());
+}
+
+qint64 DialogFilesModel::dialogId() const
+{
     qint64 dId = p->dialog->peer()->chatId();
     if(!dId)
         dId = p->dialog->peer()->channelId();
     if(!dId)
         dId = p->dialog->peer()->userId();
 
-    return p->telegram->downloadPath() + "/" + QString::number(dId);
+    return dId;
 }
 
 DialogFilesModel::~DialogFilesModel()
@@ -3,6 +3,7 @@
 
 #include "telegramqml_global.h"
 #include "tgabstractlistmodel.h"
+#include "databasecore.h"
 
 class DialogObject;
 class TelegramQml;
@@ -11,17 +12,34 @@ class TELEGRAMQMLSHARED_EXPORT DialogFilesModel : public TgAbstractListModel
 {
     Q_OBJECT
     Q_ENUMS(FileRoles)
+    Q_ENUMS(MediaTypes)
 
     Q_PROPERTY(TelegramQml* telegram READ telegram WRITE setTelegram NOTIFY telegramChanged)
     Q_PROPERTY(DialogObject* dialog READ dialog WRITE setDialog NOTIFY dialogChanged)
     Q_PROPERTY(int count READ count NOTIFY countChanged)
+    Q_PROPERTY(int mediaType READ mediaType WRITE setMediaType NOTIFY mediaTypeChanged)
 
 public:
     enum FileRoles {
         NameRole = Qt::UserRole,
         PathRole,
         ThumbnailRole,
-        SuffixRole
+        SuffixRole,
+        MessageIdRole,
+        DateRole,
+        DownloadedRole,
+        UrlRole,
+        SizeRole,
+        MimeTypeRole
+    };
+
+    enum MediaTypes {
+        AllFiles = DatabaseCore::SharedMediaNone,
+        Photos = DatabaseCore::SharedMediaPhoto,
+        Videos = DatabaseCore::SharedMediaVideo,
+        Documents = DatabaseCore::SharedMediaDocument,
+        Audios = DatabaseCore::SharedMediaAudio,
+        Links = DatabaseCore::SharedMediaLink
     };
 
     DialogFilesModel(QObject *parent = 0);
@@ -33,6 +51,9 @@ public:
     DialogObject *dialog() const;
     void setDialog( DialogObject *dlg );
 
+    int mediaType() const;
+    void setMediaType(int type);
+
     QString id( const QModelIndex &index ) const;
     int rowCount(const QModelIndex & parent = QModelIndex()) const;
 
@@ -42,6 +63,9 @@ public:
 
     int count() const;
 
+    bool canFetchMore(const QModelIndex &parent) const;
+    void fetchMore(const QModelIndex &parent);
+
 public Q_SLOTS:
     void refresh();
 
@@ -49,9 +73,19 @@ Q_SIGNALS:
     void telegramChanged();
     void countChanged();
     void dialogChanged();
+    void mediaTypeChanged();
+
+private Q_SLOTS:
+    void thumbnailCreated(const QString &rowId);
+    void sharedMediaFounded(qint64 dialogId, int type, const QVariantList &items);
 
 private:
     QString dirPath() const;
+    qint64 dialogId() const;
+    QString thumbnail(const QString &fileName, const QString &rowId) const;
+    QString indexedFile(const QVariantMap &item) const;
+    void refreshFiles();
+    void refreshIndex();
 
 private:
     DialogFilesModelPrivate *p;
@@ -73,11 +73,7 @@ void StickersModel::recheck()
     if( !p->telegram || !p->telegram->authLoggedIn() )
         return;
 
-    Telegram *tg = p->telegram->telegram();
-    if(!tg)
-        return;
-
-    tg->messagesGetAllStickers(0);
+    p->telegram->messagesGetAllStickers();
     if(!p->currentSet.isEmpty() && !p->currentSet.toLongLong() && p->currentSet != "0")
         p->telegram->getStickerSet(p->currentSet);
 }
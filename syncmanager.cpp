@@ -1,12 +1,18 @@
+// Time given to an out of order update to be followed by the missing ones.
+#define GAP_WINDOW 500
+#define SYNC_DEBOUNCE 1500
+
 #include "syncmanager.h"
 
-SyncManager::SyncManager(TelegramQml *tQ)
+#include <QTimerEvent>
+
+SyncManager::SyncManager(TelegramQml *tQ) :
+    QObject(tQ)
 {
     this->tQ = tQ;
     this->_globalState = UpdatesState();
     this->_channelStates = QHash<qint32, UpdatesState>();
-    this->syncTask = new SyncManagerSyncTask(&serverSyncMutex, &serverSyncRequested, tQ);
-    syncTask->start();
+    this->syncTimer = 0;
 }
 
 UpdatesState SyncManager::getState(qint32 channelId)
@@ -25,8 +31,11 @@ UpdatesState SyncManager::getState(qint32 channelId)
 
 void SyncManager::requestSync()
 {
-    serverSyncRequested.wakeAll();
+    // Debounced: gaps found while a request is pending share it.
+    if (syncTimer)
+        return;
 
+    syncTimer = startTimer(SYNC_DEBOUNCE);
 }
 
 void SyncManager::setState(const UpdatesState &state, qint32 channelId)
@@ -39,6 +48,28 @@ void SyncManager::setState(const UpdatesState &state, qint32 channelId)
     else
         this->_channelStates[channelId] = UpdatesState(state);
     updateMutex.unlock();
+
+    // Everything up to the new state came with it, drop what is covered.
+    SyncManagerPtsStream &stream = ptsStreams[channelId];
+    while (!stream.pending.isEmpty() && stream.pending.firstKey() <= state.pts())
+        stream.pending.erase(stream.pending.begin());
+    while (!stream.applied.isEmpty() && stream.applied.firstKey() <= state.pts())
+        stream.applied.erase(stream.applied.begin());
+    flushPts(channelId);
+
+    // Ranges already seen ahead of the new state count as applied.
+    if (channelId == 0)
+    {
+        qint32 seq = 0;
+        qint32 qts = 0;
+        checkSequence(seqStream, state.seq(), 0, 0, &seq);
+        checkSequence(qtsStream, state.qts(), 0, 0, &qts);
+
+        updateMutex.lock();
+        this->_globalState.setSeq(seq);
+        this->_globalState.setQts(qts);
+        updateMutex.unlock();
+    }
 }
 
 bool SyncManager::isSynced(const UpdatesState &state, qint32 channelId)
@@ -47,36 +78,283 @@ bool SyncManager::isSynced(const UpdatesState &state, qint32 channelId)
     updateMutex.lock();
     if (channelId == 0)
     {
-        result = (this->_globalState.seq() == state.seq() );
+        result = (this->_globalState.seq() == state.seq() &&
+                  this->_globalState.pts() == state.pts() &&
+                  this->_globalState.qts() == state.qts());
     }
     else
     {
         if (this->_channelStates.contains(channelId))
         {
             UpdatesState currentState = this->_channelStates[channelId];
-            result = (currentState.seq() == state.seq() - 1);
+            result = (currentState.pts() == state.pts());
         }
     }
     updateMutex.unlock();
     return result;
 }
 
-SyncManagerSyncTask::SyncManagerSyncTask(QMutex *serverSyncMutex, QWaitCondition *serverSyncRequested, TelegramQml *tQ, QObject *parent): QThread(parent)
+bool SyncManager::hasPts(const Update &update, qint32 *channelId)
 {
-    this->tQ = tQ;
-    this->serverSyncMutex = serverSyncMutex;
-    this->serverSyncRequested = serverSyncRequested;
+    qint32 channel = 0;
+    switch (static_cast<int>(update.classType()))
+    {
+    case Update::typeUpdateNewChannelMessage:
+    case Update::typeUpdateEditChannelMessage:
+        channel = update.message().toId().channelId();
+        break;
+    case Update::typeUpdateDeleteChannelMessages:
+        channel = update.channelId();
+        break;
+    case Update::typeUpdateNewMessage:
+    case Update::typeUpdateEditMessage:
+    case Update::typeUpdateDeleteMessages:
+    case Update::typeUpdateReadHistoryInbox:
+    case Update::typeUpdateReadHistoryOutbox:
+    case Update::typeUpdateReadMessagesContents:
+    case Update::typeUpdateWebPage:
+        break;
+    default:
+        return false;
+    }
+
+    if (channelId)
+        *channelId = channel;
+    return update.pts() != 0;
+}
+
+void SyncManager::pushUpdate(const Update &update)
+{
+    qint32 channelId = 0;
+    if (!hasPts(update, &channelId))
+    {
+        Q_EMIT updateReady(update);
+        return;
+    }
+
+    const qint32 local = localPts(channelId);
+    if (local == 0 || local + update.ptsCount() == update.pts())
+    {
+        setLocalPts(channelId, update.pts());
+        Q_EMIT updateReady(update);
+        flushPts(channelId);
+    }
+    else
+    if (local + update.ptsCount() > update.pts())
+    {
+        // Already applied, e.g. our own action echoed back.
+        return;
+    }
+    else
+    {
+        SyncManagerPtsStream &stream = ptsStreams[channelId];
+        stream.pending.insert(update.pts(), update);
+        startGap(&stream.gapTimer);
+    }
 }
 
-void SyncManagerSyncTask::run()
+void SyncManager::advancePts(qint32 pts, qint32 ptsCount, qint32 channelId)
 {
-    serverSyncMutex->lock();
-    while(true)
+    if (pts == 0)
+        return;
+
+    const qint32 local = localPts(channelId);
+    if (local == 0 || local + ptsCount == pts)
+    {
+        setLocalPts(channelId, pts);
+        flushPts(channelId);
+    }
+    else
+    if (local + ptsCount < pts)
+    {
+        // Already applied by the caller, local pts moves past it once the
+        // gap before it fills.
+        SyncManagerPtsStream &stream = ptsStreams[channelId];
+        stream.applied.insert(pts, ptsCount);
+        startGap(&stream.gapTimer);
+    }
+}
+
+bool SyncManager::checkSeq(qint32 seqStart, qint32 seq, qint32 date)
+{
+    if (seq == 0)
+        return true;
+
+    qint32 newLocal = 0;
+    const bool applied = checkSequence(seqStream, getState().seq(), seqStart? seqStart : seq, seq, &newLocal);
+
+    UpdatesState state = getState();
+    if (newLocal != state.seq())
+    {
+        state.setSeq(newLocal);
+        state.setDate(date);
+        updateMutex.lock();
+        this->_globalState = state;
+        updateMutex.unlock();
+    }
+
+    return applied;
+}
+
+bool SyncManager::checkQts(qint32 qts)
+{
+    if (qts == 0)
+        return true;
+
+    qint32 newLocal = 0;
+    const bool applied = checkSequence(qtsStream, getState().qts(), qts, qts, &newLocal);
+
+    UpdatesState state = getState();
+    if (newLocal != state.qts())
     {
-        serverSyncRequested->wait(this->serverSyncMutex);
-        QThread::msleep(1500);
+        state.setQts(newLocal);
+        updateMutex.lock();
+        this->_globalState = state;
+        updateMutex.unlock();
+    }
+
+    return applied;
+}
+
+bool SyncManager::checkSequence(SyncManagerSeqStream &stream, qint32 local, qint32 start, qint32 end, qint32 *newLocal)
+{
+    *newLocal = local;
+    bool applied = true;
+    if (start && end)
+    {
+        if (local == 0 || local + 1 == start)
+            *newLocal = end;
+        else
+        if (end <= local)
+            applied = false;
+        else
+            stream.ahead.insert(start, end);
+    }
+
+    // Ranges seen ahead of the gap are accounted once it fills.
+    while (!stream.ahead.isEmpty() && stream.ahead.firstKey() <= *newLocal + 1)
+    {
+        *newLocal = qMax(*newLocal, stream.ahead.first());
+        stream.ahead.erase(stream.ahead.begin());
+    }
+
+    if (stream.ahead.isEmpty())
+        stopGap(&stream.gapTimer);
+    else
+        startGap(&stream.gapTimer);
+
+    return applied;
+}
+
+void SyncManager::timerEvent(QTimerEvent *e)
+{
+    const int timerId = e->timerId();
+    if (timerId == syncTimer)
+    {
+        killTimer(syncTimer);
+        syncTimer = 0;
         qWarning() << "Deferred execution of server synchronization requested";
         QMetaObject::invokeMethod(tQ, "updatesGetDifference", Qt::QueuedConnection);
+        return;
+    }
 
+    if (timerId == seqStream.gapTimer || timerId == qtsStream.gapTimer)
+    {
+        stopGap(timerId == seqStream.gapTimer? &seqStream.gapTimer : &qtsStream.gapTimer);
+        seqStream.ahead.clear();
+        qtsStream.ahead.clear();
+        requestSync();
+        return;
     }
+
+    QMutableHashIterator<qint32, SyncManagerPtsStream> i(ptsStreams);
+    while (i.hasNext())
+    {
+        i.next();
+        if (i.value().gapTimer != timerId)
+            continue;
+
+        // The gap did not fill, the difference brings the buffered updates too.
+        stopGap(&i.value().gapTimer);
+        i.value().pending.clear();
+        i.value().applied.clear();
+        if (i.key() == 0)
+            requestSync();
+        else
+            Q_EMIT channelSyncRequested(i.key());
+        return;
+    }
+
+    QObject::timerEvent(e);
+}
+
+qint32 SyncManager::localPts(qint32 channelId)
+{
+    return getState(channelId).pts();
+}
+
+void SyncManager::setLocalPts(qint32 channelId, qint32 pts)
+{
+    updateMutex.lock();
+    if (channelId == 0)
+        this->_globalState.setPts(pts);
+    else
+        this->_channelStates[channelId].setPts(pts);
+    updateMutex.unlock();
+}
+
+void SyncManager::flushPts(qint32 channelId)
+{
+    if (!ptsStreams.contains(channelId))
+        return;
+
+    SyncManagerPtsStream &stream = ptsStreams[channelId];
+    while (true)
+    {
+        const qint32 local = localPts(channelId);
+        if (!stream.applied.isEmpty() && stream.applied.firstKey() - stream.applied.first() <= local)
+        {
+            if (stream.applied.firstKey() > local)
+                setLocalPts(channelId, stream.applied.firstKey());
+            stream.applied.erase(stream.applied.begin());
+            continue;
+        }
+
+        if (stream.pending.isEmpty())
+            break;
+
+        const Update update = stream.pending.first();
+        if (local + update.ptsCount() > update.pts())
+        {
+            stream.pending.erase(stream.pending.begin());
+            continue;
+        }
+        if (local + update.ptsCount() < update.pts())
+            break;
+
+        stream.pending.erase(stream.pending.begin());
+        setLocalPts(channelId, update.pts());
+        Q_EMIT updateReady(update);
+    }
+
+    // The gap is closed once local pts caught up with everything seen ahead.
+    if (stream.pending.isEmpty() && stream.applied.isEmpty())
+        stopGap(&stream.gapTimer);
+}
+
+void SyncManager::startGap(int *timer)
+{
+    if (*timer)
+        return;
+
+    *timer = startTimer(GAP_WINDOW);
+}
+
+void SyncManager::stopGap(int *timer)
+{
+    if (!*timer)
+        return;
+
+    killTimer(*timer);
+    *timer = 0;
 }
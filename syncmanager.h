@@ -3,8 +3,9 @@
 
 #include <QObject>
 #include <QList>
+#include <QMap>
+#include <QHash>
 #include <QMutex>
-#include <QWaitCondition>
 #include <QLoggingCategory>
 #include "telegramqml.h"
 #include "telegram.h"
@@ -12,27 +13,41 @@
 
 Q_DECLARE_LOGGING_CATEGORY(TG_QML_SYNCMGR)
 
-class SyncManagerSyncTask: public QThread
+class SyncManagerPtsStream
 {
-    TelegramQml *tQ;
-    QMutex *serverSyncMutex;
-    QWaitCondition *serverSyncRequested;
+public:
+    SyncManagerPtsStream(): gapTimer(0) {}
+    QMap<qint32, Update> pending;
+    QMap<qint32, qint32> applied;
+    int gapTimer;
+};
 
+class SyncManagerSeqStream
+{
 public:
-    SyncManagerSyncTask(QMutex *serverSyncMutex, QWaitCondition *serverSyncRequested, TelegramQml *tQ, QObject *parent = NULL);
-    void run();
+    SyncManagerSeqStream(): gapTimer(0) {}
+    QMap<qint32, qint32> ahead;
+    int gapTimer;
 };
 
+/*!
+ * Tracks the pts, qts and seq sequences of the update streams. Updates that
+ * arrive after a gap are held back for a short window and applied in order
+ * once the gap fills, a gap that persists ends in a single, debounced
+ * difference request.
+ */
 class TELEGRAMQMLSHARED_EXPORT SyncManager : public QObject
 {
+    Q_OBJECT
     TelegramQml *tQ;
     UpdatesState _globalState;
     QHash<qint32, UpdatesState> _channelStates;
     QMutex updateMutex;
-    QMutex serverSyncMutex;
-    QWaitCondition serverSyncRequested;
 
-    SyncManagerSyncTask *syncTask;
+    QHash<qint32, SyncManagerPtsStream> ptsStreams;
+    SyncManagerSeqStream seqStream;
+    SyncManagerSeqStream qtsStream;
+    int syncTimer;
 
 public:
     SyncManager(TelegramQml *tQ);
@@ -41,6 +56,27 @@ public:
     UpdatesState getState(qint32 channelId = 0);
     void requestSync();
 
+    void pushUpdate(const Update &update);
+    void advancePts(qint32 pts, qint32 ptsCount, qint32 channelId = 0);
+    bool checkSeq(qint32 seqStart, qint32 seq, qint32 date);
+    bool checkQts(qint32 qts);
+
+    static bool hasPts(const Update &update, qint32 *channelId = 0);
+
+Q_SIGNALS:
+    void updateReady(const Update &update);
+    void channelSyncRequested(qint32 channelId);
+
+protected:
+    void timerEvent(QTimerEvent *e);
+
+private:
+    qint32 localPts(qint32 channelId);
+    void setLocalPts(qint32 channelId, qint32 pts);
+    void flushPts(qint32 channelId);
+    void startGap(int *timer);
+    void stopGap(int *timer);
+    bool checkSequence(SyncManagerSeqStream &stream, qint32 local, qint32 start, qint32 end, qint32 *newLocal);
 };
 
 
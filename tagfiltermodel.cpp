@@ -1,5 +1,6 @@
 #include "tagfiltermodel.h"
 #include "userdata.h"
+#include "telegramnarrowingfilter.h"
 
 #include <QPointer>
 #include <QStringList>
@@ -7,9 +8,13 @@
 class TagFilterModelPrivate
 {
 public:
+    TagFilterModelPrivate(): filter(TelegramNarrowingFilter<QString>::Substring) {}
+
     QPointer<UserData> userData;
     QStringList tags;
+    QStringList source;
     QString keyword;
+    TelegramNarrowingFilter<QString> filter;
 };
 
 TagFilterModel::TagFilterModel(QObject *parent) :
@@ -117,64 +122,15 @@ void TagFilterModel::listChanged()
     if(p->userData)
         tags = p->userData->tags();
 
-    const QString &keywod = p->keyword.toLower();
-    for(int i=0; i<tags.count(); i++)
-    {
-        if(tags.at(i).contains(keywod))
-            continue;
-
-        tags.removeAt(i);
-        i--;
-    }
-
-    for( int i=0 ; i<p->tags.count() ; i++ )
-    {
-        const QString &tag = p->tags.at(i);
-        if( tags.contains(tag) )
-            continue;
-
-        beginRemoveRows(QModelIndex(), i, i);
-        p->tags.removeAt(i);
-        i--;
-        endRemoveRows();
-    }
-
-
-    QStringList temp_tags = tags;
-    for( int i=0 ; i<temp_tags.count() ; i++ )
-    {
-        const QString &tag = temp_tags.at(i);
-        if( p->tags.contains(tag) )
-            continue;
-
-        temp_tags.removeAt(i);
-        i--;
-    }
-    while( p->tags != temp_tags )
-        for( int i=0 ; i<p->tags.count() ; i++ )
-        {
-            const QString &tag = p->tags.at(i);
-            int nw = temp_tags.indexOf(tag);
-            if( i == nw )
-                continue;
-
-            beginMoveRows( QModelIndex(), i, i, QModelIndex(), nw>i?nw+1:nw );
-            p->tags.move( i, nw );
-            endMoveRows();
-        }
-
-
-    for( int i=0 ; i<tags.count() ; i++ )
+    if(tags != p->source)
     {
-        const QString &tag = tags.at(i);
-        if( p->tags.contains(tag) )
-            continue;
-
-        beginInsertRows(QModelIndex(), i, i );
-        p->tags.insert( i, tag );
-        endInsertRows();
+        p->source = tags;
+        p->filter.clear();
+        Q_FOREACH(const QString &tag, tags)
+            p->filter.setKey(tag, tag);
     }
 
+    updateRows(p->tags, p->filter.filter(p->keyword));
     Q_EMIT countChanged();
 }
 
@@ -16,7 +16,10 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#define PARTICIPANTS_PAGE 200
+
 #include "telegramchatparticipantsmodel.h"
+#include "telegramnarrowingfilter.h"
 #include "telegramqml.h"
 #include "objects/types.h"
 
@@ -31,6 +34,10 @@ public:
     QList<qint64> participants_list;
     QPointer<DialogObject> dialog;
     bool refreshing;
+
+    int filter;
+    QString keyword;
+    TelegramNarrowingFilter<qint64> names;
 };
 
 TelegramChatParticipantsModel::TelegramChatParticipantsModel(QObject *parent) :
@@ -39,6 +46,7 @@ TelegramChatParticipantsModel::TelegramChatParticipantsModel(QObject *parent) :
     p = new TelegramChatParticipantsModelPrivate;
     p->telegram = 0;
     p->refreshing = false;
+    p->filter = RecentFilter;
 }
 
 TelegramQml *TelegramChatParticipantsModel::telegram() const
@@ -52,12 +60,22 @@ void TelegramChatParticipantsModel::setTelegram(TelegramQml *tgo)
     if( p->telegram == tg )
         return;
 
+    if( p->telegram )
+    {
+        disconnect( p->telegram->participantsStore(), SIGNAL(participantsChanged(qint64)), this, SLOT(participantsChanged(qint64)) );
+        disconnect( p->telegram->participantsStore(), SIGNAL(participantsFailed(qint64)), this, SLOT(participantsFailed(qint64)) );
+        disconnect( p->telegram, SIGNAL(usersChanged()), this, SLOT(usersChanged()) );
+    }
+
     p->telegram = tg;
     Q_EMIT telegramChanged();
     if( !p->telegram )
         return;
 
-    connect( p->telegram, SIGNAL(chatFullsChanged()), SLOT(chatFullsChanged()) );
+    connect( p->telegram->participantsStore(), SIGNAL(participantsChanged(qint64)), SLOT(participantsChanged(qint64)) );
+    connect( p->telegram->participantsStore(), SIGNAL(participantsFailed(qint64)), SLOT(participantsFailed(qint64)) );
+    connect( p->telegram, SIGNAL(usersChanged()), SLOT(usersChanged()) );
+    updateParticipants();
     refresh();
 }
 
@@ -75,14 +93,55 @@ void TelegramChatParticipantsModel::setDialog(DialogObject *dlg)
     Q_EMIT dialogChanged();
 
     beginResetModel();
+    qDeleteAll(p->participants);
     p->participants.clear();
+    p->participants_list.clear();
+    p->names.clear();
     endResetModel();
 
-    if(!p->dialog && !p->dialog->peer()->chatId() && !p->dialog->peer()->channelId())
+    if( !chatId() )
         return;
+
+    // Whatever is stored already shows up before the server answers.
+    updateParticipants();
     refresh();
 }
 
+int TelegramChatParticipantsModel::filter() const
+{
+    return p->filter;
+}
+
+void TelegramChatParticipantsModel::setFilter(int filter)
+{
+    if( p->filter == filter )
+        return;
+
+    p->filter = filter;
+    Q_EMIT filterChanged();
+
+    updateParticipants();
+    if( isChannel() )
+        refresh();
+}
+
+QString TelegramChatParticipantsModel::keyword() const
+{
+    return p->keyword;
+}
+
+void TelegramChatParticipantsModel::setKeyword(const QString &keyword)
+{
+    if( p->keyword == keyword )
+        return;
+
+    p->keyword = keyword;
+    p->names.filter(keyword);
+    Q_EMIT keywordChanged();
+
+    updateParticipants();
+}
+
 qint64 TelegramChatParticipantsModel::id(const QModelIndex &index) const
 {
     int row = index.row();
@@ -92,17 +151,29 @@ qint64 TelegramChatParticipantsModel::id(const QModelIndex &index) const
 int TelegramChatParticipantsModel::rowCount(const QModelIndex &parent) const
 {
     Q_UNUSED(parent)
-    return p->participants.count();
+    return p->participants_list.count();
 }
 
 QVariant TelegramChatParticipantsModel::data(const QModelIndex &index, int role) const
 {
     QVariant res;
     const qint64 key = id(index);
+    ChatParticipantObject *obj = p->participants.value(key);
+    if( !obj )
+        return res;
+
     switch( role )
     {
     case ItemRole:
-        res = QVariant::fromValue<ChatParticipantObject*>(p->participants.value(key));
+        res = QVariant::fromValue<ChatParticipantObject*>(obj);
+        break;
+
+    case UserIdRole:
+        res = obj->userId();
+        break;
+
+    case TypeRole:
+        res = obj->classType();
         break;
     }
 
@@ -117,12 +188,23 @@ QHash<qint32, QByteArray> TelegramChatParticipantsModel::roleNames() const
 
     res = new QHash<qint32, QByteArray>();
     res->insert( ItemRole, "item");
+    res->insert( UserIdRole, "userId");
+    res->insert( TypeRole, "type");
     return *res;
 }
 
 int TelegramChatParticipantsModel::count() const
 {
-    return p->participants.count();
+    return p->participants_list.count();
+}
+
+int TelegramChatParticipantsModel::total() const
+{
+    if( !p->telegram || !chatId() )
+        return 0;
+
+    const int res = p->telegram->participantsStore()->total(chatId(), isChannel()? p->filter : RecentFilter);
+    return res == -1? p->participants_list.count() : res;
 }
 
 bool TelegramChatParticipantsModel::refreshing() const
@@ -130,52 +212,149 @@ bool TelegramChatParticipantsModel::refreshing() const
     return p->refreshing;
 }
 
-void TelegramChatParticipantsModel::refresh()
+bool TelegramChatParticipantsModel::canFetchMore(const QModelIndex &parent) const
 {
-    if( !p->telegram || !p->dialog )
+    if( parent.isValid() || !p->telegram || !isChannel() || p->refreshing )
+        return false;
+
+    return p->telegram->participantsStore()->hasMore(chatId(), p->filter);
+}
+
+void TelegramChatParticipantsModel::fetchMore(const QModelIndex &parent)
+{
+    if( !canFetchMore(parent) )
         return;
-    qint64 dId = p->dialog->peer()->chatId();
-    if(!dId)
-        dId = p->dialog->peer()->channelId();
-    if(!dId)
+
+    const int offset = p->telegram->participantsStore()->count(chatId(), p->filter);
+    p->telegram->channelsGetParticipants(chatId(), p->filter, offset, PARTICIPANTS_PAGE);
+
+    p->refreshing = true;
+    Q_EMIT refreshingChanged();
+}
+
+void TelegramChatParticipantsModel::refresh()
+{
+    if( !p->telegram || !chatId() )
         return;
-    if(p->dialog->peer()->classType() == Peer::typePeerChat)
-        p->telegram->messagesGetFullChat(dId);
+
+    if( isChannel() )
+        p->telegram->channelsGetParticipants(chatId(), p->filter, 0, PARTICIPANTS_PAGE);
     else
+        p->telegram->messagesGetFullChat(chatId());
+
+    p->refreshing = true;
+    Q_EMIT refreshingChanged();
+}
+
+void TelegramChatParticipantsModel::participantsChanged(qint64 chatId)
+{
+    if( chatId != this->chatId() )
+        return;
+
+    if( p->refreshing )
     {
-        p->telegram->channelsGetFullChannel(dId);
+        p->refreshing = false;
+        Q_EMIT refreshingChanged();
     }
 
-    p->refreshing = true;
+    updateParticipants();
+}
+
+void TelegramChatParticipantsModel::participantsFailed(qint64 chatId)
+{
+    if( chatId != this->chatId() || !p->refreshing )
+        return;
+
+    p->refreshing = false;
     Q_EMIT refreshingChanged();
 }
 
-void TelegramChatParticipantsModel::chatFullsChanged()
+void TelegramChatParticipantsModel::usersChanged()
 {
-    beginResetModel();
-    p->participants.clear();
-    endResetModel();
+    // Names only matter while searching.
+    if( !p->keyword.isEmpty() )
+        updateParticipants();
+}
+
+qint64 TelegramChatParticipantsModel::chatId() const
+{
+    if( !p->dialog )
+        return 0;
 
     qint64 dId = p->dialog->peer()->chatId();
-    if(!dId)
+    if( !dId )
         dId = p->dialog->peer()->channelId();
-    ChatFullObject *chatFull = p->telegram->chatFull(dId);
-    if( !chatFull )
+
+    return dId;
+}
+
+bool TelegramChatParticipantsModel::isChannel() const
+{
+    return p->dialog && p->dialog->peer()->classType() == Peer::typePeerChannel;
+}
+
+void TelegramChatParticipantsModel::updateParticipants()
+{
+    if( !p->telegram || !chatId() )
         return;
 
-    ChatParticipantList *list = chatFull->participants()->participants();
-    for( int i=0 ; i<list->count() ; i++ )
+    // Basic groups come complete from their ChatFull and are filtered here.
+    const bool channel = isChannel();
+    const QList<ChatParticipant> &list = p->telegram->participantsStore()->participants(chatId(), channel? p->filter : RecentFilter);
+
+    QHash<qint64, ChatParticipant> participants;
+    QList<qint64> rows;
+    Q_FOREACH( const ChatParticipant &participant, list )
+    {
+        const qint64 userId = participant.userId();
+        if( !channel && p->filter != RecentFilter )
+        {
+            const bool admin = participant.classType() == ChatParticipant::typeChatParticipantCreator ||
+                               participant.classType() == ChatParticipant::typeChatParticipantAdmin;
+            if( p->filter != AdminsFilter || !admin )
+                continue;
+        }
+
+        UserObject *user = p->telegram->user(userId);
+        p->names.setKey(userId, user->firstName() + " " + user->lastName() + " " + user->username());
+        participants[userId] = participant;
+        rows << userId;
+    }
+
+    if( !p->keyword.isEmpty() )
     {
-        ChatParticipantObject *obj = list->at(i);
+        QList<qint64> matched;
+        Q_FOREACH( qint64 userId, rows )
+            if( p->names.accepts(userId) )
+                matched << userId;
+        rows = matched;
+    }
 
-        beginInsertRows(QModelIndex(), i, i );
-        p->participants.insert( obj->userId(), obj );
-        p->participants_list << obj->userId();
-        endInsertRows();
+    Q_FOREACH( qint64 userId, rows )
+    {
+        ChatParticipantObject *obj = p->participants.value(userId);
+        if( obj )
+            *obj = participants.value(userId);
+        else
+            p->participants[userId] = new ChatParticipantObject(participants.value(userId), this);
     }
 
-    p->refreshing = false;
-    Q_EMIT refreshingChanged();
+    updateRows(p->participants_list, rows);
+
+    const QSet<qint64> &rowSet = rows.toSet();
+    QMutableHashIterator<qint64, ChatParticipantObject*> i(p->participants);
+    while( i.hasNext() )
+    {
+        i.next();
+        if( rowSet.contains(i.key()) )
+            continue;
+
+        i.value()->deleteLater();
+        i.remove();
+    }
+
+    Q_EMIT countChanged();
+    Q_EMIT totalChanged();
 }
 
 TelegramChatParticipantsModel::~TelegramChatParticipantsModel()
@@ -21,6 +21,7 @@
 
 #include "telegramqml_global.h"
 #include "tgabstractlistmodel.h"
+#include "telegramparticipantsstore.h"
 
 class TelegramQml;
 class DialogObject;
@@ -29,15 +30,28 @@ class TELEGRAMQMLSHARED_EXPORT TelegramChatParticipantsModel : public TgAbstract
 {
     Q_OBJECT
     Q_ENUMS(DialogsRoles)
+    Q_ENUMS(Filters)
 
     Q_PROPERTY(TelegramQml* telegram READ telegram WRITE setTelegram NOTIFY telegramChanged)
     Q_PROPERTY(DialogObject* dialog READ dialog WRITE setDialog NOTIFY dialogChanged)
     Q_PROPERTY(int count READ count NOTIFY countChanged)
     Q_PROPERTY(bool refreshing  READ refreshing  NOTIFY refreshingChanged)
+    Q_PROPERTY(int filter READ filter WRITE setFilter NOTIFY filterChanged)
+    Q_PROPERTY(QString keyword READ keyword WRITE setKeyword NOTIFY keywordChanged)
+    Q_PROPERTY(int total READ total NOTIFY totalChanged)
 
 public:
     enum DialogsRoles {
-        ItemRole = Qt::UserRole
+        ItemRole = Qt::UserRole,
+        UserIdRole,
+        TypeRole
+    };
+
+    enum Filters {
+        RecentFilter = TelegramParticipantsStore::RecentFilter,
+        AdminsFilter = TelegramParticipantsStore::AdminsFilter,
+        KickedFilter = TelegramParticipantsStore::KickedFilter,
+        BotsFilter = TelegramParticipantsStore::BotsFilter
     };
 
 public:
@@ -50,6 +64,12 @@ public:
     DialogObject *dialog() const;
     void setDialog( DialogObject *dlg );
 
+    int filter() const;
+    void setFilter(int filter);
+
+    QString keyword() const;
+    void setKeyword(const QString &keyword);
+
     qint64 id( const QModelIndex &index ) const;
     int rowCount(const QModelIndex & parent = QModelIndex()) const;
 
@@ -58,8 +78,12 @@ public:
     QHash<qint32,QByteArray> roleNames() const;
 
     int count() const;
+    int total() const;
     bool refreshing() const;
 
+    bool canFetchMore(const QModelIndex &parent) const;
+    void fetchMore(const QModelIndex &parent);
+
 public Q_SLOTS:
     void refresh();
 
@@ -68,9 +92,19 @@ Q_SIGNALS:
     void dialogChanged();
     void countChanged();
     void refreshingChanged();
+    void filterChanged();
+    void keywordChanged();
+    void totalChanged();
 
 private Q_SLOTS:
-    void chatFullsChanged();
+    void participantsChanged(qint64 chatId);
+    void participantsFailed(qint64 chatId);
+    void usersChanged();
+
+private:
+    qint64 chatId() const;
+    bool isChannel() const;
+    void updateParticipants();
 
 private:
     TelegramChatParticipantsModelPrivate *p;
@@ -16,8 +16,6 @@
 */
 
 
-#include <QRegExp>
-
 #include "telegramdetailedcontactsmodel.h"
 #include "telegramcontactsfiltermodel.h"
 
@@ -33,11 +31,48 @@ TelegramContactsFilterModel::~TelegramContactsFilterModel()
 bool TelegramContactsFilterModel::filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const {
     QModelIndex index = sourceModel()->index(sourceRow, 0, sourceParent);
 
-    QString fullName = sourceModel()->data(index, TelegramDetailedContactsModel::FullNameRole).toString();
-    qint32 id = sourceModel()->data(index, TelegramDetailedContactsModel::IdRole).toInt();
+    qint64 id = sourceModel()->data(index, TelegramDetailedContactsModel::IdRole).toLongLong();
+    if (id == mOwnId)
+        return false;
+
+    // Names are normalized once, keystrokes only test the cached keys.
+    if (!mFilter.contains(id))
+        mFilter.setKey(id, sourceModel()->data(index, TelegramDetailedContactsModel::FullNameRole).toString());
 
-    bool notSelf = (id != mOwnId);
-    return notSelf && (fullName.contains(filterRegExp()));
+    return mFilter.accepts(id);
+}
+
+void TelegramContactsFilterModel::setSourceModel(QAbstractItemModel *model)
+{
+    if (sourceModel()) {
+        disconnect(sourceModel(), SIGNAL(dataChanged(QModelIndex,QModelIndex)), this, SLOT(sourceDataChanged(QModelIndex,QModelIndex)));
+        disconnect(sourceModel(), SIGNAL(modelReset()), this, SLOT(sourceReset()));
+    }
+
+    mFilter.clear();
+
+    // Connected before the proxy itself, so keys are fresh when it filters.
+    if (model) {
+        connect(model, SIGNAL(dataChanged(QModelIndex,QModelIndex)), SLOT(sourceDataChanged(QModelIndex,QModelIndex)));
+        connect(model, SIGNAL(modelReset()), SLOT(sourceReset()));
+    }
+
+    QSortFilterProxyModel::setSourceModel(model);
+}
+
+void TelegramContactsFilterModel::sourceDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight)
+{
+    for (int row = topLeft.row(); row <= bottomRight.row(); row++) {
+        QModelIndex index = sourceModel()->index(row, 0, topLeft.parent());
+        qint64 id = sourceModel()->data(index, TelegramDetailedContactsModel::IdRole).toLongLong();
+        mFilter.setKey(id, sourceModel()->data(index, TelegramDetailedContactsModel::FullNameRole).toString());
+    }
+}
+
+void TelegramContactsFilterModel::sourceReset()
+{
+    mFilter.clear();
+    mFilter.filter(mSearchTerm);
 }
 
 QString TelegramContactsFilterModel::searchTerm() const
@@ -50,9 +85,8 @@ void TelegramContactsFilterModel::setSearchTerm(const QString &searchTerm)
     if (mSearchTerm != searchTerm) {
         mSearchTerm = searchTerm;
 
-        QString pattern = QString("\\b%1").arg(searchTerm);
-        setFilterKeyColumn(0);
-        setFilterRegExp(QRegExp(pattern, Qt::CaseInsensitive));
+        mFilter.filter(searchTerm);
+        invalidateFilter();
 
         Q_EMIT searchTermChanged();
     }
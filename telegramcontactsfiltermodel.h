@@ -22,6 +22,7 @@
 #include <QSortFilterProxyModel>
 
 #include "telegramqml_global.h"
+#include "telegramnarrowingfilter.h"
 
 class TELEGRAMQMLSHARED_EXPORT TelegramContactsFilterModel : public QSortFilterProxyModel
 {
@@ -35,6 +36,7 @@ public:
     ~TelegramContactsFilterModel();
 
     bool filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const;
+    void setSourceModel(QAbstractItemModel *model);
 
     Q_INVOKABLE QVariant get(int rowIndex) const;
 
@@ -45,9 +47,14 @@ Q_SIGNALS:
     void searchTermChanged();
     void countChanged();
 
+private Q_SLOTS:
+    void sourceDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight);
+    void sourceReset();
+
 private:
     qint64 mOwnId;
     QString mSearchTerm;
+    mutable TelegramNarrowingFilter<qint64> mFilter;
 };
 
 #endif // TELEGRAMCONTACTSFILTERMODEL_H
@@ -19,15 +19,21 @@
 #include "telegramcontactsmodel.h"
 #include "telegramqml.h"
 #include "objects/types.h"
+#include "telegramsortkeys.h"
 
 #include <telegram.h>
 #include <QPointer>
+#include <QSet>
+
+#include <algorithm>
+#include <iterator>
 
 class TelegramContactsModelPrivate
 {
 public:
     QPointer<TelegramQml> telegram;
     QList<qint64> contacts;
+    QHash<qint64, QString> names;
     bool initializing;
 };
 
@@ -129,9 +135,7 @@ void TelegramContactsModel::recheck()
 {
     if( !p->telegram || !p->telegram->authLoggedIn() )
         return;
-    Telegram *tg = p->telegram->telegram();
-    if(tg)
-        tg->contactsGetContacts();
+    p->telegram->contactsGetContacts();
 }
 
 void TelegramContactsModel::contactsChanged()
@@ -139,30 +143,38 @@ void TelegramContactsModel::contactsChanged()
     if(!p->telegram)
         return;
 
-    const QList<qint64> & contacts_unsort = p->telegram->contacts();
-    QMap<QString,qint64> sort_map;
-    Q_FOREACH( qint64 id, contacts_unsort )
+    TelegramSortKeys *keys = p->telegram->userSortKeys();
+    const QSet<qint64> &contacts = p->telegram->contacts().toSet();
+
+    // Rows whose name did not change are still in order, only new and
+    // renamed contacts are sorted and merged in.
+    QList<qint64> rest;
+    QList<qint64> added;
+    Q_FOREACH( qint64 id, p->contacts )
     {
-        UserObject *user = p->telegram->user(id);
-        sort_map.insertMulti( user->firstName() + " " + user->lastName(), id );
+        if( !contacts.contains(id) )
+            p->names.remove(id);
+        else
+        if( p->names.value(id) == keys->text(id) )
+            rest << id;
+        else
+            added << id;
     }
+    Q_FOREACH( qint64 id, contacts )
+        if( !p->names.contains(id) )
+            added << id;
 
-    const QList<qint64> & contacts = sort_map.values();
+    Q_FOREACH( qint64 id, added )
+        p->names[id] = keys->text(id);
 
-    beginResetModel();
-    p->contacts.clear();
-    endResetModel();
+    auto lessThan = [keys](qint64 a, qint64 b) { return keys->lessThan(a, b); };
+    std::sort(added.begin(), added.end(), lessThan);
 
-    for( int i=0 ; i<contacts.count() ; i++ )
-    {
-        const qint64 dId = contacts.at(i);
-        if( p->contacts.contains(dId) )
-            continue;
+    QList<qint64> next;
+    next.reserve(rest.count() + added.count());
+    std::merge(rest.begin(), rest.end(), added.begin(), added.end(), std::back_inserter(next), lessThan);
 
-        beginInsertRows(QModelIndex(), i, i );
-        p->contacts.insert( i, dId );
-        endInsertRows();
-    }
+    updateRows(p->contacts, next);
 
     p->initializing = false;
     Q_EMIT initializingChanged();
@@ -24,6 +24,8 @@
 
 #include <telegram.h>
 #include <QPointer>
+#include <QDateTime>
+#include <QSet>
 
 class TelegramDialogsModelPrivate
 {
@@ -35,6 +37,10 @@ public:
     int refresh_timer;
 
     QList<qint64> dialogs;
+    QHash<QObject*, qint64> watched;
+
+    qint64 love;
+    QSet<qint64> favorites;
 };
 
 TelegramDialogsModel::TelegramDialogsModel(QObject *parent) :
@@ -45,6 +51,7 @@ TelegramDialogsModel::TelegramDialogsModel(QObject *parent) :
     p->initializing = false;
     p->stopUpdating = false;
     p->refresh_timer = 0;
+    p->love = 0;
 }
 
 TelegramQml *TelegramDialogsModel::telegram() const
@@ -62,8 +69,8 @@ void TelegramDialogsModel::setTelegram(TelegramQml *tgo)
         disconnect( p->telegram, SIGNAL(dialogsChanged(bool)), this, SLOT(dialogsChanged(bool)) );
         disconnect( p->telegram, SIGNAL(phoneNumberChanged()), this, SLOT(refreshDatabase()) );
 
-        disconnect( p->telegram->userData(), SIGNAL(favoriteChanged(int)) , this, SLOT(userDataChanged()) );
-        disconnect( p->telegram->userData(), SIGNAL(valueChanged(QString)), this, SLOT(userDataChanged()) );
+        disconnect( p->telegram->userData(), SIGNAL(favoriteChanged(int)) , this, SLOT(favoriteChanged(int)) );
+        disconnect( p->telegram->userData(), SIGNAL(valueChanged(QString)), this, SLOT(userValueChanged(QString)) );
     }
 
     p->telegram = tgo;
@@ -73,10 +80,12 @@ void TelegramDialogsModel::setTelegram(TelegramQml *tgo)
         connect( p->telegram, SIGNAL(dialogsChanged(bool)), SLOT(dialogsChanged(bool)) );
         connect( p->telegram, SIGNAL(phoneNumberChanged()), SLOT(refreshDatabase()), Qt::QueuedConnection );
 
-        connect( p->telegram->userData(), SIGNAL(favoriteChanged(int)) , this, SLOT(userDataChanged()) );
-        connect( p->telegram->userData(), SIGNAL(valueChanged(QString)), this, SLOT(userDataChanged()) );
+        connect( p->telegram->userData(), SIGNAL(favoriteChanged(int)) , this, SLOT(favoriteChanged(int)) );
+        connect( p->telegram->userData(), SIGNAL(valueChanged(QString)), this, SLOT(userValueChanged(QString)) );
     }
 
+    reloadPartitions();
+
     Q_EMIT telegramChanged();
     Q_EMIT initializingChanged();
 }
@@ -121,13 +130,155 @@ QVariant TelegramDialogsModel::data(const QModelIndex &index, int role) const
         break;
 
     case SectionRole:
-        res = p->telegram->userData()->value("love").toLongLong()==key? 2 : (p->telegram->userData()->isFavorited(key)? 1 : 0);
+        res = partitionOf(key);
+        break;
+    }
+    if( role == ItemRole || role == SectionRole )
+        return res;
+
+    // Flat roles are read straight from the store, delegates using only
+    // them never bind to the dialog object.
+    DialogObject *dialog = p->telegram->dialog(key);
+    if( dialog == p->telegram->nullDialog() )
+        return res;
+
+    watchObject(dialog, key, QList<const char*>() << SIGNAL(unreadCountChanged()) << SIGNAL(topMessageChanged())
+                                                  << SIGNAL(typingUsersChanged()) << SIGNAL(notifySettingsChanged()));
+    watchObject(dialog->notifySettings(), key, QList<const char*>() << SIGNAL(muteUntilChanged()));
+
+    PeerObject *peer = dialog->peer();
+    switch( role )
+    {
+    case TitleRole:
+    {
+        qint64 userId = peer->userId();
+        if( dialog->encrypted() )
+        {
+            EncryptedChatObject *chat = p->telegram->encryptedChat(peer->userId());
+            userId = chat->adminId()==p->telegram->me()? chat->participantId() : chat->adminId();
+        }
+
+        if( peer->classType() == Peer::typePeerUser )
+        {
+            UserObject *user = p->telegram->user(userId);
+            if( user != p->telegram->nullUser() )
+                watchObject(user, key, QList<const char*>() << SIGNAL(firstNameChanged()) << SIGNAL(lastNameChanged()));
+            res = (user->firstName() + " " + user->lastName()).trimmed();
+        }
+        else
+        {
+            ChatObject *chat = p->telegram->chat(peer->classType()==Peer::typePeerChannel? peer->channelId() : peer->chatId());
+            if( chat != p->telegram->nullChat() )
+                watchObject(chat, key, QList<const char*>() << SIGNAL(titleChanged()));
+            res = chat->title();
+        }
+    }
+        break;
+
+    case PeerIdRole:
+        res = key;
+        break;
+
+    case PeerTypeRole:
+        res = peer->classType();
+        break;
+
+    case EncryptedRole:
+        res = dialog->encrypted();
+        break;
+
+    case UnreadCountRole:
+        res = dialog->unreadCount();
+        break;
+
+    case MutedRole:
+        res = dialog->notifySettings()->muteUntil() > QDateTime::currentDateTime().toTime_t();
+        break;
+
+    case TypingUsersRole:
+        res = dialog->typingUsers();
+        break;
+
+    case TopMessageTextRole:
+    case TopMessageDateRole:
+    case TopMessageOutRole:
+    {
+        const qint64 msgKey = QmlUtils::getUnifiedMessageKey(dialog->topMessage(), peer->channelId());
+        MessageObject *msg = p->telegram->message(msgKey);
+        if( msg == p->telegram->nullMessage() )
+            break;
+
+        watchObject(msg, key, QList<const char*>() << SIGNAL(messageChanged()));
+        if( role == TopMessageTextRole )
+            res = msg->message();
+        else
+        if( role == TopMessageDateRole )
+            res = msg->date();
+        else
+            res = msg->out();
+    }
         break;
     }
 
     return res;
 }
 
+void TelegramDialogsModel::watchObject(QObject *obj, qint64 key, const QList<const char *> &signalList) const
+{
+    if( !obj || p->watched.contains(obj) )
+        return;
+
+    p->watched[obj] = key;
+    Q_FOREACH( const char *signal, signalList )
+        connect( obj, signal, this, SLOT(dialogObjectChanged()) );
+    connect( obj, SIGNAL(destroyed(QObject*)), this, SLOT(dialogObjectDestroyed(QObject*)) );
+}
+
+void TelegramDialogsModel::unwatchObjects()
+{
+    QHashIterator<QObject*, qint64> i(p->watched);
+    while( i.hasNext() )
+    {
+        i.next();
+        disconnect( i.key(), 0, this, 0 );
+    }
+
+    p->watched.clear();
+}
+
+void TelegramDialogsModel::pruneWatched()
+{
+    const QSet<qint64> &rows = p->dialogs.toSet();
+    QMutableHashIterator<QObject*, qint64> i(p->watched);
+    while( i.hasNext() )
+    {
+        i.next();
+        if( rows.contains(i.value()) )
+            continue;
+
+        disconnect( i.key(), 0, this, 0 );
+        i.remove();
+    }
+}
+
+void TelegramDialogsModel::dialogObjectChanged()
+{
+    const int row = p->dialogs.indexOf( p->watched.value(sender()) );
+    if( row == -1 )
+        return;
+
+    static const QVector<int> roles = QVector<int>() << TitleRole << UnreadCountRole << MutedRole
+                                                     << TypingUsersRole << TopMessageTextRole
+                                                     << TopMessageDateRole << TopMessageOutRole;
+    const QModelIndex &idx = index(row);
+    Q_EMIT dataChanged(idx, idx, roles);
+}
+
+void TelegramDialogsModel::dialogObjectDestroyed(QObject *obj)
+{
+    p->watched.remove(obj);
+}
+
 QHash<qint32, QByteArray> TelegramDialogsModel::roleNames() const
 {
     static QHash<qint32, QByteArray> *res = 0;
@@ -137,6 +288,16 @@ QHash<qint32, QByteArray> TelegramDialogsModel::roleNames() const
     res = new QHash<qint32, QByteArray>();
     res->insert( ItemRole, "item");
     res->insert( SectionRole, "section");
+    res->insert( TitleRole, "title");
+    res->insert( PeerIdRole, "peerId");
+    res->insert( PeerTypeRole, "peerType");
+    res->insert( EncryptedRole, "encrypted");
+    res->insert( UnreadCountRole, "unreadCount");
+    res->insert( MutedRole, "muted");
+    res->insert( TypingUsersRole, "typingUsers");
+    res->insert( TopMessageTextRole, "topMessageText");
+    res->insert( TopMessageDateRole, "topMessageDate");
+    res->insert( TopMessageOutRole, "topMessageOut");
     return *res;
 }
 
@@ -150,6 +311,22 @@ bool TelegramDialogsModel::initializing() const
     return p->initializing;
 }
 
+bool TelegramDialogsModel::canFetchMore(const QModelIndex &parent) const
+{
+    if(parent.isValid() || !p->telegram)
+        return false;
+
+    return p->telegram->dialogsHasMore();
+}
+
+void TelegramDialogsModel::fetchMore(const QModelIndex &parent)
+{
+    if(parent.isValid() || !p->telegram)
+        return;
+
+    p->telegram->fetchMoreDialogs();
+}
+
 int TelegramDialogsModel::indexOf(DialogObject *dialog)
 {
     if(!dialog)
@@ -176,6 +353,7 @@ void TelegramDialogsModel::refreshDatabase()
 {
     if(!p->telegram)
         return;
+    reloadPartitions();
     telegram()->setBusy(true);
     p->telegram->database()->readFullDialogs();
     telegram()->setBusy(false);
@@ -203,98 +381,100 @@ void TelegramDialogsModel::dialogsChanged_priv()
     if(p->stopUpdating)
         return;
 
-    const QList<qint64> & dialogs = fixDialogs(p->telegram->dialogs());
+    updateRows(p->dialogs, fixDialogs(p->telegram->dialogs()));
 
-    for( int i=0 ; i<p->dialogs.count() ; i++ )
-    {
-        const qint64 dId = p->dialogs.at(i);
-        if( dialogs.contains(dId) )
-            continue;
+    pruneWatched();
+    Q_EMIT countChanged();
+}
 
-        beginRemoveRows(QModelIndex(), i, i);
-        p->dialogs.removeAt(i);
-        i--;
-        endRemoveRows();
-    }
+void TelegramDialogsModel::favoriteChanged(int id)
+{
+    const bool favorited = p->telegram->userData()->isFavorited(id);
+    if( favorited == p->favorites.contains(id) )
+        return;
 
+    if( favorited )
+        p->favorites.insert(id);
+    else
+        p->favorites.remove(id);
 
-    QList<qint64> temp_msgs = dialogs;
-    for( int i=0 ; i<temp_msgs.count() ; i++ )
-    {
-        const qint64 dId = temp_msgs.at(i);
-        if( p->dialogs.contains(dId) )
-            continue;
-
-        temp_msgs.removeAt(i);
-        i--;
-    }
-    while( p->dialogs != temp_msgs )
-        for( int i=0 ; i<p->dialogs.count() ; i++ )
-        {
-            const qint64 dId = p->dialogs.at(i);
-            int nw = temp_msgs.indexOf(dId);
-            if( i == nw )
-                continue;
-
-            beginMoveRows( QModelIndex(), i, i, QModelIndex(), nw>i?nw+1:nw );
-            p->dialogs.move( i, nw );
-            endMoveRows();
-        }
+    // Only the toggled row changes partition, updateRows moves just that one.
+    if( p->stopUpdating || !p->dialogs.contains(id) )
+        return;
 
+    updateRows(p->dialogs, fixDialogs(p->telegram->dialogs()));
+    updateSection(id);
+}
 
-    for( int i=0 ; i<dialogs.count() ; i++ )
-    {
-        const qint64 dId = dialogs.at(i);
-        if( p->dialogs.contains(dId) )
-            continue;
+void TelegramDialogsModel::userValueChanged(const QString &key)
+{
+    if( key != "love" )
+        return;
 
-        beginInsertRows(QModelIndex(), i, i );
-        p->dialogs.insert( i, dId );
-        endInsertRows();
-    }
+    const qint64 oldLove = p->love;
+    p->love = p->telegram->userData()->value("love").toLongLong();
+    if( oldLove == p->love || p->stopUpdating )
+        return;
 
-    Q_EMIT countChanged();
+    updateRows(p->dialogs, fixDialogs(p->telegram->dialogs()));
+    updateSection(oldLove);
+    updateSection(p->love);
 }
 
-void TelegramDialogsModel::userDataChanged()
+void TelegramDialogsModel::reloadPartitions()
 {
-    const QList<qint64> & dialogs = fixDialogs(p->telegram->dialogs());
+    p->love = 0;
+    p->favorites.clear();
+    if( !p->telegram )
+        return;
 
-    beginResetModel();
-    p->dialogs.clear();
-    endResetModel();
+    p->love = p->telegram->userData()->value("love").toLongLong();
+    Q_FOREACH( int id, p->telegram->userData()->favorites() )
+        p->favorites.insert(id);
+}
 
-    for( int i=0 ; i<dialogs.count() ; i++ )
-    {
-        const qint64 dId = dialogs.at(i);
-        if( p->dialogs.contains(dId) )
-            continue;
+int TelegramDialogsModel::partitionOf(qint64 dId) const
+{
+    if( p->love && dId == p->love )
+        return 2;
+    if( p->favorites.contains(dId) )
+        return 1;
+    return 0;
+}
 
-        beginInsertRows(QModelIndex(), i, i );
-        p->dialogs.insert( i, dId );
-        endInsertRows();
-    }
+void TelegramDialogsModel::updateSection(qint64 dId)
+{
+    const int row = p->dialogs.indexOf(dId);
+    if( row == -1 )
+        return;
+
+    const QModelIndex &idx = index(row);
+    Q_EMIT dataChanged(idx, idx, QVector<int>() << SectionRole);
 }
 
 QList<qint64> TelegramDialogsModel::fixDialogs(QList<qint64> dialogs)
 {
-    int fav_counts = 0;
-    for( int i=0; i<dialogs.count(); i++ )
+    // Love first, then favorites, each keeping the recency order.
+    QList<qint64> love;
+    QList<qint64> favorites;
+    QList<qint64> others;
+    Q_FOREACH( qint64 dId, dialogs )
     {
-        qint64 dId = dialogs.at(i);
-        if( p->telegram->userData()->isFavorited(dId) )
+        switch( partitionOf(dId) )
         {
-            dialogs.move(i, fav_counts);
-            fav_counts++;
+        case 2:
+            love << dId;
+            break;
+        case 1:
+            favorites << dId;
+            break;
+        default:
+            others << dId;
+            break;
         }
     }
 
-    qint64 love_id = p->telegram->userData()->value("love").toLongLong();
-    int love_idx = dialogs.indexOf(love_id);
-    if( love_idx != -1 )
-        dialogs.move(love_idx, 0);
-
-    return dialogs;
+    return love + favorites + others;
 }
 
 void TelegramDialogsModel::timerEvent(QTimerEvent *e)
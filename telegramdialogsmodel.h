@@ -38,7 +38,17 @@ class TELEGRAMQMLSHARED_EXPORT TelegramDialogsModel : public TgAbstractListModel
 public:
     enum DialogsRoles {
         ItemRole = Qt::UserRole,
-        SectionRole
+        SectionRole,
+        TitleRole,
+        PeerIdRole,
+        PeerTypeRole,
+        EncryptedRole,
+        UnreadCountRole,
+        MutedRole,
+        TypingUsersRole,
+        TopMessageTextRole,
+        TopMessageDateRole,
+        TopMessageOutRole
     };
 
     TelegramDialogsModel(QObject *parent = 0);
@@ -60,6 +70,9 @@ public:
     int count() const;
     bool initializing() const;
 
+    bool canFetchMore(const QModelIndex &parent) const;
+    void fetchMore(const QModelIndex &parent);
+
     Q_INVOKABLE int indexOf(DialogObject *dialog);
     Q_INVOKABLE DialogObject *at(int row);
 
@@ -75,13 +88,24 @@ Q_SIGNALS:
 private Q_SLOTS:
     void dialogsChanged(bool cachedData);
     void dialogsChanged_priv();
-    void userDataChanged();
+    void favoriteChanged(int id);
+    void userValueChanged(const QString &key);
+    void dialogObjectChanged();
+    void dialogObjectDestroyed(QObject *obj);
 
     QList<qint64> fixDialogs(QList<qint64> dialogs );
 
 protected:
     void timerEvent(QTimerEvent *e);
 
+private:
+    void watchObject(QObject *obj, qint64 key, const QList<const char*> &signalList) const;
+    void unwatchObjects();
+    void pruneWatched();
+    void reloadPartitions();
+    int partitionOf(qint64 dId) const;
+    void updateSection(qint64 dId);
+
 private:
     TelegramDialogsModelPrivate *p;
 };
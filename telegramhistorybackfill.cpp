@@ -0,0 +1,361 @@
+/*
+    Copyright (C) 2014 Aseman
+    http://aseman.co
+
+    This project is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This project is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define DEFAULT_DIALOG_LIMIT 20
+#define DEFAULT_MESSAGE_LIMIT 50
+#define DEFAULT_REQUEST_BUDGET 60
+#define DEFAULT_BYTE_BUDGET (2*1024*1024)
+#define BUDGET_WINDOW (60*60*1000)
+#define IDLE_CHECK_INTERVAL 60000
+#define STEP_INTERVAL 2000
+// Rough size of a message besides its text, media and entities included.
+#define MESSAGE_OVERHEAD 256
+
+#include "telegramhistorybackfill.h"
+#include "telegramrequestscheduler.h"
+#include "telegramqml.h"
+#include "database.h"
+#include "userdata.h"
+#include "objects/types.h"
+
+#include <telegram.h>
+
+#include <QTimerEvent>
+#include <QDateTime>
+#include <QPointer>
+#include <QHash>
+
+class TelegramHistoryBackfillPrivate
+{
+public:
+    QPointer<TelegramQml> telegram;
+    QPointer<TelegramRequestScheduler> scheduler;
+
+    bool enabled;
+    int dialogLimit;
+    int messageLimit;
+    int requestBudget;
+    qint64 byteBudget;
+
+    int timer;
+    bool running;
+
+    qint64 windowStart;
+    int windowRequests;
+    qint64 windowBytes;
+
+    qint64 totalRequests;
+    qint64 totalMessages;
+    qint64 totalBytes;
+
+    QHash<qint64, qint32> filled;
+    QHash<qint64, qint32> rejected;
+};
+
+TelegramHistoryBackfill::TelegramHistoryBackfill(TelegramQml *telegram, TelegramRequestScheduler *scheduler) :
+    QObject(telegram)
+{
+    p = new TelegramHistoryBackfillPrivate;
+    p->telegram = telegram;
+    p->scheduler = scheduler;
+    p->enabled = true;
+    p->dialogLimit = DEFAULT_DIALOG_LIMIT;
+    p->messageLimit = DEFAULT_MESSAGE_LIMIT;
+    p->requestBudget = DEFAULT_REQUEST_BUDGET;
+    p->byteBudget = DEFAULT_BYTE_BUDGET;
+    p->timer = 0;
+    p->running = false;
+    p->windowStart = 0;
+    p->windowRequests = 0;
+    p->windowBytes = 0;
+    p->totalRequests = 0;
+    p->totalMessages = 0;
+    p->totalBytes = 0;
+
+    connect(scheduler, SIGNAL(dropped(QString)), SLOT(requestDropped(QString)));
+    restartTimer(IDLE_CHECK_INTERVAL);
+}
+
+void TelegramHistoryBackfill::setEnabled(bool stt)
+{
+    if(p->enabled == stt)
+        return;
+
+    p->enabled = stt;
+    if(p->enabled)
+        restartTimer(IDLE_CHECK_INTERVAL);
+    else
+    if(p->timer)
+    {
+        killTimer(p->timer);
+        p->timer = 0;
+    }
+
+    Q_EMIT enabledChanged();
+}
+
+bool TelegramHistoryBackfill::enabled() const
+{
+    return p->enabled;
+}
+
+void TelegramHistoryBackfill::setDialogLimit(int limit)
+{
+    if(p->dialogLimit == limit)
+        return;
+
+    p->dialogLimit = limit;
+    Q_EMIT dialogLimitChanged();
+}
+
+int TelegramHistoryBackfill::dialogLimit() const
+{
+    return p->dialogLimit;
+}
+
+void TelegramHistoryBackfill::setMessageLimit(int limit)
+{
+    if(p->messageLimit == limit)
+        return;
+
+    p->messageLimit = limit;
+    Q_EMIT messageLimitChanged();
+}
+
+int TelegramHistoryBackfill::messageLimit() const
+{
+    return p->messageLimit;
+}
+
+void TelegramHistoryBackfill::setRequestBudget(int budget)
+{
+    if(p->requestBudget == budget)
+        return;
+
+    p->requestBudget = budget;
+    Q_EMIT requestBudgetChanged();
+}
+
+int TelegramHistoryBackfill::requestBudget() const
+{
+    return p->requestBudget;
+}
+
+void TelegramHistoryBackfill::setByteBudget(qint64 budget)
+{
+    if(p->byteBudget == budget)
+        return;
+
+    p->byteBudget = budget;
+    Q_EMIT byteBudgetChanged();
+}
+
+qint64 TelegramHistoryBackfill::byteBudget() const
+{
+    return p->byteBudget;
+}
+
+QVariantMap TelegramHistoryBackfill::metrics() const
+{
+    QVariantMap res;
+    res["requests"] = p->totalRequests;
+    res["messages"] = p->totalMessages;
+    res["bytes"] = p->totalBytes;
+    res["windowRequests"] = p->windowRequests;
+    res["windowBytes"] = p->windowBytes;
+    res["filledDialogs"] = p->filled.count();
+    return res;
+}
+
+void TelegramHistoryBackfill::reset()
+{
+    p->filled.clear();
+    p->rejected.clear();
+    p->running = false;
+    p->windowStart = 0;
+    p->windowRequests = 0;
+    p->windowBytes = 0;
+}
+
+void TelegramHistoryBackfill::step()
+{
+    if(!p->enabled || p->running || !p->telegram || !p->scheduler)
+        return;
+
+    Telegram *tg = p->telegram->telegram();
+    if(!tg || !tg->isConnected() || p->telegram->background() || !p->scheduler->isIdle() || !budgetLeft())
+    {
+        restartTimer(IDLE_CHECK_INTERVAL);
+        return;
+    }
+
+    const qint64 dId = nextDialog();
+    if(!dId)
+    {
+        restartTimer(IDLE_CHECK_INTERVAL);
+        return;
+    }
+
+    const qint32 topMessage = p->telegram->dialog(dId)->topMessage();
+    const InputPeer &peer = p->telegram->getInputPeer(dId);
+    const int limit = p->messageLimit;
+
+    QPointer<TelegramHistoryBackfill> guard = this;
+    TelegramCore::Callback<MessagesMessages> callback = [this, guard, dId, topMessage](TG_MESSAGES_GET_HISTORY_CALLBACK) {
+        if(!guard)
+            return;
+
+        // A FLOOD_WAIT answer is retried by the scheduler, the step is still running.
+        if(!error.null && p->scheduler->serverError(msgId, error.errorCode, error.errorText))
+            return;
+
+        p->running = false;
+        if(!error.null)
+        {
+            // Transient failures are tried again, a rejected dialog waits
+            // for its next message.
+            if(error.errorCode == 400)
+                p->rejected[dId] = topMessage;
+            restartTimer(IDLE_CHECK_INTERVAL);
+            return;
+        }
+
+        p->filled[dId] = topMessage;
+
+        p->scheduler->finished(msgId);
+
+        // Straight to the database, the objects are created once the chat is opened.
+        Database *db = p->telegram? p->telegram->database() : 0;
+        if(db)
+        {
+            Q_FOREACH(const User &user, result.users())
+                db->insertUser(user);
+            Q_FOREACH(const Chat &chat, result.chats())
+                db->insertChat(chat);
+            Q_FOREACH(const Message &message, result.messages())
+            {
+                db->insertMessage(message, false);
+
+                const qint64 bytes = message.message().toUtf8().size() + MESSAGE_OVERHEAD;
+                p->windowBytes += bytes;
+                p->totalBytes += bytes;
+            }
+        }
+
+        p->totalMessages += result.messages().count();
+        restartTimer(STEP_INTERVAL);
+    };
+
+    p->running = true;
+    p->windowRequests++;
+    p->totalRequests++;
+    p->scheduler->schedule("messagesGetHistory", TelegramRequestScheduler::BackgroundSync, [this, peer, limit, callback]() -> qint64 {
+        Telegram *tg = p->telegram? p->telegram->telegram() : 0;
+        if(!tg)
+        {
+            p->running = false;
+            return 0;
+        }
+        return tg->messagesGetHistory(peer, 0, 0, 0, limit, 0, 0, callback);
+    });
+}
+
+qint64 TelegramHistoryBackfill::nextDialog() const
+{
+    UserData *userData = p->telegram->userData();
+
+    // Favorites first, then unread, then the rest by recency.
+    QList<qint64> favorites;
+    QList<qint64> unread;
+    QList<qint64> recent;
+    Q_FOREACH(qint64 dId, p->telegram->dialogs())
+    {
+        DialogObject *dialog = p->telegram->dialog(dId);
+        if(dialog == p->telegram->nullDialog() || dialog->encrypted() || !dialog->topMessage())
+            continue;
+
+        if(userData && userData->isFavorited(dId))
+            favorites << dId;
+        else
+        if(dialog->unreadCount())
+            unread << dId;
+        else
+            recent << dId;
+    }
+
+    const QList<qint64> &candidates = (favorites + unread + recent).mid(0, p->dialogLimit);
+    Q_FOREACH(qint64 dId, candidates)
+    {
+        const qint32 topMessage = p->telegram->dialog(dId)->topMessage();
+        if(p->filled.value(dId) == topMessage || p->rejected.value(dId) == topMessage)
+            continue;
+
+        return dId;
+    }
+
+    return 0;
+}
+
+bool TelegramHistoryBackfill::budgetLeft()
+{
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    if(now - p->windowStart > BUDGET_WINDOW)
+    {
+        p->windowStart = now;
+        p->windowRequests = 0;
+        p->windowBytes = 0;
+    }
+
+    return p->windowRequests < p->requestBudget && p->windowBytes < p->byteBudget;
+}
+
+void TelegramHistoryBackfill::requestDropped(const QString &method)
+{
+    // Lost to a disconnect or a timeout, the answer will never come.
+    if(method != "messagesGetHistory" || !p->running)
+        return;
+
+    p->running = false;
+    restartTimer(IDLE_CHECK_INTERVAL);
+}
+
+void TelegramHistoryBackfill::restartTimer(int interval)
+{
+    if(p->timer)
+        killTimer(p->timer);
+
+    p->timer = p->enabled? startTimer(interval) : 0;
+}
+
+void TelegramHistoryBackfill::timerEvent(QTimerEvent *e)
+{
+    if(e->timerId() == p->timer)
+    {
+        killTimer(p->timer);
+        p->timer = 0;
+        step();
+        return;
+    }
+
+    QObject::timerEvent(e);
+}
+
+TelegramHistoryBackfill::~TelegramHistoryBackfill()
+{
+    delete p;
+}
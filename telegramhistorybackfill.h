@@ -0,0 +1,95 @@
+/*
+    Copyright (C) 2014 Aseman
+    http://aseman.co
+
+    This project is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This project is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TELEGRAMHISTORYBACKFILL_H
+#define TELEGRAMHISTORYBACKFILL_H
+
+#include <QObject>
+#include <QVariantMap>
+
+#include "telegramqml_global.h"
+
+class TelegramQml;
+class TelegramRequestScheduler;
+class TelegramHistoryBackfillPrivate;
+
+/*!
+ * Fills the local message cache of the most relevant dialogs while the
+ * client is online and has nothing else to do. The recent history of the
+ * favorite, unread and most recent dialogs is fetched with background
+ * priority and written to the database only, so opening one of those
+ * chats later is answered by a local read. Work is bounded by a request
+ * and a byte budget per hour.
+ */
+class TELEGRAMQMLSHARED_EXPORT TelegramHistoryBackfill : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(bool enabled READ enabled WRITE setEnabled NOTIFY enabledChanged)
+    Q_PROPERTY(int dialogLimit READ dialogLimit WRITE setDialogLimit NOTIFY dialogLimitChanged)
+    Q_PROPERTY(int messageLimit READ messageLimit WRITE setMessageLimit NOTIFY messageLimitChanged)
+    Q_PROPERTY(int requestBudget READ requestBudget WRITE setRequestBudget NOTIFY requestBudgetChanged)
+    Q_PROPERTY(qint64 byteBudget READ byteBudget WRITE setByteBudget NOTIFY byteBudgetChanged)
+
+public:
+    TelegramHistoryBackfill(TelegramQml *telegram, TelegramRequestScheduler *scheduler);
+    ~TelegramHistoryBackfill();
+
+    void setEnabled(bool stt);
+    bool enabled() const;
+
+    void setDialogLimit(int limit);
+    int dialogLimit() const;
+
+    void setMessageLimit(int limit);
+    int messageLimit() const;
+
+    void setRequestBudget(int budget);
+    int requestBudget() const;
+
+    void setByteBudget(qint64 budget);
+    qint64 byteBudget() const;
+
+    Q_INVOKABLE QVariantMap metrics() const;
+
+public Q_SLOTS:
+    void reset();
+
+private Q_SLOTS:
+    void requestDropped(const QString &method);
+
+Q_SIGNALS:
+    void enabledChanged();
+    void dialogLimitChanged();
+    void messageLimitChanged();
+    void requestBudgetChanged();
+    void byteBudgetChanged();
+
+protected:
+    void timerEvent(QTimerEvent *e);
+
+private:
+    void step();
+    qint64 nextDialog() const;
+    bool budgetLeft();
+    void restartTimer(int interval);
+
+private:
+    TelegramHistoryBackfillPrivate *p;
+};
+
+#endif // TELEGRAMHISTORYBACKFILL_H
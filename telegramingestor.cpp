@@ -0,0 +1,122 @@
+/*
+    Copyright (C) 2014 Aseman
+    http://aseman.co
+
+    This project is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This project is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "telegramingestor.h"
+#include "telegramqml.h"
+#include "utils.h"
+
+#include <QThreadPool>
+#include <QRunnable>
+
+#include <algorithm>
+
+bool checkIngestRecordLessThan(const TelegramIngestRecord &a, const TelegramIngestRecord &b)
+{
+    // Same order as the dialog message lists, newest first.
+    if(a.message.date() != b.message.date())
+        return a.message.date() > b.message.date();
+    else
+        return a.unifiedId > b.unifiedId;
+}
+
+class TelegramIngestorJob : public QRunnable
+{
+public:
+    TelegramIngestorJob(const TelegramIngestBatch &batch, const QList<Message> &messages, TelegramIngestor *ingestor) :
+        batch(batch), messages(messages), ingestor(ingestor) {}
+
+    void run() {
+        TelegramIngestor::normalize(batch, messages);
+        QMetaObject::invokeMethod(ingestor, "jobFinished", Qt::QueuedConnection,
+                                  Q_ARG(TelegramIngestBatch, batch));
+    }
+
+private:
+    TelegramIngestBatch batch;
+    QList<Message> messages;
+    TelegramIngestor *ingestor;
+};
+
+TelegramIngestor::TelegramIngestor(QObject *parent) :
+    QObject(parent),
+    lastId(0),
+    running(0)
+{
+    qRegisterMetaType<TelegramIngestBatch>("TelegramIngestBatch");
+
+    // A single worker keeps the batches in order.
+    pool = new QThreadPool(this);
+    pool->setMaxThreadCount(1);
+}
+
+qint64 TelegramIngestor::ingest(const QList<Message> &messages, const QList<User> &users, const QList<Chat> &chats)
+{
+    TelegramIngestBatch batch;
+    batch.id = ++lastId;
+    batch.users = users;
+    batch.chats = chats;
+
+    running++;
+    pool->start(new TelegramIngestorJob(batch, messages, this));
+    return batch.id;
+}
+
+int TelegramIngestor::pending() const
+{
+    return running;
+}
+
+void TelegramIngestor::normalize(TelegramIngestBatch &batch, const QList<Message> &messages)
+{
+    batch.records.reserve(messages.count());
+    Q_FOREACH(const Message &m, messages)
+    {
+        if (m.id() == 0 || (m.message().isEmpty()
+                && m.action().classType() == MessageAction::typeMessageActionEmpty
+                && m.media().classType() == MessageMedia::typeMessageMediaEmpty))
+            continue;
+
+        TelegramIngestRecord record;
+        record.message = m;
+        record.unifiedId = QmlUtils::getUnifiedMessageKey(m.id(), m.toId().channelId());
+        if(m.replyToMsgId())
+            record.replyToUnifiedId = QmlUtils::getUnifiedMessageKey(m.replyToMsgId(), m.toId().channelId());
+
+        record.dialogId = m.toId().channelId();
+        if( !record.dialogId )
+            record.dialogId = m.toId().chatId();
+        if( !record.dialogId )
+            record.dialogId = FLAG_TO_OUT(m.flags())? m.toId().userId() : m.fromId();
+
+        batch.records << record;
+    }
+
+    std::stable_sort(batch.records.begin(), batch.records.end(), checkIngestRecordLessThan);
+}
+
+void TelegramIngestor::jobFinished(const TelegramIngestBatch &batch)
+{
+    running--;
+    Q_EMIT ready(batch);
+}
+
+TelegramIngestor::~TelegramIngestor()
+{
+    pool->clear();
+    pool->waitForDone();
+}
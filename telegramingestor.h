@@ -0,0 +1,87 @@
+/*
+    Copyright (C) 2014 Aseman
+    http://aseman.co
+
+    This project is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This project is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TELEGRAMINGESTOR_H
+#define TELEGRAMINGESTOR_H
+
+#include <QObject>
+#include <QList>
+#include <QMetaType>
+#include <telegram/types/types.h>
+
+#include "telegramqml_global.h"
+
+class QThreadPool;
+
+class TELEGRAMQMLSHARED_EXPORT TelegramIngestRecord
+{
+public:
+    TelegramIngestRecord(): unifiedId(0), replyToUnifiedId(0), dialogId(0) {}
+
+    Message message;
+    qint64 unifiedId;
+    qint64 replyToUnifiedId;
+    qint64 dialogId;
+};
+
+class TELEGRAMQMLSHARED_EXPORT TelegramIngestBatch
+{
+public:
+    TelegramIngestBatch(): id(0) {}
+
+    qint64 id;
+    QList<User> users;
+    QList<Chat> chats;
+    QList<TelegramIngestRecord> records;
+};
+
+Q_DECLARE_METATYPE(TelegramIngestBatch)
+
+/*!
+ * Normalizes message pages received from the server on a worker thread.
+ * Empty messages are dropped, the unified and dialog keys are computed and
+ * the records are put in display order, so the GUI thread only creates the
+ * objects and merges them into the already sorted dialog lists. Batches are
+ * handed back in the order they were queued.
+ */
+class TELEGRAMQMLSHARED_EXPORT TelegramIngestor : public QObject
+{
+    Q_OBJECT
+public:
+    TelegramIngestor(QObject *parent = 0);
+    ~TelegramIngestor();
+
+    qint64 ingest(const QList<Message> &messages, const QList<User> &users = QList<User>(),
+                  const QList<Chat> &chats = QList<Chat>());
+    int pending() const;
+
+    static void normalize(TelegramIngestBatch &batch, const QList<Message> &messages);
+
+Q_SIGNALS:
+    void ready(const TelegramIngestBatch &batch);
+
+private Q_SLOTS:
+    void jobFinished(const TelegramIngestBatch &batch);
+
+private:
+    QThreadPool *pool;
+    qint64 lastId;
+    int running;
+};
+
+#endif // TELEGRAMINGESTOR_H
@@ -0,0 +1,261 @@
+/*
+    Copyright (C) 2014 Aseman
+    http://aseman.co
+
+    This project is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This project is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Telegram servers store photos at 1280px at most, anything bigger is
+// only wasted upload bandwidth.
+#define PHOTO_MAX_SIZE 1280
+#define PHOTO_QUALITY 87
+#define STICKER_THUMB_WIDTH 200
+
+#include "telegrammediapreparer.h"
+#include "telegramthumbnailer.h"
+#include "telegramthumbnailercore.h"
+
+#include <QThreadPool>
+#include <QThread>
+#include <QRunnable>
+#include <QMimeDatabase>
+#include <QMimeType>
+#include <QImageReader>
+#include <QImageWriter>
+#include <QFileInfo>
+#include <QUuid>
+#include <QDir>
+
+class TelegramMediaPreparerJob : public QRunnable
+{
+public:
+    TelegramMediaPreparerJob(const TelegramPreparedMedia &media, TelegramMediaPreparer *preparer) :
+        media(media), preparer(preparer) {}
+
+    void run() {
+        TelegramMediaPreparer::process(media, preparer);
+        QMetaObject::invokeMethod(preparer, "jobFinished", Qt::QueuedConnection,
+                                  Q_ARG(TelegramPreparedMedia, media));
+    }
+
+private:
+    TelegramPreparedMedia media;
+    TelegramMediaPreparer *preparer;
+};
+
+TelegramMediaPreparer::TelegramMediaPreparer(QObject *parent) :
+    QObject(parent)
+{
+    qRegisterMetaType<TelegramPreparedMedia>("TelegramPreparedMedia");
+
+    pool = new QThreadPool(this);
+    pool->setMaxThreadCount(qMax(2, QThread::idealThreadCount()));
+}
+
+void TelegramMediaPreparer::setMaxThreads(int count)
+{
+    pool->setMaxThreadCount(qMax(1, count));
+}
+
+int TelegramMediaPreparer::maxThreads() const
+{
+    return pool->maxThreadCount();
+}
+
+void TelegramMediaPreparer::setThumbnailer(TelegramThumbnailer *thumbnailer)
+{
+    _thumbnailer = thumbnailer;
+}
+
+TelegramThumbnailer *TelegramMediaPreparer::thumbnailer() const
+{
+    return _thumbnailer;
+}
+
+void TelegramMediaPreparer::prepare(const TelegramPreparedMedia &media)
+{
+    queues[media.dialogId] << media.handle;
+    Q_EMIT stageChanged(media.handle, StageQueued);
+
+    pool->start(new TelegramMediaPreparerJob(media, this));
+}
+
+void TelegramMediaPreparer::process(TelegramPreparedMedia &media, TelegramMediaPreparer *reporter)
+{
+    Q_EMIT reporter->stageChanged(media.handle, StageProbing);
+
+    QMimeDatabase mime_db;
+    const QMimeType &t = mime_db.mimeTypeForFile(media.file);
+    const QString &mime = t.name();
+    media.mimeType = mime;
+
+    const bool asIs = media.forceDocument || media.forceAudio;
+    if( (mime.contains("webp") || media.file.right(5) == ".webp") && !media.encrypted && !asIs )
+        media.kind = TelegramPreparedMedia::Sticker;
+    else
+    if( !mime.contains("gif") && mime.contains("image/") && !asIs )
+        media.kind = TelegramPreparedMedia::Photo;
+    else
+    if( mime.contains("video/") && !asIs )
+        media.kind = TelegramPreparedMedia::Video;
+    else
+    if( (mime.contains("audio/") || media.forceAudio) && !media.forceDocument && !media.encrypted )
+        media.kind = TelegramPreparedMedia::Audio;
+    else
+        media.kind = TelegramPreparedMedia::Document;
+
+    if(media.kind == TelegramPreparedMedia::Photo || media.kind == TelegramPreparedMedia::Sticker)
+    {
+        QImageReader reader(media.file);
+        media.size = reader.size();
+        if(!media.size.isValid())
+        {
+            media.failed = true;
+            Q_EMIT reporter->stageChanged(media.handle, StageFailed);
+            return;
+        }
+    }
+
+    if(media.kind == TelegramPreparedMedia::Photo &&
+       (media.size.width() > PHOTO_MAX_SIZE || media.size.height() > PHOTO_MAX_SIZE))
+    {
+        Q_EMIT reporter->stageChanged(media.handle, StageResizing);
+
+        const QImage &image = TelegramThumbnailerCore::readScaledImage(media.file, QSize(PHOTO_MAX_SIZE, PHOTO_MAX_SIZE));
+        const QString &resized = media.tempPath + "/cutegram_photo_" + QUuid::createUuid().toString() + ".jpg";
+        if(!image.isNull() && image.save(resized, "JPEG", PHOTO_QUALITY))
+        {
+            media.file = resized;
+            media.size = image.size();
+        }
+    }
+
+    Q_EMIT reporter->stageChanged(media.handle, StageThumbnailing);
+    switch(static_cast<int>(media.kind))
+    {
+    case TelegramPreparedMedia::Sticker:
+    {
+        QImageReader reader(media.file);
+        reader.setScaledSize(QSize(STICKER_THUMB_WIDTH, qreal(STICKER_THUMB_WIDTH)*media.size.height()/media.size.width()));
+
+        media.thumbnail = media.tempPath + "/cutegram_thumbnail_" + QUuid::createUuid().toString() + ".webp";
+        QImageWriter writer(media.thumbnail);
+        if(!writer.write(reader.read()))
+            media.thumbnail.clear();
+    }
+        break;
+
+    case TelegramPreparedMedia::Video:
+    case TelegramPreparedMedia::Document:
+        // Missing thumbnails are created by the thumbnailer once the job is
+        // back on the main thread, see jobFinished().
+        if(mime.contains("video/"))
+            media.thumbnail = media.videoThumbnail;
+        else
+        if(mime.contains("audio/"))
+        {
+            media.thumbnail = media.coverThumbnail;
+            QDir().mkpath(QFileInfo(media.thumbnail).path());
+        }
+
+        if(QFileInfo::exists(media.thumbnail))
+            checkThumbnail(media);
+        break;
+    }
+}
+
+void TelegramMediaPreparer::checkThumbnail(TelegramPreparedMedia &media)
+{
+    if(media.thumbnail.isEmpty())
+        return;
+
+    const QSize &thumbSize = QImageReader(media.thumbnail).size();
+    if(thumbSize.width() <= 0 || thumbSize.height() <= 0)
+        media.thumbnail.clear();
+    else
+    if(media.kind == TelegramPreparedMedia::Video)
+        media.size = thumbSize;
+}
+
+void TelegramMediaPreparer::jobFinished(const TelegramPreparedMedia &media)
+{
+    if(media.failed || media.thumbnail.isEmpty() || QFileInfo::exists(media.thumbnail))
+    {
+        finish(media);
+        return;
+    }
+
+    if(!_thumbnailer || _thumbnailer->hasFailed(media.file, media.thumbnail))
+    {
+        TelegramPreparedMedia result = media;
+        result.thumbnail.clear();
+        finish(result);
+        return;
+    }
+
+    const qint64 handle = media.handle;
+    const int size = (media.thumbnail == media.coverThumbnail)? TelegramThumbnailer::DocumentThumbSize : 0;
+    thumbnailing[handle] = media;
+
+#ifdef TG_THUMBNAILER_CPP11
+    QPointer<TelegramMediaPreparer> preparer = this;
+    TelegramThumbnailer_Callback callback = [preparer, handle](){
+        if(preparer)
+            preparer->thumbnailFinished(handle);
+    };
+#else
+    TelegramThumbnailer_Callback callback;
+    callback.object = this;
+    callback.method = "thumbnailFinished";
+    callback.args << handle;
+#endif
+
+    _thumbnailer->createThumbnail(media.file, media.thumbnail, callback, size);
+}
+
+void TelegramMediaPreparer::thumbnailFinished(qint64 handle)
+{
+    if(!thumbnailing.contains(handle))
+        return;
+
+    TelegramPreparedMedia media = thumbnailing.take(handle);
+    if(QFileInfo::exists(media.thumbnail))
+        checkThumbnail(media);
+    else
+        media.thumbnail.clear();
+
+    finish(media);
+}
+
+void TelegramMediaPreparer::finish(const TelegramPreparedMedia &media)
+{
+    finished[media.handle] = media;
+
+    // Hand files over in the order they were sent to each dialog.
+    QList<qint64> &queue = queues[media.dialogId];
+    while(!queue.isEmpty() && finished.contains(queue.first()))
+    {
+        const TelegramPreparedMedia &ready = finished.take(queue.takeFirst());
+        Q_EMIT prepared(ready);
+    }
+
+    if(queue.isEmpty())
+        queues.remove(media.dialogId);
+}
+
+TelegramMediaPreparer::~TelegramMediaPreparer()
+{
+    pool->clear();
+    pool->waitForDone();
+}
@@ -0,0 +1,120 @@
+/*
+    Copyright (C) 2014 Aseman
+    http://aseman.co
+
+    This project is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This project is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TELEGRAMMEDIAPREPARER_H
+#define TELEGRAMMEDIAPREPARER_H
+
+#include <QObject>
+#include <QSize>
+#include <QHash>
+#include <QList>
+#include <QMetaType>
+#include <QPointer>
+
+#include "telegramqml_global.h"
+
+class QThreadPool;
+class TelegramThumbnailer;
+
+class TELEGRAMQMLSHARED_EXPORT TelegramPreparedMedia
+{
+public:
+    enum Kind {
+        Document,
+        Photo,
+        Video,
+        Audio,
+        Sticker
+    };
+
+    TelegramPreparedMedia(): handle(0), dialogId(0), kind(Document), encrypted(false),
+        forceDocument(false), forceAudio(false), failed(false) {}
+
+    qint64 handle;
+    qint64 dialogId;
+    QString source;
+    QString file;
+    QString mimeType;
+    QString thumbnail;
+    QString tempPath;
+    QString videoThumbnail;
+    QString coverThumbnail;
+    QSize size;
+    Kind kind;
+    bool encrypted;
+    bool forceDocument;
+    bool forceAudio;
+    bool failed;
+};
+
+Q_DECLARE_METATYPE(TelegramPreparedMedia)
+
+/*!
+ * Runs the CPU and IO heavy part of sending a file (probe, downscale,
+ * thumbnail) on worker threads. Video and audio thumbnails are created by
+ * the shared TelegramThumbnailer. Results are handed back in the order files
+ * were queued for each dialog, so messages keep their order while the first
+ * file already uploads.
+ */
+class TELEGRAMQMLSHARED_EXPORT TelegramMediaPreparer : public QObject
+{
+    Q_OBJECT
+public:
+    enum Stage {
+        StageQueued,
+        StageProbing,
+        StageResizing,
+        StageThumbnailing,
+        StageUploading,
+        StageFailed
+    };
+
+    TelegramMediaPreparer(QObject *parent = 0);
+    ~TelegramMediaPreparer();
+
+    void setMaxThreads(int count);
+    int maxThreads() const;
+
+    void setThumbnailer(TelegramThumbnailer *thumbnailer);
+    TelegramThumbnailer *thumbnailer() const;
+
+    void prepare(const TelegramPreparedMedia &media);
+
+    static void process(TelegramPreparedMedia &media, TelegramMediaPreparer *reporter);
+
+Q_SIGNALS:
+    void stageChanged(qint64 handle, int stage);
+    void prepared(const TelegramPreparedMedia &media);
+
+private Q_SLOTS:
+    void jobFinished(const TelegramPreparedMedia &media);
+    void thumbnailFinished(qint64 handle);
+
+private:
+    void finish(const TelegramPreparedMedia &media);
+    static void checkThumbnail(TelegramPreparedMedia &media);
+
+private:
+    QThreadPool *pool;
+    QPointer<TelegramThumbnailer> _thumbnailer;
+    QHash<qint64, TelegramPreparedMedia> thumbnailing;
+    QHash<qint64, QList<qint64> > queues;
+    QHash<qint64, TelegramPreparedMedia> finished;
+};
+
+#endif // TELEGRAMMEDIAPREPARER_H
@@ -17,6 +17,12 @@
 */
 
 #define LOAD_STEP_COUNT 50
+#define DEFAULT_WINDOW_SIZE 150
+
+#define SECTION_DAY_START 1
+#define SECTION_RUN_START 2
+#define SECTION_RUN_END 4
+#define SECTION_FIRST_UNREAD 8
 
 #include "telegrammessagesmodel.h"
 #include "telegramqml.h"
@@ -25,6 +31,9 @@
 
 #include <telegram.h>
 #include <QPointer>
+#include <QSet>
+#include <QDateTime>
+#include <algorithm>
 
 
 class TelegramMessagesModelPrivate
@@ -45,6 +54,15 @@ public:
     int refresh_timer;
 
     int unreadCount;
+
+    bool windowed;
+    int windowSize;
+    int viewIndex;
+    qint64 windowAnchor;
+
+    QHash<QObject*, qint64> watched;
+    QHash<qint64, int> sections;
+    QSet<qint64> dbRequests;
 };
 
 TelegramMessagesModel::TelegramMessagesModel(QObject *parent) :
@@ -61,6 +79,10 @@ TelegramMessagesModel::TelegramMessagesModel(QObject *parent) :
     p->maxId = 0;
     p->stepCount = LOAD_STEP_COUNT;
     p->unreadCount = 0;
+    p->windowed = false;
+    p->windowSize = DEFAULT_WINDOW_SIZE;
+    p->viewIndex = 0;
+    p->windowAnchor = 0;
 }
 
 TelegramQml *TelegramMessagesModel::telegram() const
@@ -75,11 +97,13 @@ void TelegramMessagesModel::setTelegram(TelegramQml *tgo)
         return;
     if(p->telegram)
     {
+        cancelLocalReads();
         p->telegram->unregisterMessagesModel(this);
         disconnect(p->telegram, SIGNAL(messagesChanged(bool)), this, SLOT(messagesChanged(bool)));
+        if(p->telegram->database())
+            disconnect(p->telegram->database(), SIGNAL(requestFinished(qint64,int)), this, SLOT(dbRequestFinished(qint64,int)));
         disconnect(p->telegram, SIGNAL(authLoggedInChanged()), this, SLOT(init()));
         disconnect(p->telegram, SIGNAL(connectedChanged()), this, SLOT(init()));
-        disconnect(p->telegram, SIGNAL(connectedChanged()), this, SLOT(setReaded()));
     }
 
     p->telegram = tg;
@@ -87,9 +111,10 @@ void TelegramMessagesModel::setTelegram(TelegramQml *tgo)
     {
         p->telegram->registerMessagesModel(this);
         connect(p->telegram, SIGNAL(messagesChanged(bool)), this, SLOT(messagesChanged(bool)));
+        if(p->telegram->database())
+            connect(p->telegram->database(), SIGNAL(requestFinished(qint64,int)), this, SLOT(dbRequestFinished(qint64,int)));
         connect(p->telegram, SIGNAL(authLoggedInChanged()), this, SLOT(init()), Qt::QueuedConnection);
         connect(p->telegram, SIGNAL(connectedChanged()), this, SLOT(init()), Qt::QueuedConnection);
-        connect(p->telegram, SIGNAL(connectedChanged()), this, SLOT(setReaded()), Qt::QueuedConnection);
     }
 
     p->initializing = tg;
@@ -109,11 +134,20 @@ void TelegramMessagesModel::setDialog(DialogObject *dlg)
     if( p->dialog == dlg )
         return;
 
+    // Leaving the chat, the pending read mark goes out now.
+    if( p->telegram && p->dialog )
+        p->telegram->flushReadHistory(peerId());
+
+    // Pages of the previous chat are of no use anymore.
+    cancelLocalReads();
     p->dialog = dlg;
     Q_EMIT dialogChanged();
 
     beginResetModel();
     p->messages.clear();
+    p->windowAnchor = 0;
+    p->sections.clear();
+    unwatchMessages();
     endResetModel();
 
     if( !p->dialog )
@@ -159,6 +193,72 @@ int TelegramMessagesModel::stepCount() const
     return p->stepCount;
 }
 
+void TelegramMessagesModel::setWindowed(bool stt)
+{
+    if(p->windowed == stt)
+        return;
+
+    p->windowed = stt;
+    p->windowAnchor = 0;
+    Q_EMIT windowedChanged();
+
+    messagesChanged_priv();
+}
+
+bool TelegramMessagesModel::windowed() const
+{
+    return p->windowed;
+}
+
+void TelegramMessagesModel::setWindowSize(int size)
+{
+    size = qMax(LOAD_STEP_COUNT, size);
+    if(p->windowSize == size)
+        return;
+
+    p->windowSize = size;
+    Q_EMIT windowSizeChanged();
+
+    if(p->windowed)
+        messagesChanged_priv();
+}
+
+int TelegramMessagesModel::windowSize() const
+{
+    return p->windowSize;
+}
+
+void TelegramMessagesModel::setViewIndex(int index)
+{
+    if(p->viewIndex == index)
+        return;
+
+    p->viewIndex = index;
+    Q_EMIT viewIndexChanged();
+
+    if(!p->windowed || !p->telegram || !p->dialog || index < 0 || index >= p->messages.count())
+        return;
+
+    // The window is moved once the view gets close to one of its ends.
+    const int margin = p->windowSize/4;
+    const bool nearTop = index < margin && p->messages.first() != p->telegram->messagesWindow(dialogId(), 0, 0, 1, p->maxId).value(0);
+    const bool nearBottom = index >= p->messages.count() - margin;
+    if(!nearTop && !nearBottom)
+        return;
+
+    p->windowAnchor = p->messages.at(index);
+    messagesChanged_priv();
+
+    // Nothing older is known locally, get the next page.
+    if(nearBottom && p->messages.indexOf(p->windowAnchor) >= p->messages.count() - margin)
+        loadMore(true);
+}
+
+int TelegramMessagesModel::viewIndex() const
+{
+    return p->viewIndex;
+}
+
 int TelegramMessagesModel::indexOf(qint32 msgId, qint32 channelId) const
 {
     return p->messages.indexOf(QmlUtils::getUnifiedMessageKey(msgId, channelId));
@@ -202,18 +302,16 @@ void TelegramMessagesModel::refresh()
         Peer peer(Peer::typePeerChat);
         peer.setChatId(p->dialog->peer()->userId());
 
-        p->telegram->database()->readMessages(peer, 0, p->stepCount);
+        readLocal(peer, 0, p->stepCount);
         return;
     }
 
     const InputPeer & peer = p->telegram->getInputPeer(peerId());
 
+    // The local cache answers first, the server refresh follows when online.
+    readLocal(TelegramMessagesModel::peer(), 0, p->stepCount);
     if (p->telegram->connected())
-    {
         tgObject->messagesGetHistory(peer, 0, 0, 0, p->stepCount, p->maxId, 0);
-    }
-    else
-        p->telegram->database()->readMessages(TelegramMessagesModel::peer(), 0, p->stepCount);
 }
 
 void TelegramMessagesModel::loadMore(bool force)
@@ -240,19 +338,27 @@ void TelegramMessagesModel::loadMore(bool force)
         Peer peer(Peer::typePeerChat);
         peer.setChatId(p->dialog->peer()->userId());
 
-        p->telegram->database()->readMessages(peer, p->load_count, p->stepCount);
+        readLocal(peer, p->load_count, p->stepCount);
         return;
     }
 
     const InputPeer & peer = p->telegram->getInputPeer(peerId());
 
+    if (p->telegram->connected() && p->windowed && !p->messages.isEmpty())
+    {
+        // Pages continue below the oldest loaded row, the window decides what stays.
+        const qint32 offsetId = QmlUtils::getSeparateMessageId(p->messages.last());
+        tgObject->messagesGetHistory(peer, offsetId, 0, 0, p->stepCount, p->maxId, 0);
+        p->refreshing = true;
+    }
+    else
     if (p->telegram->connected())
     {
         tgObject->messagesGetHistory(peer, 0, 0, p->load_count, p->load_limit, p->maxId, 0);
         p->refreshing = true;
     }
     else
-        p->telegram->database()->readMessages(TelegramMessagesModel::peer(), p->load_count, p->stepCount);
+        readLocal(TelegramMessagesModel::peer(), p->load_count, p->stepCount);
 
     Q_EMIT refreshingChanged();
 }
@@ -295,20 +401,15 @@ void TelegramMessagesModel::setReaded()
         return;
     }
 
-    if(p->telegram->connected()) {
-        if (p->dialog->peer()->classType()==Peer::typePeerChannel)
-        {
-            const InputPeer & input = p->telegram->getInputPeer(p->dialog->peer()->channelId());
-            p->telegram->channelsReadHistory(input.channelId(), input.accessHash());
-        } else {
-            p->telegram->messagesReadHistory(peerId(), message->date());
-        }
-    }
+    // Coalesced per peer and sent once online, see TelegramQml::readHistory.
+    p->telegram->readHistory(peerId(), topMessageId, message->date());
 }
 
 void TelegramMessagesModel::clearNewMessageFlag()
 {
+    const int previousUnread = p->unreadCount;
     p->unreadCount = 0;
+    updateSectionRows(QList<int>() << previousUnread-1);
     Q_EMIT hasNewMessageChanged();
 }
 
@@ -332,16 +433,299 @@ QVariant TelegramMessagesModel::data(const QModelIndex &index, int role) const
     {
     case ItemRole:
         res = QVariant::fromValue<MessageObject*>(p->telegram->message(key));
-        break;
+        return res;
 
     case UnreadedRole:
         res = index.row()<p->unreadCount;
+        return res;
+
+    case DayStartRole:
+        res = (p->sections.value(key) & SECTION_DAY_START) != 0;
+        return res;
+
+    case SenderRunStartRole:
+        res = (p->sections.value(key) & SECTION_RUN_START) != 0;
+        return res;
+
+    case SenderRunEndRole:
+        res = (p->sections.value(key) & SECTION_RUN_END) != 0;
+        return res;
+
+    case FirstUnreadRole:
+        res = (p->sections.value(key) & SECTION_FIRST_UNREAD) != 0;
+        return res;
+    }
+
+    // Flat roles are read straight from the store, delegates using only
+    // them never bind to the message object.
+    MessageObject *msg = p->telegram->message(key);
+    if( msg == p->telegram->nullMessage() )
+        return res;
+
+    watchMessage(msg, key);
+    switch( role )
+    {
+    case TextRole:
+        res = msg->message();
+        break;
+
+    case DateRole:
+        res = msg->date();
+        break;
+
+    case OutRole:
+        res = msg->out();
+        break;
+
+    case UnreadRole:
+        res = msg->unread();
+        break;
+
+    case SentRole:
+        res = msg->sent();
+        break;
+
+    case SenderIdRole:
+        res = msg->fromId();
+        break;
+
+    case MediaTypeRole:
+        res = msg->media()->classType();
+        break;
+
+    case ThumbnailRole:
+    {
+        MessageMediaObject *media = msg->media();
+        FileLocationObject *location = 0;
+        if( media->classType() == MessageMedia::typeMessageMediaPhoto )
+            location = p->telegram->locationOfThumbPhoto(media->photo());
+        else
+        if( media->classType() == MessageMedia::typeMessageMediaDocument )
+            location = media->document()->thumb()->location();
+
+        if( location && location->download() )
+        {
+            watchLocation(location, key);
+            res = location->download()->location();
+        }
+        else
+            res = QString();
+    }
+        break;
+
+    case ReplyToIdRole:
+        res = msg->replyToMsgId();
+        break;
+
+    case ReplyPreviewRole:
+    {
+        if( !msg->replyToMsgId() )
+        {
+            res = QString();
+            break;
+        }
+
+        const qint64 replyKey = QmlUtils::getUnifiedMessageKey(msg->replyToMsgId(), msg->toId()->channelId());
+        MessageObject *reply = p->telegram->message(replyKey);
+        res = reply == p->telegram->nullMessage()? QString() : reply->message();
+    }
+        break;
+
+    case ViewsRole:
+        res = msg->views();
+        break;
+
+    case EditDateRole:
+        res = msg->editDate();
+        break;
+
+    case DayRole:
+        res = QDateTime::fromTime_t(msg->date()).date().toString(Qt::ISODate);
         break;
     }
 
     return res;
 }
 
+int TelegramMessagesModel::sectionFlags(int row) const
+{
+    // Rows are newest first, so a run or a day starts at its last row.
+    MessageObject *msg = p->telegram->message(p->messages.at(row));
+    MessageObject *older = row+1<p->messages.count()? p->telegram->message(p->messages.at(row+1)) : 0;
+    MessageObject *newer = row>0? p->telegram->message(p->messages.at(row-1)) : 0;
+
+    const QDate &day = QDateTime::fromTime_t(msg->date()).date();
+    const bool dayStart = !older || QDateTime::fromTime_t(older->date()).date() != day;
+    const bool dayEnd = !newer || QDateTime::fromTime_t(newer->date()).date() != day;
+
+    int flags = 0;
+    if( dayStart )
+        flags |= SECTION_DAY_START;
+    if( dayStart || older->fromId() != msg->fromId() || older->out() != msg->out() )
+        flags |= SECTION_RUN_START;
+    if( dayEnd || newer->fromId() != msg->fromId() || newer->out() != msg->out() )
+        flags |= SECTION_RUN_END;
+    if( row == p->unreadCount-1 )
+        flags |= SECTION_FIRST_UNREAD;
+
+    return flags;
+}
+
+void TelegramMessagesModel::updateSections(const QList<qint64> &previous, int previousUnread)
+{
+    if( !p->telegram )
+        return;
+
+    // Flags only depend on the neighbours of a row, so only new rows and
+    // rows next to an insertion or a removal are looked at again.
+    typedef QPair<qint64,qint64> Neighbours;
+    QHash<qint64, Neighbours> neighbours;
+    neighbours.reserve(previous.count());
+    for( int i=0 ; i<previous.count() ; i++ )
+        neighbours[previous.at(i)] = Neighbours(i>0? previous.at(i-1) : 0, i+1<previous.count()? previous.at(i+1) : 0);
+
+    QList<int> rows;
+    for( int i=0 ; i<p->messages.count() ; i++ )
+    {
+        const qint64 key = p->messages.at(i);
+        const Neighbours current(i>0? p->messages.at(i-1) : 0, i+1<p->messages.count()? p->messages.at(i+1) : 0);
+        if( !neighbours.contains(key) || neighbours.value(key) != current )
+            rows << i;
+        neighbours.remove(key);
+    }
+
+    // What is left has no row anymore.
+    QHashIterator<qint64, Neighbours> i(neighbours);
+    while( i.hasNext() )
+        p->sections.remove(i.next().key());
+
+    rows << previousUnread-1 << p->unreadCount-1;
+    updateSectionRows(rows);
+}
+
+void TelegramMessagesModel::updateSectionRows(QList<int> rows)
+{
+    if( !p->telegram )
+        return;
+
+    // Only rows whose flags moved are announced, contiguous ones together.
+    static const QVector<int> roles = QVector<int>() << DayStartRole << SenderRunStartRole
+                                                     << SenderRunEndRole << FirstUnreadRole;
+    std::sort(rows.begin(), rows.end());
+
+    int runStart = -1;
+    int runEnd = -1;
+    for( int i=0 ; i<=rows.count() ; i++ )
+    {
+        int row = -1;
+        if( i < rows.count() )
+        {
+            row = rows.at(i);
+            if( row < 0 || row >= p->messages.count() || row == runEnd )
+                continue;
+
+            const qint64 key = p->messages.at(row);
+            const int flags = sectionFlags(row);
+            if( p->sections.contains(key) && p->sections.value(key) == flags )
+                row = -1;
+            else
+                p->sections[key] = flags;
+        }
+
+        if( row != -1 && row == runEnd+1 && runStart != -1 )
+        {
+            runEnd = row;
+            continue;
+        }
+
+        if( runStart != -1 )
+            Q_EMIT dataChanged(index(runStart), index(runEnd), roles);
+
+        runStart = row;
+        runEnd = row;
+    }
+}
+
+void TelegramMessagesModel::watchMessage(MessageObject *msg, qint64 key) const
+{
+    if( p->watched.contains(msg) )
+        return;
+
+    p->watched[msg] = key;
+    connect( msg, SIGNAL(messageChanged())  , this, SLOT(messageObjectChanged()) );
+    connect( msg, SIGNAL(dateChanged())     , this, SLOT(messageObjectChanged()) );
+    connect( msg, SIGNAL(unreadChanged())   , this, SLOT(messageObjectChanged()) );
+    connect( msg, SIGNAL(sentChanged())     , this, SLOT(messageObjectChanged()) );
+    connect( msg, SIGNAL(mediaChanged())    , this, SLOT(messageObjectChanged()) );
+    connect( msg, SIGNAL(viewsChanged())    , this, SLOT(messageObjectChanged()) );
+    connect( msg, SIGNAL(editDateChanged()) , this, SLOT(messageObjectChanged()) );
+    connect( msg, SIGNAL(replyToMsgIdChanged()), this, SLOT(messageObjectChanged()) );
+    connect( msg, SIGNAL(fromIdChanged())   , this, SLOT(messageObjectChanged()) );
+    connect( msg, SIGNAL(outChanged())      , this, SLOT(messageObjectChanged()) );
+    connect( msg, SIGNAL(dateChanged())     , this, SLOT(messageSectionChanged()) );
+    connect( msg, SIGNAL(fromIdChanged())   , this, SLOT(messageSectionChanged()) );
+    connect( msg, SIGNAL(outChanged())      , this, SLOT(messageSectionChanged()) );
+    connect( msg, SIGNAL(destroyed(QObject*)), this, SLOT(messageObjectDestroyed(QObject*)) );
+}
+
+void TelegramMessagesModel::watchLocation(FileLocationObject *location, qint64 key) const
+{
+    // Thumbnails finish downloading after the row was first read.
+    QObject *download = location->download();
+    if( !p->watched.contains(location) )
+    {
+        p->watched[location] = key;
+        connect( location, SIGNAL(downloadChanged()), this, SLOT(messageObjectChanged()) );
+        connect( location, SIGNAL(destroyed(QObject*)), this, SLOT(messageObjectDestroyed(QObject*)) );
+    }
+    if( !p->watched.contains(download) )
+    {
+        p->watched[download] = key;
+        connect( download, SIGNAL(locationChanged()), this, SLOT(messageObjectChanged()) );
+        connect( download, SIGNAL(destroyed(QObject*)), this, SLOT(messageObjectDestroyed(QObject*)) );
+    }
+}
+
+void TelegramMessagesModel::unwatchMessages()
+{
+    QHashIterator<QObject*, qint64> i(p->watched);
+    while( i.hasNext() )
+    {
+        i.next();
+        disconnect( i.key(), 0, this, 0 );
+    }
+
+    p->watched.clear();
+}
+
+void TelegramMessagesModel::messageObjectChanged()
+{
+    const int row = p->messages.indexOf( p->watched.value(sender()) );
+    if( row == -1 )
+        return;
+
+    static const QVector<int> roles = QVector<int>() << TextRole << DateRole << OutRole << UnreadRole
+                                                     << SentRole << SenderIdRole << MediaTypeRole << ThumbnailRole
+                                                     << ReplyToIdRole << ReplyPreviewRole << ViewsRole << EditDateRole;
+    const QModelIndex &idx = index(row);
+    Q_EMIT dataChanged(idx, idx, roles);
+}
+
+void TelegramMessagesModel::messageSectionChanged()
+{
+    // Day and sender runs of the neighbours depend on this row too.
+    const int row = p->messages.indexOf( p->watched.value(sender()) );
+    if( row == -1 )
+        return;
+
+    updateSectionRows(QList<int>() << row-1 << row << row+1);
+}
+
+void TelegramMessagesModel::messageObjectDestroyed(QObject *obj)
+{
+    p->watched.remove(obj);
+}
+
 QHash<qint32, QByteArray> TelegramMessagesModel::roleNames() const
 {
     static QHash<qint32, QByteArray> *res = 0;
@@ -351,6 +735,23 @@ QHash<qint32, QByteArray> TelegramMessagesModel::roleNames() const
     res = new QHash<qint32, QByteArray>();
     res->insert( ItemRole, "item");
     res->insert( UnreadedRole, "unreaded");
+    res->insert( TextRole, "text");
+    res->insert( DateRole, "date");
+    res->insert( OutRole, "out");
+    res->insert( UnreadRole, "unread");
+    res->insert( SentRole, "sent");
+    res->insert( SenderIdRole, "senderId");
+    res->insert( MediaTypeRole, "mediaType");
+    res->insert( ThumbnailRole, "thumbnail");
+    res->insert( ReplyToIdRole, "replyToId");
+    res->insert( ReplyPreviewRole, "replyPreview");
+    res->insert( ViewsRole, "views");
+    res->insert( EditDateRole, "editDate");
+    res->insert( DayRole, "day");
+    res->insert( DayStartRole, "dayStart");
+    res->insert( SenderRunStartRole, "senderRunStart");
+    res->insert( SenderRunEndRole, "senderRunEnd");
+    res->insert( FirstUnreadRole, "firstUnread");
     return *res;
 }
 
@@ -410,73 +811,102 @@ void TelegramMessagesModel::messagesChanged(bool cachedData)
     p->refresh_timer = startTimer(100);
 }
 
-void TelegramMessagesModel::messagesChanged_priv()
+void TelegramMessagesModel::dbRequestFinished(qint64 requestId, int count)
 {
-    if( !p->dialog )
+    Q_UNUSED(count)
+    if(!p->dbRequests.remove(requestId))
         return;
 
-    qint64 did;
-    if (p->dialog->peer()->classType()==Peer::typePeerChannel)
-        did = p->dialog->peer()->channelId();
-    else if (p->dialog->peer()->classType()==Peer::typePeerChat)
-        did = p->dialog->peer()->chatId();
-    else
-        did = p->dialog->peer()->userId();
-    const QList<qint64> & messages = p->telegram->messages(did, p->maxId).mid(0,p->load_limit);
+    // The whole page is in the store now, apply it at once.
+    if(p->refresh_timer)
+        killTimer(p->refresh_timer);
 
-    for( int i=0 ; i<p->messages.count() ; i++ )
-    {
-        const qint64 msgId = p->messages.at(i);
-        if( messages.contains(msgId) )
-            continue;
+    p->refresh_timer = 0;
+    messagesChanged_priv();
+}
 
-        beginRemoveRows(QModelIndex(), i, i);
-        p->messages.removeAt(i);
-        i--;
-        endRemoveRows();
-    }
+void TelegramMessagesModel::readLocal(const Peer &peer, int offset, int limit)
+{
+    Database *db = p->telegram->database();
+    if(!db)
+        return;
 
-    QList<qint64> temp_msgs = messages;
-    for( int i=0 ; i<temp_msgs.count() ; i++ )
-    {
-        const qint64 msgId = temp_msgs.at(i);
-        if( p->messages.contains(msgId) )
-            continue;
+    const qint64 requestId = db->readMessages(peer, offset, limit);
+    if(requestId)
+        p->dbRequests.insert(requestId);
+}
 
-        temp_msgs.removeAt(i);
-        i--;
-    }
-    while( p->messages != temp_msgs )
-        for( int i=0 ; i<p->messages.count() ; i++ )
-        {
-            const qint64 msgId = p->messages.at(i);
-            int nw = temp_msgs.indexOf(msgId);
-            if( i == nw )
-                continue;
+void TelegramMessagesModel::cancelLocalReads()
+{
+    Database *db = p->telegram? p->telegram->database() : 0;
+    if(db)
+        Q_FOREACH(qint64 requestId, p->dbRequests)
+            db->cancelRequest(requestId);
 
-            beginMoveRows( QModelIndex(), i, i, QModelIndex(), nw>i?nw+1:nw );
-            p->messages.move( i, nw );
-            endMoveRows();
-        }
+    p->dbRequests.clear();
+}
 
+qint64 TelegramMessagesModel::dialogId() const
+{
+    if (p->dialog->peer()->classType()==Peer::typePeerChannel)
+        return p->dialog->peer()->channelId();
+    else if (p->dialog->peer()->classType()==Peer::typePeerChat)
+        return p->dialog->peer()->chatId();
+    else
+        return p->dialog->peer()->userId();
+}
 
+void TelegramMessagesModel::messagesChanged_priv()
+{
+    if( !p->dialog || !p->telegram )
+        return;
+
+    // Only the requested slice is copied out of the dialog's message list.
+    const qint64 did = dialogId();
+    QList<qint64> messages;
+    if(p->windowed)
+        messages = p->telegram->messagesWindow(did, p->windowAnchor, p->windowSize/2, p->windowSize - p->windowSize/2, p->maxId);
+    else
+        messages = p->telegram->messagesWindow(did, 0, 0, p->load_limit, p->maxId);
+
+    // Rows scrolled back into the window are not arrivals, only messages
+    // newer than the previous top row are.
+    const QList<qint64> previous = p->messages;
+    const int previousUnread = p->unreadCount;
+    const QSet<qint64> &current = previous.toSet();
+    const qint64 newest = p->messages.isEmpty()? 0 : p->messages.first();
+    QList<qint64> added;
     for( int i=0 ; i<messages.count() ; i++ )
     {
         const qint64 msgId = messages.at(i);
-        if( p->messages.contains(msgId) )
+        if( current.contains(msgId) || msgId <= newest )
             continue;
 
         if(!p->refreshing_cache && !p->refreshing && i<p->unreadCount)
             p->unreadCount++;
+        added << msgId;
+    }
 
-        beginInsertRows(QModelIndex(), i, i );
-        p->messages.insert( i, msgId );
-        endInsertRows();
-
+    updateRows(p->messages, messages);
+    Q_FOREACH( qint64 msgId, added )
         Q_EMIT messageAdded(msgId);
+
+    updateSections(previous, previousUnread);
+
+    const QSet<qint64> &rows = messages.toSet();
+    QMutableHashIterator<QObject*, qint64> w(p->watched);
+    while( w.hasNext() )
+    {
+        w.next();
+        if( rows.contains(w.value()) )
+            continue;
+
+        disconnect( w.key(), 0, this, 0 );
+        w.remove();
     }
 
-    p->load_count = p->messages.count();
+    if(!p->windowed)
+        p->load_count = p->messages.count();
     Q_EMIT countChanged();
 
     if(p->refreshing_cache && !p->refreshing)
@@ -500,7 +930,12 @@ void TelegramMessagesModel::timerEvent(QTimerEvent *e)
 TelegramMessagesModel::~TelegramMessagesModel()
 {
     if(p->telegram)
+    {
+        if(p->dialog)
+            p->telegram->flushReadHistory(peerId());
+        cancelLocalReads();
         p->telegram->unregisterMessagesModel(this);
+    }
 
     delete p;
 }
@@ -26,6 +26,8 @@ class TelegramQml;
 class Peer;
 class InputPeer;
 class DialogObject;
+class MessageObject;
+class FileLocationObject;
 class TelegramMessagesModelPrivate;
 class TELEGRAMQMLSHARED_EXPORT TelegramMessagesModel : public TgAbstractListModel
 {
@@ -39,11 +41,31 @@ class TELEGRAMQMLSHARED_EXPORT TelegramMessagesModel : public TgAbstractListMode
     Q_PROPERTY(int maxId READ maxId WRITE setMaxId NOTIFY maxIdChanged)
     Q_PROPERTY(int stepCount READ stepCount WRITE setStepCount NOTIFY stepCountChanged)
     Q_PROPERTY(bool hasNewMessage READ hasNewMessage NOTIFY hasNewMessageChanged)
+    Q_PROPERTY(bool windowed READ windowed WRITE setWindowed NOTIFY windowedChanged)
+    Q_PROPERTY(int windowSize READ windowSize WRITE setWindowSize NOTIFY windowSizeChanged)
+    Q_PROPERTY(int viewIndex READ viewIndex WRITE setViewIndex NOTIFY viewIndexChanged)
 
 public:
     enum MessagesRoles {
         ItemRole = Qt::UserRole,
-        UnreadedRole
+        UnreadedRole,
+        TextRole,
+        DateRole,
+        OutRole,
+        UnreadRole,
+        SentRole,
+        SenderIdRole,
+        MediaTypeRole,
+        ThumbnailRole,
+        ReplyToIdRole,
+        ReplyPreviewRole,
+        ViewsRole,
+        EditDateRole,
+        DayRole,
+        DayStartRole,
+        SenderRunStartRole,
+        SenderRunEndRole,
+        FirstUnreadRole
     };
 
     TelegramMessagesModel(QObject *parent = 0);
@@ -61,6 +83,15 @@ public:
     void setStepCount(int step);
     int stepCount() const;
 
+    void setWindowed(bool stt);
+    bool windowed() const;
+
+    void setWindowSize(int size);
+    int windowSize() const;
+
+    void setViewIndex(int index);
+    int viewIndex() const;
+
     Q_INVOKABLE int indexOf(qint32 msgId, qint32 channelId) const;
 
     qint64 id( const QModelIndex &index ) const;
@@ -93,6 +124,9 @@ Q_SIGNALS:
     void refreshingChanged();
     void maxIdChanged();
     void stepCountChanged();
+    void windowedChanged();
+    void windowSizeChanged();
+    void viewIndexChanged();
     void messageAdded(qint64 msgId);
     void hasNewMessageChanged();
     void focusToNewRequest(int unreads);
@@ -100,8 +134,23 @@ Q_SIGNALS:
 private Q_SLOTS:
     void messagesChanged(bool cachedData);
     void messagesChanged_priv();
+    void messageObjectChanged();
+    void messageSectionChanged();
+    void messageObjectDestroyed(QObject *obj);
+    void dbRequestFinished(qint64 requestId, int count);
     void init();
 
+private:
+    qint64 dialogId() const;
+    void readLocal(const Peer &peer, int offset, int limit);
+    void cancelLocalReads();
+    void watchMessage(MessageObject *msg, qint64 key) const;
+    void watchLocation(FileLocationObject *location, qint64 key) const;
+    void unwatchMessages();
+    int sectionFlags(int row) const;
+    void updateSections(const QList<qint64> &previous, int previousUnread);
+    void updateSectionRows(QList<int> rows);
+
 protected:
     void timerEvent(QTimerEvent *e);
 
@@ -0,0 +1,225 @@
+/*
+    Copyright (C) 2014 Aseman
+    http://aseman.co
+
+    This project is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This project is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define TRIGRAM_SIZE 3
+
+#define RANK_EXACT 0
+#define RANK_PREFIX 1
+#define RANK_INFIX 2
+
+#include "telegramnameindex.h"
+
+#include <algorithm>
+
+TelegramNameIndex::TelegramNameIndex()
+{
+}
+
+void TelegramNameIndex::insert(qint64 id, const QStringList &names)
+{
+    QStringList list;
+    Q_FOREACH(const QString &name, names)
+        Q_FOREACH(const QString &token, tokenize(name))
+            if(!list.contains(token))
+                list << token;
+
+    if(entries.contains(id) && entries.value(id) == list)
+        return;
+
+    remove(id);
+    entries[id] = list;
+    Q_FOREACH(const QString &token, list)
+    {
+        tokens[token].insert(id);
+        for(int i=0; i+TRIGRAM_SIZE<=token.length(); i++)
+            trigrams[token.mid(i, TRIGRAM_SIZE)].insert(id);
+    }
+}
+
+void TelegramNameIndex::remove(qint64 id)
+{
+    if(!entries.contains(id))
+        return;
+
+    Q_FOREACH(const QString &token, entries.take(id))
+    {
+        QSet<qint64> &ids = tokens[token];
+        ids.remove(id);
+        if(ids.isEmpty())
+            tokens.remove(token);
+
+        for(int i=0; i+TRIGRAM_SIZE<=token.length(); i++)
+        {
+            const QString &trigram = token.mid(i, TRIGRAM_SIZE);
+            QSet<qint64> &postings = trigrams[trigram];
+            postings.remove(id);
+            if(postings.isEmpty())
+                trigrams.remove(trigram);
+        }
+    }
+}
+
+void TelegramNameIndex::clear()
+{
+    entries.clear();
+    tokens.clear();
+    trigrams.clear();
+}
+
+bool TelegramNameIndex::contains(qint64 id) const
+{
+    return entries.contains(id);
+}
+
+int TelegramNameIndex::count() const
+{
+    return entries.count();
+}
+
+QList<qint64> TelegramNameIndex::search(const QString &keyword) const
+{
+    const QStringList &keys = tokenize(keyword);
+
+    QHash<qint64,int> ranks;
+    QSet<qint64> result;
+    if(keys.isEmpty())
+        result = entries.keys().toSet();
+
+    // Every keyword token has to match one of the name tokens.
+    for(int i=0; i<keys.count(); i++)
+    {
+        QHash<qint64,int> tokenRanks;
+        const QSet<qint64> &ids = match(keys.at(i), &tokenRanks);
+        if(i == 0)
+            result = ids;
+        else
+            result.intersect(ids);
+
+        Q_FOREACH(qint64 id, result)
+            ranks[id] += tokenRanks.value(id);
+        if(result.isEmpty())
+            break;
+    }
+
+    QList<qint64> list = result.toList();
+    std::sort(list.begin(), list.end(), [this, &ranks](qint64 a, qint64 b) {
+        const int ra = ranks.value(a);
+        const int rb = ranks.value(b);
+        if(ra != rb)
+            return ra < rb;
+
+        const QStringList &ta = entries.value(a);
+        const QStringList &tb = entries.value(b);
+        if(ta != tb)
+            return ta < tb;
+        return a < b;
+    });
+
+    return list;
+}
+
+QSet<qint64> TelegramNameIndex::match(const QString &token, QHash<qint64,int> *ranks) const
+{
+    QSet<qint64> result;
+    QMap<QString, QSet<qint64> >::const_iterator i = tokens.lowerBound(token);
+    for(; i != tokens.constEnd() && i.key().startsWith(token); ++i)
+    {
+        const int rank = i.key().length() == token.length()? RANK_EXACT : RANK_PREFIX;
+        Q_FOREACH(qint64 id, i.value())
+        {
+            if(!result.contains(id) || ranks->value(id) > rank)
+                (*ranks)[id] = rank;
+            result.insert(id);
+        }
+    }
+
+    if(token.length() < TRIGRAM_SIZE)
+        return result;
+
+    // Candidates have all trigrams of the token, the check on the tokens
+    // drops the ones having them in different places.
+    QSet<qint64> candidates;
+    for(int j=0; j+TRIGRAM_SIZE<=token.length(); j++)
+    {
+        const QString &trigram = token.mid(j, TRIGRAM_SIZE);
+        if(!trigrams.contains(trigram))
+            return result;
+
+        if(j == 0)
+            candidates = trigrams.value(trigram);
+        else
+            candidates.intersect(trigrams.value(trigram));
+        if(candidates.isEmpty())
+            return result;
+    }
+
+    Q_FOREACH(qint64 id, candidates)
+    {
+        if(result.contains(id))
+            continue;
+
+        Q_FOREACH(const QString &name, entries.value(id))
+            if(name.contains(token))
+            {
+                (*ranks)[id] = RANK_INFIX;
+                result.insert(id);
+                break;
+            }
+    }
+
+    return result;
+}
+
+QString TelegramNameIndex::normalize(const QString &str)
+{
+    const QString &decomposed = str.normalized(QString::NormalizationForm_KD);
+
+    QString result;
+    result.reserve(decomposed.length());
+    for(int i=0; i<decomposed.length(); i++)
+    {
+        const QChar ch = decomposed.at(i);
+        if(ch.category() == QChar::Mark_NonSpacing)
+            continue;
+
+        result += ch;
+    }
+
+    return result.toCaseFolded();
+}
+
+QStringList TelegramNameIndex::tokenize(const QString &str)
+{
+    QStringList result;
+    QString token;
+    const QString &normalized = normalize(str);
+    for(int i=0; i<=normalized.length(); i++)
+    {
+        if(i < normalized.length() && normalized.at(i).isLetterOrNumber())
+        {
+            token += normalized.at(i);
+            continue;
+        }
+
+        if(!token.isEmpty())
+            result << token;
+        token.clear();
+    }
+
+    return result;
+}
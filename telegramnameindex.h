@@ -0,0 +1,62 @@
+/*
+    Copyright (C) 2014 Aseman
+    http://aseman.co
+
+    This project is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This project is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TELEGRAMNAMEINDEX_H
+#define TELEGRAMNAMEINDEX_H
+
+#include <QStringList>
+#include <QHash>
+#include <QMap>
+#include <QSet>
+
+#include "telegramqml_global.h"
+
+/*!
+ * Name index of users, chats and channels. Names are folded to lower case
+ * without diacritics and split into tokens. A keyword token matches the
+ * tokens it is a prefix of through the sorted token map, keywords of three
+ * and more letters match inside tokens too through trigram postings.
+ * Results are ranked, exact tokens first, then prefixes, then the rest.
+ */
+class TELEGRAMQMLSHARED_EXPORT TelegramNameIndex
+{
+public:
+    TelegramNameIndex();
+
+    void insert(qint64 id, const QStringList &names);
+    void remove(qint64 id);
+    void clear();
+
+    bool contains(qint64 id) const;
+    int count() const;
+
+    QList<qint64> search(const QString &keyword) const;
+
+    static QString normalize(const QString &str);
+    static QStringList tokenize(const QString &str);
+
+private:
+    QSet<qint64> match(const QString &token, QHash<qint64,int> *ranks) const;
+
+private:
+    QHash<qint64, QStringList> entries;
+    QMap<QString, QSet<qint64> > tokens;
+    QHash<QString, QSet<qint64> > trigrams;
+};
+
+#endif // TELEGRAMNAMEINDEX_H
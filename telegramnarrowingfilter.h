@@ -0,0 +1,168 @@
+/*
+    Copyright (C) 2014 Aseman
+    http://aseman.co
+
+    This project is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This project is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TELEGRAMNARROWINGFILTER_H
+#define TELEGRAMNARROWINGFILTER_H
+
+#include <QStringList>
+#include <QHash>
+#include <QSet>
+
+#include "telegramnameindex.h"
+
+/*!
+ * Keyword filter over a list of items with normalized keys computed once
+ * per item. When the keyword extends the previous one only the previous
+ * result is tested again. WordPrefix matches every keyword word against
+ * the start of a word of the key, Substring matches anywhere in the key.
+ * Results keep the order the items were added in.
+ */
+template<typename T>
+class TelegramNarrowingFilter
+{
+public:
+    enum MatchMode {
+        WordPrefix,
+        Substring
+    };
+
+    TelegramNarrowingFilter(MatchMode mode = WordPrefix) :
+        mode(mode), valid(false) {}
+
+    void setKey(const T &item, const QString &text)
+    {
+        const QStringList &key = mode == WordPrefix? TelegramNameIndex::tokenize(text) :
+                                                     QStringList() << TelegramNameIndex::normalize(text);
+        const bool added = !keys.contains(item);
+        if(added)
+            items << item;
+        else
+        if(keys.value(item) == key)
+            return;
+
+        keys[item] = key;
+        if(!valid)
+            return;
+
+        // Only this item is tested again, filling the filter stays linear.
+        const bool match = matches(key, lastWords);
+        if(match == resultSet.contains(item))
+            return;
+
+        if(!match)
+        {
+            resultSet.remove(item);
+            result.removeOne(item);
+        }
+        else
+        if(added)
+        {
+            result << item;
+            resultSet.insert(item);
+        }
+        else
+            valid = false; // Its place in the result order is unknown
+    }
+
+    void remove(const T &item)
+    {
+        if(!keys.contains(item))
+            return;
+
+        keys.remove(item);
+        items.removeOne(item);
+        if(resultSet.remove(item))
+            result.removeOne(item);
+    }
+
+    void clear()
+    {
+        items.clear();
+        keys.clear();
+        result.clear();
+        resultSet.clear();
+        valid = false;
+    }
+
+    bool contains(const T &item) const
+    {
+        return keys.contains(item);
+    }
+
+    QList<T> filter(const QString &keyword)
+    {
+        const QString &normalized = TelegramNameIndex::normalize(keyword);
+        const QStringList &words = mode == WordPrefix? TelegramNameIndex::tokenize(keyword) :
+                                                       QStringList() << normalized;
+
+        const bool narrowing = valid && normalized.startsWith(lastKeyword);
+        const QList<T> &candidates = narrowing? result : items;
+
+        QList<T> list;
+        Q_FOREACH(const T &item, candidates)
+            if(matches(keys.value(item), words))
+                list << item;
+
+        result = list;
+        resultSet = list.toSet();
+        lastKeyword = normalized;
+        lastWords = words;
+        valid = true;
+        return result;
+    }
+
+    bool accepts(const T &item)
+    {
+        if(!valid)
+            filter(lastKeyword);
+
+        return resultSet.contains(item);
+    }
+
+private:
+    bool matches(const QStringList &key, const QStringList &words) const
+    {
+        Q_FOREACH(const QString &word, words)
+        {
+            bool found = false;
+            Q_FOREACH(const QString &part, key)
+                if(mode == WordPrefix? part.startsWith(word) : part.contains(word))
+                {
+                    found = true;
+                    break;
+                }
+
+            if(!found)
+                return false;
+        }
+
+        return true;
+    }
+
+private:
+    MatchMode mode;
+    QList<T> items;
+    QHash<T, QStringList> keys;
+    QList<T> result;
+    QSet<T> resultSet;
+    QString lastKeyword;
+    QStringList lastWords;
+    bool valid;
+};
+
+#endif // TELEGRAMNARROWINGFILTER_H
@@ -0,0 +1,155 @@
+/*
+    Copyright (C) 2014 Aseman
+    http://aseman.co
+
+    This project is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This project is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "telegramparticipantsstore.h"
+
+#include <telegram/types/types.h>
+
+#include <QHash>
+
+class TelegramParticipantsStoreEntry
+{
+public:
+    TelegramParticipantsStoreEntry(): total(-1) {}
+    QList<ChatParticipant> list;
+    QHash<qint32, int> rows;
+    int total;
+};
+
+class TelegramParticipantsStorePrivate
+{
+public:
+    QHash<qint64, QHash<int, TelegramParticipantsStoreEntry> > chats;
+};
+
+TelegramParticipantsStore::TelegramParticipantsStore(QObject *parent) :
+    QObject(parent)
+{
+    p = new TelegramParticipantsStorePrivate;
+}
+
+void TelegramParticipantsStore::setChatParticipants(qint64 chatId, const QList<ChatParticipant> &list)
+{
+    TelegramParticipantsStoreEntry entry;
+    entry.list = list;
+    entry.total = list.count();
+    for(int i=0; i<list.count(); i++)
+        entry.rows[list.at(i).userId()] = i;
+
+    p->chats[chatId][RecentFilter] = entry;
+    Q_EMIT participantsChanged(chatId);
+}
+
+void TelegramParticipantsStore::insertChannelParticipants(qint64 chatId, int filter, int offset, const QList<ChannelParticipant> &list, int total)
+{
+    TelegramParticipantsStoreEntry &entry = p->chats[chatId][filter];
+    if(offset == 0)
+    {
+        entry.list.clear();
+        entry.rows.clear();
+    }
+
+    // A page may overlap the previous one when members joined meanwhile.
+    Q_FOREACH(const ChannelParticipant &participant, list)
+    {
+        const ChatParticipant &item = fromChannelParticipant(participant);
+        if(entry.rows.contains(item.userId()))
+        {
+            entry.list[entry.rows.value(item.userId())] = item;
+            continue;
+        }
+
+        entry.rows[item.userId()] = entry.list.count();
+        entry.list << item;
+    }
+
+    entry.total = list.isEmpty()? entry.list.count() : total;
+    Q_EMIT participantsChanged(chatId);
+}
+
+QList<ChatParticipant> TelegramParticipantsStore::participants(qint64 chatId, int filter) const
+{
+    return p->chats.value(chatId).value(filter).list;
+}
+
+int TelegramParticipantsStore::count(qint64 chatId, int filter) const
+{
+    return p->chats.value(chatId).value(filter).list.count();
+}
+
+int TelegramParticipantsStore::total(qint64 chatId, int filter) const
+{
+    return p->chats.value(chatId).value(filter).total;
+}
+
+bool TelegramParticipantsStore::hasMore(qint64 chatId, int filter) const
+{
+    const TelegramParticipantsStoreEntry &entry = p->chats.value(chatId).value(filter);
+    return entry.total == -1 || entry.list.count() < entry.total;
+}
+
+bool TelegramParticipantsStore::contains(qint64 chatId, int filter) const
+{
+    return p->chats.value(chatId).contains(filter);
+}
+
+ChatParticipant TelegramParticipantsStore::fromChannelParticipant(const ChannelParticipant &participant)
+{
+    ChatParticipant res;
+    res.setDate(participant.date());
+    res.setUserId(participant.userId());
+    res.setInviterId(participant.inviterId());
+    if(participant.classType() == ChannelParticipant::typeChannelParticipantCreator)
+        res.setClassType(ChatParticipant::typeChatParticipantCreator);
+    else
+    if(participant.classType() == ChannelParticipant::typeChannelParticipantEditor ||
+       participant.classType() == ChannelParticipant::typeChannelParticipantModerator)
+        res.setClassType(ChatParticipant::typeChatParticipantAdmin);
+    else
+        res.setClassType(ChatParticipant::typeChatParticipant);
+
+    return res;
+}
+
+void TelegramParticipantsStore::remove(qint64 chatId)
+{
+    if(!p->chats.remove(chatId))
+        return;
+
+    Q_EMIT participantsChanged(chatId);
+}
+
+void TelegramParticipantsStore::fetchFailed(qint64 chatId)
+{
+    // Nothing changed, views waiting for a page can ask again.
+    Q_EMIT participantsFailed(chatId);
+}
+
+void TelegramParticipantsStore::clear()
+{
+    const QList<qint64> &chats = p->chats.keys();
+    p->chats.clear();
+    Q_FOREACH(qint64 chatId, chats)
+        Q_EMIT participantsChanged(chatId);
+}
+
+TelegramParticipantsStore::~TelegramParticipantsStore()
+{
+    delete p;
+}
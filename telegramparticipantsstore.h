@@ -0,0 +1,76 @@
+/*
+    Copyright (C) 2014 Aseman
+    http://aseman.co
+
+    This project is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This project is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef TELEGRAMPARTICIPANTSSTORE_H
+#define TELEGRAMPARTICIPANTSSTORE_H
+
+#include <QObject>
+#include <QList>
+
+#include "telegramqml_global.h"
+
+class ChatParticipant;
+class ChannelParticipant;
+class TelegramParticipantsStorePrivate;
+
+/*!
+ * Participant lists of chats and channels, kept per chat and per filter.
+ * Basic groups are filled from their ChatFull in one go, channels and
+ * supergroups page by page as the views ask for more. Each change is
+ * announced for its own chat only.
+ */
+class TELEGRAMQMLSHARED_EXPORT TelegramParticipantsStore : public QObject
+{
+    Q_OBJECT
+public:
+    enum Filter {
+        RecentFilter,
+        AdminsFilter,
+        KickedFilter,
+        BotsFilter
+    };
+
+    TelegramParticipantsStore(QObject *parent = 0);
+    ~TelegramParticipantsStore();
+
+    void setChatParticipants(qint64 chatId, const QList<ChatParticipant> &list);
+    void insertChannelParticipants(qint64 chatId, int filter, int offset, const QList<ChannelParticipant> &list, int total);
+    void fetchFailed(qint64 chatId);
+
+    QList<ChatParticipant> participants(qint64 chatId, int filter = RecentFilter) const;
+    int count(qint64 chatId, int filter = RecentFilter) const;
+    int total(qint64 chatId, int filter = RecentFilter) const;
+    bool hasMore(qint64 chatId, int filter = RecentFilter) const;
+    bool contains(qint64 chatId, int filter = RecentFilter) const;
+
+    static ChatParticipant fromChannelParticipant(const ChannelParticipant &participant);
+
+public Q_SLOTS:
+    void remove(qint64 chatId);
+    void clear();
+
+Q_SIGNALS:
+    void participantsChanged(qint64 chatId);
+    void participantsFailed(qint64 chatId);
+
+private:
+    TelegramParticipantsStorePrivate *p;
+};
+
+#endif // TELEGRAMPARTICIPANTSSTORE_H
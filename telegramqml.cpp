@@ -25,6 +25,15 @@
 #include "objects/types.h"
 #include "utils.h"
 #include "syncmanager.h"
+#include "audiocoverextractor.h"
+#include "telegramstreamserver.h"
+#include "telegramrequestscheduler.h"
+#include "telegramresponsecache.h"
+#include "telegramhistorybackfill.h"
+#include "telegramtimerwheel.h"
+#include "telegramnameindex.h"
+#include "telegramsortkeys.h"
+#include "telegramparticipantsstore.h"
 #include <secret/decrypter.h>
 #include <util/utils.h>
 #include <telegram.h>
@@ -67,7 +76,15 @@ const int THUMB_SIZE = 128;
 #endif
 
 #define DIALOGS_SLICE_SIZE 100
+#define DIALOGS_IDLE_INTERVAL 30000
 #define CHANNEL_UPDATE_TIME 15000
+#define BACKGROUND_RELOAD_COUNT 50
+#define READ_FLUSH_DELAY 1000
+#define TYPING_TIMEOUT 6000
+// One UI frame, presence updates within it are applied together.
+#define PRESENCE_FLUSH_INTERVAL 16
+// Longer mutes are checked again when the dialogs are reloaded.
+#define MUTE_EXPIRY_HORIZON (24*60*60)
 
 TelegramQmlPrivate *telegramp_qml_tmp = 0;
 bool checkDialogLessThan( qint64 a, qint64 b );
@@ -149,7 +166,9 @@ public:
     QSet<qint64> installedStickerSets;
     QHash<QString, qint64> stickerShortIds;
 
-    QMultiMap<QString, qint64> userNameIndexes;
+    TelegramNameIndex userNameIndex;
+    TelegramNameIndex chatNameIndex;
+    TelegramSortKeys userSortKeys;
 
     QHash<qint64,DialogObject*> fakeDialogs;
 
@@ -162,6 +181,12 @@ public:
     QHash<qint64,MessageObject*> uploads;
     QHash<qint64,FileLocationObject*> accessHashes;
     QHash<qint64,qint64> read_history_requests;
+    QHash<qint64, QPair<qint32,qint32> > pendingReads;
+    QHash<qint64,qint32> sentReads;
+    QHash<qint64,qint64> readFlushPeers;
+    QHash<qint64, QPair<qint32,qint32> > readFlushMarks;
+    QHash<qint64,qint32> outboxReadMaxId;
+    int read_flush_timer;
     QHash<qint64,qint64> delete_history_requests;
     QSet<qint64> deleteChatIds;
     QHash<qint64,qint64> blockRequests;
@@ -174,7 +199,10 @@ public:
     QHash<qint64, qint32> pending_channelDiffs;
     QSet<QObject*> garbages;
 
-    QHash<int, QPair<qint64,qint64> > typing_timers;
+    TelegramTimerWheel *timerWheel;
+    TelegramIngestor *ingestor;
+    QHash<qint64, UserStatus> pendingStatuses;
+    int presence_timer;
     int upd_dialogs_timer;
     int update_contacts_timer;
     int garbage_checker_timer;
@@ -205,6 +233,14 @@ public:
     QTimer *messageRequester;
 
     TelegramThumbnailer thumbnailer;
+    TelegramStreamServer *streamServer;
+    TelegramMediaPreparer *mediaPreparer;
+    TelegramRequestScheduler *requestScheduler;
+    TelegramResponseCache *responseCache;
+    bool replayingCache;
+    TelegramHistoryBackfill *historyBackfill;
+    TelegramParticipantsStore *participantsStore;
+    QList<qint64> participantsRequests;
 
     QTimer *sleepTimer;
     QTimer *wakeTimer;
@@ -213,7 +249,21 @@ public:
     QTimer *channelPoller;
 
     qint32 dialogSliceOffset;
-    QSet<qint64> deletedDialogs;
+    bool dialogsComplete;
+    bool dialogsEnumerate;
+    qint32 dialogsEnumerateStart;
+    bool dialogsWalkPending;
+    QSet<qint64> dialogsSeen;
+    QSet<qint32> heldShortMessages;
+    int dialogs_idle_timer;
+
+    bool background;
+    QList<Update> backgroundUpdates;
+    QHash<qint64, User> backgroundUsers;
+    QHash<qint64, Chat> backgroundChats;
+    QHash<qint64, int> backgroundUnread;
+    QSet<qint64> backgroundDialogs;
+    bool backgroundDialogsRefresh;
 
 };
 
@@ -226,6 +276,16 @@ TelegramQml::TelegramQml(QObject *parent) :
     p->appId = 0;
     p->upd_dialogs_timer = 0;
     p->update_contacts_timer = 0;
+    p->dialogSliceOffset = 0;
+    p->dialogsComplete = false;
+    p->dialogsEnumerate = false;
+    p->dialogsEnumerateStart = 0;
+    p->dialogsWalkPending = false;
+    p->dialogs_idle_timer = 0;
+    p->read_flush_timer = 0;
+    p->presence_timer = 0;
+    p->background = false;
+    p->backgroundDialogsRefresh = false;
     p->garbage_checker_timer = 0;
     p->unreadCount = 0;
     p->autoRewakeInterval = 0;
@@ -242,6 +302,7 @@ TelegramQml::TelegramQml(QObject *parent) :
     p->wakeTimer = 0;
     p->autoAcceptEncrypted = false;
     p->autoCleanUpMessages = false;
+    p->streamServer = 0;
 
     p->cleanUpTimer = new QTimer(this);
     p->cleanUpTimer->setSingleShot(true);
@@ -286,7 +347,28 @@ TelegramQml::TelegramQml(QObject *parent) :
     p->nullStickerSet = new StickerSetObject(StickerSet(), this);
     p->nullStickerPack = new StickerPackObject(StickerPack(), this);
 
+    p->requestScheduler = new TelegramRequestScheduler(this);
+    connect(p->requestScheduler, SIGNAL(dropped(QString)), SLOT(requestDropped(QString)));
+    p->responseCache = new TelegramResponseCache(this);
+    p->responseCache->setDatabase(p->database);
+    p->replayingCache = false;
+    p->historyBackfill = new TelegramHistoryBackfill(this, p->requestScheduler);
+    p->participantsStore = new TelegramParticipantsStore(this);
+
+    p->timerWheel = new TelegramTimerWheel(this);
+    connect(p->timerWheel, SIGNAL(expired(int,qint64,qint64)), SLOT(timerWheelExpired(int,qint64,qint64)));
+
+    p->ingestor = new TelegramIngestor(this);
+    connect(p->ingestor, SIGNAL(ready(TelegramIngestBatch)), SLOT(applyIngestBatch(TelegramIngestBatch)));
+
+    p->mediaPreparer = new TelegramMediaPreparer(this);
+    p->mediaPreparer->setThumbnailer(&p->thumbnailer);
+    connect(p->mediaPreparer, SIGNAL(stageChanged(qint64,int)), SIGNAL(fileSendStageChanged(qint64,int)));
+    connect(p->mediaPreparer, SIGNAL(prepared(TelegramPreparedMedia)), SLOT(sendPreparedFile(TelegramPreparedMedia)));
+
     p->syncManager = new SyncManager(this);
+    connect(p->syncManager, &SyncManager::updateReady, this, &TelegramQml::insertUpdate);
+    connect(p->syncManager, SIGNAL(channelSyncRequested(qint32)), SLOT(syncChannel(qint32)));
     connect(p->cleanUpTimer    , SIGNAL(timeout()), SLOT(cleanUpMessages_prv())   );
     //connect(p->messageRequester, SIGNAL(timeout()), SLOT(requestReadMessage_prv()));
     p->channelPoller = new QTimer(this);
@@ -321,6 +403,13 @@ void TelegramQml::setPhoneNumber(const QString &phone)
     connect(p->database, SIGNAL(messageFounded(Message))   , SLOT(dbMessageFounded(Message))   );
     connect(p->database, SIGNAL(contactFounded(Contact))   , SLOT(dbContactFounded(Contact))   );
     connect(p->database, SIGNAL(mediaKeyFounded(qint64,QByteArray,QByteArray)), SLOT(dbMediaKeysFounded(qint64,QByteArray,QByteArray)) );
+    connect(p->database, SIGNAL(valueFounded(QString,QString)), SLOT(dbValueFounded(QString,QString)) );
+
+    p->dialogSliceOffset = 0;
+    p->dialogsComplete = false;
+    p->database->readValue("dialogsCursor");
+    p->database->readValue("dialogsComplete");
+    p->database->readValue("pendingReads");
 }
 
 QString TelegramQml::downloadPath() const
@@ -591,6 +680,26 @@ Database *TelegramQml::database() const
     return p->database;
 }
 
+TelegramHistoryBackfill *TelegramQml::historyBackfill() const
+{
+    return p->historyBackfill;
+}
+
+TelegramThumbnailer *TelegramQml::thumbnailer() const
+{
+    return &p->thumbnailer;
+}
+
+TelegramSortKeys *TelegramQml::userSortKeys() const
+{
+    return &p->userSortKeys;
+}
+
+TelegramParticipantsStore *TelegramQml::participantsStore() const
+{
+    return p->participantsStore;
+}
+
 Telegram *TelegramQml::telegram() const
 {
     return p->telegram;
@@ -614,6 +723,29 @@ bool TelegramQml::online() const
     return p->online;
 }
 
+bool TelegramQml::background() const
+{
+    return p->background;
+}
+
+void TelegramQml::setBackground(bool stt)
+{
+    if( p->background == stt )
+        return;
+
+    p->background = stt;
+    if( p->background )
+        p->channelPoller->stop();
+    else
+    {
+        flushBackground();
+        if( p->dialogsWalkPending )
+            loadAllDialogs();
+    }
+
+    Q_EMIT backgroundChanged();
+}
+
 void TelegramQml::setOnline(bool stt)
 {
     if( p->online == stt )
@@ -1352,13 +1484,42 @@ QString TelegramQml::videoThumbLocation(const QString &pt, TelegramThumbnailer_C
         return QString();
 
     const QString &thumb = path + ".jpg";
-    if(QFileInfo::exists(thumb))
+    if(p->thumbnailer.hasThumbnail(thumb))
         return localFilesPrePath() + thumb;
 
     p->thumbnailer.createThumbnail(path, thumb, callback);
     return localFilesPrePath() + thumb;
 }
 
+QString TelegramQml::imageThumbLocation(const QString &pt, TelegramThumbnailer_Callback callback)
+{
+    QString path = pt;
+    if(path.left(localFilesPrePath().length()) == localFilesPrePath())
+        path = path.mid(localFilesPrePath().length());
+    if(path.isEmpty())
+        return QString();
+
+    const QString &thumbDir = thumbnailsPath();
+    const QString &thumb = p->thumbnailer.getThumbPath(thumbDir, path);
+    if(p->thumbnailer.hasThumbnail(thumb))
+        return localFilesPrePath() + thumb;
+
+    QDir().mkpath(thumbDir);
+    p->thumbnailer.createThumbnail(path, thumb, callback);
+    return QString();
+}
+
+void TelegramQml::forgetThumbnail(const QString &pt)
+{
+    QString path = pt;
+    if(path.left(localFilesPrePath().length()) == localFilesPrePath())
+        path = path.mid(localFilesPrePath().length());
+    if(path.isEmpty())
+        return;
+
+    p->thumbnailer.forgetThumbnail(path);
+}
+
 QString TelegramQml::audioThumbLocation(const QString &pt)
 {
     QString path = pt;
@@ -1375,6 +1536,35 @@ QString TelegramQml::audioThumbLocation(const QString &pt)
     return localFilesPrePath() + thumb;
 }
 
+QUrl TelegramQml::streamFile(FileLocationObject *l, qint64 type, qint32 fileSize)
+{
+    if( !l || !p->telegram )
+        return QUrl();
+
+    const QString & download_file = fileLocation(l);
+    if( QFile::exists(download_file) && !l->download()->fileId() )
+        return QUrl::fromLocalFile(download_file);
+
+    getFile(l, type, fileSize);
+    if( !l->download()->fileId() )
+        return QUrl(l->download()->location());
+
+    if( !p->streamServer )
+        p->streamServer = new TelegramStreamServer(this);
+
+    QString mimeType;
+    DocumentObject *doc = qobject_cast<DocumentObject*>(l->parent());
+    if(doc)
+        mimeType = doc->mimeType();
+
+    return p->streamServer->registerDownload(l->download(), mimeType, l->fileName());
+}
+
+QString TelegramQml::thumbnailsPath() const
+{
+    return p->downloadPath + "/" + phoneNumber() + "/thumbnails";
+}
+
 QString TelegramQml::fileLocation_old(FileLocationObject *l)
 {
     const QString & dpath = downloadPath();
@@ -1462,54 +1652,12 @@ QString TelegramQml::localFilesPrePath()
 
 bool TelegramQml::createAudioThumbnail(const QString &audio, const QString &output)
 {
-#if defined(Q_OS_WIN) || defined(Q_OS_MAC)
-    Q_UNUSED(audio)
-    Q_UNUSED(output)
-    return false;
-#endif
-
-    const QString command = "eyeD3";
-    const QString coverName = "FRONT_COVER";
-    const QString uuid = QUuid::createUuid().toString();
-    const QString tmpDir = QDir::tempPath() + "/" + uuid;
-
-    QDir().mkpath(tmpDir);
-
-    QStringList args;
-    args << "--write-images=" + tmpDir;
-    args << audio;
-
-    QProcess prc;
-    prc.start(command, args);
-    prc.waitForStarted();
-    prc.waitForFinished();
-
-    if(prc.exitCode() != 0)
-    {
-        removeFiles(tmpDir);
-        return false;
-    }
-
-    QString file;
-    const QStringList files = QDir(tmpDir).entryList(QDir::Files);
-    Q_FOREACH(const QString &f, files)
-        if(f.left(coverName.length()) == coverName)
-        {
-            file = tmpDir + "/" + f;
-            break;
-        }
-
-    if(file.isEmpty())
-    {
-        removeFiles(tmpDir);
+    const QImage &image = AudioCoverExtractor::extractImage(audio);
+    if(image.isNull())
         return false;
-    }
 
     QImageWriter writer(output);
-    writer.write(QImage(file));
-
-    removeFiles(tmpDir);
-    return true;
+    return writer.write(image);
 }
 
 QList<qint64> TelegramQml::dialogs() const
@@ -1532,6 +1680,46 @@ QList<qint64> TelegramQml::messages( qint64 did, qint64 maxId ) const
     return res;
 }
 
+QList<qint64> TelegramQml::messagesWindow(qint64 did, qint64 anchor, int before, int after, qint64 maxId) const
+{
+    QList<qint64> res;
+    QHash<qint64, QList<qint64> >::const_iterator it = p->messages_list.constFind(did);
+    if(it == p->messages_list.constEnd())
+        return res;
+
+    // Newest first, "before" counts the newer messages above the anchor.
+    const QList<qint64> &list = it.value();
+    int pos = 0;
+    if(anchor && p->messages.contains(anchor))
+    {
+        telegramp_qml_tmp = p;
+        QList<qint64>::const_iterator found = std::lower_bound(list.constBegin(), list.constEnd(), anchor, checkMessageLessThan);
+        pos = (found != list.constEnd() && *found == anchor)? found - list.constBegin() : list.indexOf(anchor);
+        if(pos < 0)
+            pos = 0;
+    }
+
+    for(int i=pos-1; i>=0 && before>0; i--)
+    {
+        if(maxId && list.at(i) > maxId)
+            continue;
+
+        res.prepend(list.at(i));
+        before--;
+    }
+
+    for(int i=pos; i<list.count() && after>0; i++)
+    {
+        if(maxId && list.at(i) > maxId)
+            continue;
+
+        res.append(list.at(i));
+        after--;
+    }
+
+    return res;
+}
+
 QList<qint64> TelegramQml::wallpapers() const
 {
     return p->wallpapers_map.keys();
@@ -1621,29 +1809,14 @@ InputPeer TelegramQml::getInputPeer(qint64 peerId)
     return peer;
 }
 
-QList<qint64> TelegramQml::userIndex(const QString &kw)
+QList<qint64> TelegramQml::userIndex(const QString &keyword)
 {
-    const QString & keyword = kw.toLower();
-
-    QList<qint64> result;
-    QSet<qint64> addeds;
-
-    QMapIterator<QString, qint64> i(p->userNameIndexes);
-    while(i.hasNext())
-    {
-        i.next();
-        qint64 uid = i.value();
-        if(addeds.contains(uid))
-            continue;
-        else
-        if(!i.key().contains(keyword.toLower()))
-            continue;
-
-        result << uid;
-        addeds.insert(uid);
-    }
+    return p->userNameIndex.search(keyword);
+}
 
-    return result;
+QList<qint64> TelegramQml::chatIndex(const QString &keyword)
+{
+    return p->chatNameIndex.search(keyword);
 }
 
 void TelegramQml::authLogout()
@@ -1741,12 +1914,81 @@ void TelegramQml::accountUpdateProfile(const QString &firstName, const QString &
     p->telegram->accountUpdateProfile(firstName, lastName);
 }
 
+void TelegramQml::contactsGetContacts()
+{
+    if(!p->telegram)
+        return;
+
+    QString hash;
+    const QByteArray &data = p->responseCache->value("contacts");
+    if(!data.isEmpty())
+        hash = contactsHash(TelegramResponseCache::fromData<ContactsContacts>(data).contacts());
+
+    p->requestScheduler->schedule("contactsGetContacts", TelegramRequestScheduler::BackgroundSync, [this, hash]() -> qint64 {
+        return p->telegram->contactsGetContacts(hash);
+    });
+}
+
+void TelegramQml::messagesGetAllStickers()
+{
+    if(!p->telegram)
+        return;
+
+    qint32 hash = 0;
+    const QByteArray &data = p->responseCache->value("allstickers");
+    if(!data.isEmpty())
+        hash = TelegramResponseCache::fromData<MessagesAllStickers>(data).hash();
+
+    p->requestScheduler->schedule("messagesGetAllStickers", TelegramRequestScheduler::BackgroundSync, [this, hash]() -> qint64 {
+        return p->telegram->messagesGetAllStickers(hash);
+    });
+}
+
+QString TelegramQml::contactsHash(const QList<Contact> &contacts)
+{
+    QList<qint32> ids;
+    Q_FOREACH(const Contact &contact, contacts)
+        ids << contact.userId();
+    qSort(ids);
+
+    QStringList list;
+    Q_FOREACH(qint32 id, ids)
+        list << QString::number(id);
+
+    return QCryptographicHash::hash(list.join(",").toUtf8(), QCryptographicHash::Md5).toHex();
+}
+
+void TelegramQml::accountGetWallPapers()
+{
+    if(!p->telegram)
+        return;
+
+    const QString key = "wallpapers";
+    if(takeCachedResponse(key))
+        return;
+
+    p->requestScheduler->schedule("accountGetWallPapers", TelegramRequestScheduler::VisibleData, [this, key]() -> qint64 {
+        const qint64 msgId = p->telegram->accountGetWallPapers();
+        p->responseCache->setRequestId(msgId, key);
+        return msgId;
+    });
+}
+
 void TelegramQml::usersGetFullUser(qint64 userId)
 {
     if (!p->telegram)
         return;
 
-    p->telegram->usersGetFullUser(getInputUser(userId));
+    const QString key = "user:" + QString::number(userId);
+    if(takeCachedResponse(key))
+        return;
+
+    const InputUser &user = getInputUser(userId);
+    p->requestScheduler->schedule("usersGetFullUser", TelegramRequestScheduler::VisibleData, [this, user, key]() -> qint64 {
+        const qint64 msgId = p->telegram->usersGetFullUser(user);
+        p->responseCache->setRequestId(msgId, key);
+        return msgId;
+    });
 }
 
 void TelegramQml::accountCheckUsername(const QString &username)
@@ -1800,10 +2042,12 @@ qint32 TelegramQml::sendMessage(qint64 dId, const QString &msg, qint32 replyTo)
     if(dlg && dlg->encrypted())
     {
         apiId = p->telegram->messagesSendEncrypted(dId, p->msg_send_random_id, 0, msg);
+        p->requestScheduler->track("messagesSendEncrypted", TelegramRequestScheduler::UserInitiated, apiId);
     }
     else
     {
         apiId = p->telegram->messagesSendMessage(true, false, false, true, peer, replyTo, plainText, p->msg_send_random_id, ReplyMarkup(), entities);
+        p->requestScheduler->track("messagesSendMessage", TelegramRequestScheduler::UserInitiated, apiId);
     }
     if(peer.channelId())
         p->pend_messages[p->msg_send_random_id] = msgObj;
@@ -1889,7 +2133,8 @@ void TelegramQml::forwardMessages(QList<int> msgIds, qint32 toPeerId, PeerObject
     for(int i=0; i<msgIds.count(); i++)
         randoms << generateRandomId();
 
-    p->telegram->messagesForwardMessages(false, false, fwdFromPeer, msgIds, randoms, toPeer);
+    const qint64 msgId = p->telegram->messagesForwardMessages(false, false, fwdFromPeer, msgIds, randoms, toPeer);
+    p->requestScheduler->track("messagesForwardMessages", TelegramRequestScheduler::UserInitiated, msgId);
 }
 
 void TelegramQml::deleteMessages(const QList<int> msgIds, PeerObject *peer)
@@ -1900,11 +2145,12 @@ void TelegramQml::deleteMessages(const QList<int> msgIds, PeerObject *peer)
 
     Q_FOREACH(qint32 msgId, msgIds)
     {
-        MessageObject *msgObj = p->messages.value(QmlUtils::getUnifiedMessageKey(msgId, peer->channelId()));
+        const qint64 unifiedId = QmlUtils::getUnifiedMessageKey(msgId, peer->channelId());
+        MessageObject *msgObj = p->messages.value(unifiedId);
         if(msgObj)
         {
-            p->database->deleteMessage(msgId);
-            insertToGarbeges(p->messages.value(msgId));
+            p->database->deleteMessage(unifiedId);
+            insertToGarbeges(msgObj);
         }
     }
     Q_EMIT messagesChanged(false);
@@ -2043,6 +2289,7 @@ void TelegramQml::messagesDeleteHistory(qint64 peerId, bool deleteChat, bool use
             insertToGarbeges(p->chats[peerId]);
             insertToGarbeges(p->dialogs[peerId]);
         } else {
+            p->responseCache->remove("chat:" + QString::number(peerId));
             messagesGetFullChat(peerId);
         }
     } else if (p->encchats.contains(peerId)) {
@@ -2085,7 +2332,7 @@ void TelegramQml::messagesSetTyping(qint64 peerId, bool stt)
 
 }
 
-qint64 TelegramQml::channelsReadHistory(qint32 channelId, qint64 accessHash)
+qint64 TelegramQml::channelsReadHistory(qint32 channelId, qint64 accessHash, qint32 maxId)
 {
     if(!p->telegram)
         return 0;
@@ -2096,7 +2343,7 @@ qint64 TelegramQml::channelsReadHistory(qint32 channelId, qint64 accessHash)
     InputChannel channel(InputChannel::typeInputChannel);
     channel.setChannelId(channelId);
     channel.setAccessHash(accessHash);
-    result = p->telegram->channelsReadHistory(channel, 0);
+    result = p->telegram->channelsReadHistory(channel, maxId);
     p->read_history_requests.insert(result, channelId);
     return result;
 }
@@ -2129,7 +2376,7 @@ void TelegramQml::channelsDeleteMessages(qint32 channelId, qint64 accessHash, QL
 
 }
 
-qint64 TelegramQml::messagesReadHistory(qint64 peerId, qint32 maxDate)
+qint64 TelegramQml::messagesReadHistory(qint64 peerId, qint32 maxDate, qint32 maxId)
 {
     if(!p->telegram)
         return 0;
@@ -2139,7 +2386,7 @@ qint64 TelegramQml::messagesReadHistory(qint64 peerId, qint32 maxDate)
     qint64 result;
     const InputPeer & peer = getInputPeer(peerId);
     if(!p->encchats.contains(peerId)) {
-        result = p->telegram->messagesReadHistory(peer);
+        result = p->telegram->messagesReadHistory(peer, maxId);
     }  else {
         if (maxDate == 0) {
             maxDate = (qint32) QDateTime::currentDateTime().toTime_t();
@@ -2151,6 +2398,112 @@ qint64 TelegramQml::messagesReadHistory(qint64 peerId, qint32 maxDate)
     return result;
 }
 
+void TelegramQml::readHistory(qint64 peerId, qint32 maxId, qint32 maxDate)
+{
+    if(!peerId)
+        return;
+    if(maxId && maxId <= p->sentReads.value(peerId))
+        return;
+
+    const QPair<qint32,qint32> current = p->pendingReads.value(peerId);
+    if(p->pendingReads.contains(peerId) && maxId <= current.first && maxDate <= current.second)
+        return;
+
+    QPair<qint32,qint32> &pending = p->pendingReads[peerId];
+    pending.first = qMax(pending.first, maxId);
+    pending.second = qMax(pending.second, maxDate);
+    storePendingReads();
+
+    if(!p->read_flush_timer)
+        p->read_flush_timer = startTimer(READ_FLUSH_DELAY);
+}
+
+void TelegramQml::flushReadHistory(qint64 peerId)
+{
+    if(p->read_flush_timer && !peerId)
+    {
+        killTimer(p->read_flush_timer);
+        p->read_flush_timer = 0;
+    }
+
+    // Kept in the database until we are back online.
+    if(!p->telegram || !p->telegram->isConnected() || !p->authLoggedIn)
+        return;
+
+    // Marks stay pending, and stored, until the server confirms them.
+    const QList<qint64> &peers = peerId? QList<qint64>() << peerId : p->pendingReads.keys();
+    Q_FOREACH(qint64 pId, peers)
+    {
+        if(!p->pendingReads.contains(pId))
+            continue;
+
+        const QPair<qint32,qint32> pending = p->pendingReads.value(pId);
+        bool inFlight = false;
+        QHashIterator<qint64,qint64> i(p->readFlushPeers);
+        while(i.hasNext() && !inFlight)
+            inFlight = i.next().value() == pId && p->readFlushMarks.value(i.key()) == pending;
+        if(inFlight)
+            continue;
+
+        qint64 requestId = 0;
+        const InputPeer &input = getInputPeer(pId);
+        if(input.classType() == InputPeer::typeInputPeerChannel)
+            requestId = channelsReadHistory(input.channelId(), input.accessHash(), pending.first);
+        else
+            requestId = messagesReadHistory(pId, pending.second, pending.first);
+        if(!requestId)
+            continue;
+
+        p->readFlushPeers[requestId] = pId;
+        p->readFlushMarks[requestId] = pending;
+    }
+}
+
+void TelegramQml::readFlushFinished(qint64 requestId, bool ok, qint32 errorCode)
+{
+    if(!p->readFlushPeers.contains(requestId))
+        return;
+
+    const qint64 pId = p->readFlushPeers.take(requestId);
+    const QPair<qint32,qint32> sent = p->readFlushMarks.take(requestId);
+    if(!ok)
+    {
+        // Rejected marks are dropped, anything else is sent again.
+        if(errorCode == 400)
+        {
+            p->pendingReads.remove(pId);
+            storePendingReads();
+        }
+        else
+        if(!p->read_flush_timer)
+            p->read_flush_timer = startTimer(READ_FLUSH_DELAY);
+        return;
+    }
+
+    p->sentReads[pId] = qMax(p->sentReads.value(pId), sent.first);
+
+    // Marks made while the request was out are still pending.
+    const QPair<qint32,qint32> pending = p->pendingReads.value(pId);
+    if(p->pendingReads.contains(pId) && pending.first <= sent.first && pending.second <= sent.second)
+    {
+        p->pendingReads.remove(pId);
+        storePendingReads();
+    }
+}
+
+void TelegramQml::storePendingReads()
+{
+    QStringList list;
+    QHashIterator<qint64, QPair<qint32,qint32> > i(p->pendingReads);
+    while(i.hasNext())
+    {
+        i.next();
+        list << QString("%1:%2:%3").arg(i.key()).arg(i.value().first).arg(i.value().second);
+    }
+
+    p->database->setValue("pendingReads", list.join(","));
+}
+
 void TelegramQml::messagesCreateEncryptedChat(qint64 userId)
 {
     if( !p->telegram )
@@ -2194,7 +2547,15 @@ void TelegramQml::messagesGetFullChat(qint32 chatId)
     if(!p->telegram)
         return;
 
-    p->telegram->messagesGetFullChat(chatId);
+    const QString key = "chat:" + QString::number(chatId);
+    if(takeCachedResponse(key))
+        return;
+
+    p->requestScheduler->schedule("messagesGetFullChat", TelegramRequestScheduler::VisibleData, [this, chatId, key]() -> qint64 {
+        const qint64 msgId = p->telegram->messagesGetFullChat(chatId);
+        p->responseCache->setRequestId(msgId, key);
+        return msgId;
+    });
 }
 
 void TelegramQml::channelsGetFullChannel(qint32 peerId)
@@ -2202,11 +2563,73 @@ void TelegramQml::channelsGetFullChannel(qint32 peerId)
     if(!p->telegram)
         return;
 
+    const QString key = "channel:" + QString::number(peerId);
+    if(takeCachedResponse(key))
+        return;
+
     const InputPeer & input = getInputPeer(peerId);
     InputChannel channel(InputChannel::typeInputChannel);
     channel.setChannelId(input.channelId());
     channel.setAccessHash(input.accessHash());
-    p->telegram->channelsGetFullChannel(channel);
+    p->requestScheduler->schedule("channelsGetFullChannel", TelegramRequestScheduler::VisibleData, [this, channel, key]() -> qint64 {
+        const qint64 msgId = p->telegram->channelsGetFullChannel(channel);
+        p->responseCache->setRequestId(msgId, key);
+        return msgId;
+    });
+}
+
+void TelegramQml::channelsGetParticipants(qint32 channelId, int filter, int offset, int limit)
+{
+    if(!p->telegram)
+        return;
+
+    ChannelParticipantsFilter participantsFilter(ChannelParticipantsFilter::typeChannelParticipantsRecent);
+    switch(filter)
+    {
+    case TelegramParticipantsStore::AdminsFilter:
+        participantsFilter.setClassType(ChannelParticipantsFilter::typeChannelParticipantsAdmins);
+        break;
+    case TelegramParticipantsStore::KickedFilter:
+        participantsFilter.setClassType(ChannelParticipantsFilter::typeChannelParticipantsKicked);
+        break;
+    case TelegramParticipantsStore::BotsFilter:
+        participantsFilter.setClassType(ChannelParticipantsFilter::typeChannelParticipantsBots);
+        break;
+    }
+
+    const InputPeer & input = getInputPeer(channelId);
+    InputChannel channel(InputChannel::typeInputChannel);
+    channel.setChannelId(input.channelId());
+    channel.setAccessHash(input.accessHash());
+
+    QPointer<TelegramQml> guard = this;
+    TelegramCore::Callback<ChannelsChannelParticipants> callback = [this, guard, channelId, filter, offset](TG_CHANNELS_GET_PARTICIPANTS_CALLBACK) {
+        if(!guard)
+            return;
+        if(!error.null)
+        {
+            // A FLOOD_WAIT retry answers later.
+            if(!p->requestScheduler->serverError(msgId, error.errorCode, error.errorText))
+            {
+                p->participantsRequests.removeOne(channelId);
+                p->participantsStore->fetchFailed(channelId);
+            }
+            return;
+        }
+
+        p->requestScheduler->finished(msgId);
+        p->participantsRequests.removeOne(channelId);
+        Q_FOREACH(const User & user, result.users())
+            insertUser(user, false, false);
+        Q_EMIT usersChanged();
+
+        p->participantsStore->insertChannelParticipants(channelId, filter, offset, result.participants(), result.count());
+    };
+
+    p->participantsRequests << channelId;
+    p->requestScheduler->schedule("channelsGetParticipants", TelegramRequestScheduler::VisibleData, [this, channel, participantsFilter, offset, limit, callback]() -> qint64 {
+        return p->telegram->channelsGetParticipants(channel, participantsFilter, offset, limit, callback);
+    });
 }
 
 void TelegramQml::installStickerSet(const QString &shortName)
@@ -2241,7 +2664,15 @@ void TelegramQml::getStickerSet(const QString &shortName)
     InputStickerSet set(InputStickerSet::typeInputStickerSetShortName);
     set.setShortName(shortName);
 
-    p->telegram->messagesGetStickerSet(set);
+    const QString key = "stickerset:" + shortName;
+    if(takeCachedResponse(key))
+        return;
+
+    p->requestScheduler->schedule("messagesGetStickerSet", TelegramRequestScheduler::VisibleData, [this, set, key]() -> qint64 {
+        const qint64 msgId = p->telegram->messagesGetStickerSet(set);
+        p->responseCache->setRequestId(msgId, key);
+        return msgId;
+    });
 }
 
 void TelegramQml::getStickerSet(DocumentObject *doc)
@@ -2255,8 +2686,26 @@ void TelegramQml::getStickerSet(DocumentObject *doc)
     Q_FOREACH(DocumentAttribute attr, attrs)
         if(attr.classType() == DocumentAttribute::typeDocumentAttributeSticker)
         {
-            qint64 msgId = p->telegram->messagesGetStickerSet(attr.stickerset());
-            p->pending_doc_stickers[msgId] = doc;
+            const InputStickerSet set = attr.stickerset();
+            const QString key = "stickerset:" + QString::number(set.id());
+            if(p->responseCache->contains(key))
+            {
+                // Answered from the cache, the document still gets its signal.
+                const qint64 msgId = generateRandomId();
+                p->pending_doc_stickers[msgId] = doc;
+                QMetaObject::invokeMethod(this, "replayCachedResponse", Qt::QueuedConnection, Q_ARG(QString,key), Q_ARG(qint64,msgId));
+                break;
+            }
+
+            QPointer<DocumentObject> docPtr = doc;
+            p->requestScheduler->schedule("messagesGetStickerSet", TelegramRequestScheduler::VisibleData, [this, set, docPtr]() -> qint64 {
+                if(!docPtr)
+                    return 0;
+
+                qint64 msgId = p->telegram->messagesGetStickerSet(set);
+                p->pending_doc_stickers[msgId] = docPtr;
+                return msgId;
+            });
             break;
         }
 }
@@ -2295,47 +2744,44 @@ qint64 TelegramQml::sendFile(qint64 dId, const QString &fpath, bool forceDocumen
     if( !dlg )
         return 0;
 
+    TelegramPreparedMedia media;
+    media.handle = generateRandomId();
+    media.dialogId = dId;
+    media.source = fpath;
+    media.file = file;
+    media.tempPath = tempPath();
+    media.videoThumbnail = p->thumbnailer.getThumbPath(tempPath(), fpath);
+    media.coverThumbnail = p->thumbnailer.getFingerprintThumbPath(thumbnailsPath(), file);
+    media.encrypted = dlg->encrypted();
+    media.forceDocument = forceDocument;
+    media.forceAudio = forceAudio;
+
+    p->mediaPreparer->prepare(media);
+    return media.handle;
+}
+
+void TelegramQml::sendPreparedFile(const TelegramPreparedMedia &prepared)
+{
+    if( prepared.failed || !p->telegram )
+        return;
+
+    const qint64 dId = prepared.dialogId;
+    DialogObject *dlg = dialog(dId);
+
+    const QString &file = prepared.file;
+    const QString &thumbnail = prepared.thumbnail;
+    const QSize &size = prepared.size;
+    qWarning() << "Sending file mime type:" << prepared.mimeType;
+
     Message message = newMessage(dId);
     InputPeer peer = getInputPeer(dId);
 
     qint64 fileId;
     p->msg_send_random_id = generateRandomId();
-    const QMimeType & t = p->mime_db.mimeTypeForFile(file);
-    qWarning() << "Sending file mime type:" << t.name();
-    QString thumbnail = p->thumbnailer.getThumbPath(tempPath(), fpath);
-    if (t.name().contains("video/") && !p->thumbnailer.hasThumbnail(thumbnail)) {
-#ifdef TG_THUMBNAILER_CPP11
-        TelegramThumbnailer_Callback callBack = [this, dId, fpath, forceDocument, forceAudio]() {
-            sendFile(dId, fpath, forceDocument, forceAudio);
-        };
-#else
-        TelegramThumbnailer_Callback callBack;
-        callBack.object = this;
-        callBack.method = "sendFile";
-        callBack.args << dId << fpath << forceDocument << forceAudio;
-#endif
-
-        p->thumbnailer.createThumbnail(fpath, thumbnail,callBack);
-        // Stop here. We'll call back to this method once thumbnailer's done.
-        return true;
-    }
-
-    QImageReader reader(thumbnail);
-    QSize size = reader.size();
-    if (size.width() == 0 || size.height() == 0) {
-        thumbnail.clear();
-    }
-
-    if( (t.name().contains("webp") || fpath.right(5) == ".webp") && !dlg->encrypted() && !forceDocument && !forceAudio )
+    switch(static_cast<int>(prepared.kind))
+    {
+    case TelegramPreparedMedia::Sticker:
     {
-        QImageReader reader(file);
-        const QSize imageSize = reader.size();
-        reader.setScaledSize(QSize(200, 200.0*imageSize.height()/imageSize.width()));
-
-        QString thumbnail = tempPath() +"/cutegram_thumbnail_" + QUuid::createUuid().toString() + ".webp";
-        QImageWriter writer(thumbnail);
-        writer.write(reader.read());
-
         fileId = p->telegram->messagesSendDocument(peer, p->msg_send_random_id, file, thumbnail, QString::null, true);
 
         MessageMedia media = message.media();
@@ -2347,8 +2793,9 @@ qint64 TelegramQml::sendFile(qint64 dId, const QString &fpath, bool forceDocumen
         media.setDocument(document);
         message.setMedia(media);
     }
-    else
-    if( !t.name().contains("gif") && t.name().contains("image/") && !forceDocument && !forceAudio )
+        break;
+
+    case TelegramPreparedMedia::Photo:
     {
         if(dlg->encrypted())
             fileId = p->telegram->messagesSendEncryptedPhoto(dId, p->msg_send_random_id, 0, file);
@@ -2359,11 +2806,10 @@ qint64 TelegramQml::sendFile(qint64 dId, const QString &fpath, bool forceDocumen
         media.setClassType(MessageMedia::typeMessageMediaPhoto);
         message.setMedia(media);
     }
-    else
-    if( t.name().contains("video/") && !forceDocument && !forceAudio )
-    {
-        // Video thumb already processed.
+        break;
 
+    case TelegramPreparedMedia::Video:
+    {
         if(dlg->encrypted())
         {
             QByteArray thumbData;
@@ -2386,8 +2832,9 @@ qint64 TelegramQml::sendFile(qint64 dId, const QString &fpath, bool forceDocumen
         media.setDocument(document);
         message.setMedia(media);
     }
-    else
-    if( (t.name().contains("audio/") || forceAudio) && !forceDocument && !dlg->encrypted() )
+        break;
+
+    case TelegramPreparedMedia::Audio:
     {
         fileId = p->telegram->messagesSendAudio(peer, p->msg_send_random_id, file, 0);
 
@@ -2398,22 +2845,10 @@ qint64 TelegramQml::sendFile(qint64 dId, const QString &fpath, bool forceDocumen
         media.setDocument(document);
         message.setMedia(media);
     }
-    else
-    {
-        QString thumbnail = tempPath()+"/cutegram_thumbnail_" + QUuid::createUuid().toString() + ".jpg";
-        if(t.name().contains("audio/"))
-        {
-            if(!createAudioThumbnail(file, thumbnail))
-                thumbnail.clear();
-        }
-        else
-        if(t.name().contains("video/"))
-        {
-            // Video thumb already processed.
-        }
-        else
-            thumbnail.clear();
+        break;
 
+    default:
+    {
         if(dlg->encrypted())
             fileId = p->telegram->messagesSendEncryptedDocument(dId, p->msg_send_random_id, 0, file);
         else
@@ -2423,6 +2858,8 @@ qint64 TelegramQml::sendFile(qint64 dId, const QString &fpath, bool forceDocumen
         media.setClassType(MessageMedia::typeMessageMediaDocument);
         message.setMedia(media);
     }
+        break;
+    }
 
     insertMessage(message, false, false, true);
 
@@ -2441,8 +2878,9 @@ qint64 TelegramQml::sendFile(qint64 dId, const QString &fpath, bool forceDocumen
     p->uploads[fileId] = msgObj;
     p->uploadPercents.insert(upload);
 
+    Q_EMIT fileSendStageChanged(prepared.handle, TelegramMediaPreparer::StageUploading);
+    Q_EMIT fileSendStarted(prepared.handle, fileId);
     Q_EMIT uploadsChanged();
-    return fileId;
 }
 
 void TelegramQml::getFile(FileLocationObject *l, qint64 type, qint32 fileSize)
@@ -2625,6 +3063,12 @@ void TelegramQml::setProfilePhoto(const QString &fileName)
 
 void TelegramQml::timerUpdateDialogs(qint32 duration)
 {
+    if( p->background )
+    {
+        p->backgroundDialogsRefresh = true;
+        return;
+    }
+
     if( p->upd_dialogs_timer )
         killTimer(p->upd_dialogs_timer);
 
@@ -2665,6 +3109,44 @@ void TelegramQml::updatesGetDifference()
     p->telegram->updatesGetDifference(currentState.pts(), currentState.date(), currentState.qts());
 }
 
+bool TelegramQml::takeCachedResponse(const QString &key)
+{
+    if(p->responseCache->contains(key))
+    {
+        QMetaObject::invokeMethod(this, "replayCachedResponse", Qt::QueuedConnection, Q_ARG(QString,key), Q_ARG(qint64,0));
+        return true;
+    }
+
+    // The same entity is already on its way, the answer is shared.
+    return !p->responseCache->startRequest(key);
+}
+
+void TelegramQml::replayCachedResponse(const QString &key, qint64 msgId)
+{
+    const QByteArray &data = p->responseCache->value(key);
+    if(data.isEmpty())
+        return;
+
+    p->replayingCache = true;
+    if(key.startsWith("chat:") || key.startsWith("channel:"))
+        messagesGetFullChat_slt(msgId, TelegramResponseCache::fromData<MessagesChatFull>(data));
+    else
+    if(key.startsWith("user:"))
+        usersGetFullUser_slt(msgId, TelegramResponseCache::fromData<UserFull>(data));
+    else
+    if(key.startsWith("stickerset:"))
+        messagesGetStickerSet_slt(msgId, TelegramResponseCache::fromData<MessagesStickerSet>(data));
+    else
+    if(key == "wallpapers")
+        accountGetWallPapers_slt(msgId, TelegramResponseCache::fromData< QList<WallPaper> >(data));
+    p->replayingCache = false;
+}
+
+QVariantMap TelegramQml::requestMetrics() const
+{
+    return p->requestScheduler->metrics();
+}
+
 void TelegramQml::updatesGetChannelDifference(qint32 channelId, qint64 accessHash)
 {
     if(!p->telegram || !p->telegram->isConnected())
@@ -2685,20 +3167,24 @@ void TelegramQml::updatesGetChannelDifference(qint32 channelId, qint64 accessHas
 
             return;
         }
+        p->requestScheduler->finished(msgId);
         if(result.classType() != UpdatesChannelDifference::typeUpdatesChannelDifferenceEmpty)
         {
             Q_FOREACH( const Update & u, result.otherUpdates() )
                 insertUpdate(u);
-            Q_FOREACH( const User & u, result.users() )
-                insertUser(u, false, false);
-            Q_EMIT usersChanged();
-            Q_FOREACH( const Chat & c, result.chats() )
-                insertChat(c, false, ChatFull(), false);
-            Q_EMIT chatsChanged();
-            Q_FOREACH( const Message & m, result.newMessages() )
-                insertMessage(m, false, false, false, false);
-            sortMessages();
-            Q_EMIT messagesChanged(false);
+            insertUpdateEntities(result.users(), result.chats());
+            if(p->background)
+            {
+                Q_FOREACH( const Message & m, result.newMessages() )
+                    insertBackgroundMessage(m, true);
+            }
+            else
+            {
+                Q_FOREACH( const Message & m, result.newMessages() )
+                    insertMessage(m, false, false, false, false);
+                sortMessages();
+                Q_EMIT messagesChanged(false);
+            }
         }
         auto newState = p->syncManager->getState(channelId);
         if(newState.pts() != result.pts())
@@ -2712,7 +3198,18 @@ void TelegramQml::updatesGetChannelDifference(qint32 channelId, qint64 accessHas
             updatesGetChannelDifference(channelId, accessHash);
         }
     };
-    p->telegram->updatesGetChannelDifference(channel, ChannelMessagesFilter(), currentState.pts(), 50, callback);
+    p->requestScheduler->schedule("updatesGetChannelDifference", TelegramRequestScheduler::BackgroundSync, [this, channel, channelId, callback]() -> qint64 {
+        return p->telegram->updatesGetChannelDifference(channel, ChannelMessagesFilter(), p->syncManager->getState(channelId).pts(), 50, callback);
+    });
+}
+
+void TelegramQml::syncChannel(qint32 channelId)
+{
+    ChatObject *chat = p->chats.value(channelId);
+    if(!chat || chat->classType() != Chat::typeChannel)
+        return;
+
+    updatesGetChannelDifference(channelId, chat->accessHash());
 }
 
 void TelegramQml::updatesGetChannelDifference()
@@ -2730,7 +3227,9 @@ void TelegramQml::updatesGetChannelDifference()
     if(busy())
     {
         setBusy(false);
-        p->channelPoller->start(CHANNEL_UPDATE_TIME);
+        // Polling is resumed by flushBackground() otherwise.
+        if(!p->background)
+            p->channelPoller->start(CHANNEL_UPDATE_TIME);
         reconnectLock.tryLock();
         reconnectLock.unlock();
     }
@@ -2853,7 +3352,9 @@ bool TelegramQml::requestReadMessage(qint32 msgId)
     getMessagesLock.lock();
     QList<qint32> singleRequest;
     singleRequest << msgId;
-    p->telegram->messagesGetMessages(singleRequest);
+    p->requestScheduler->schedule("messagesGetMessages", TelegramRequestScheduler::VisibleData, [this, singleRequest]() -> qint64 {
+        return p->telegram->messagesGetMessages(singleRequest);
+    });
     getMessagesLock.unlock();
 
     return true;
@@ -2867,7 +3368,9 @@ bool TelegramQml::requestReadChannelMessage(qint32 msgId, qint32 channelId, qint
     InputChannel channel(InputChannel::typeInputChannel);
     channel.setChannelId(channelId);
     channel.setAccessHash(accessHash);
-    p->telegram->channelsGetMessages(channel, singleRequest);
+    p->requestScheduler->schedule("channelsGetMessages", TelegramRequestScheduler::VisibleData, [this, channel, singleRequest]() -> qint64 {
+        return p->telegram->channelsGetMessages(channel, singleRequest);
+    });
     getMessagesLock.unlock();
     return true;
 }
@@ -2903,12 +3406,19 @@ void TelegramQml::try_init()
     removeFiles(tempPath());
     QDir().mkpath(tempPath());
 
+    QDir().mkpath(p->configPath + "/" + p->phoneNumber);
+    p->thumbnailer.setIndexPath(p->configPath + "/" + p->phoneNumber + "/thumbnails.index");
+    p->thumbnailer.forgetThumbnails(tempPath());
+
     QString pKeyFile = publicKeyPath();
     if(pKeyFile.left(localFilesPrePath().length()) == localFilesPrePath())
         pKeyFile = pKeyFile.mid(localFilesPrePath().length());
 
     p->telegram = new Telegram(p->defaultHostAddress,p->defaultHostPort,p->defaultHostDcId,
                                p->appId, p->appHash, p->phoneNumber, p->configPath, pKeyFile);
+    p->requestScheduler->setTelegram(p->telegram);
+    p->responseCache->load();
+    p->historyBackfill->reset();
 
     connect( p->telegram, &Telegram::authNeeded, this, &TelegramQml::authNeeded_slt);
     connect( p->telegram, &Telegram::authLoggedIn, this, &TelegramQml::authLoggedIn_slt);
@@ -2949,6 +3459,7 @@ void TelegramQml::try_init()
     connect( p->telegram, &Telegram::messagesGetHistoryAnswer, this, &TelegramQml::messagesGetHistory_slt);
     connect( p->telegram, &Telegram::messagesReadHistoryAnswer,  this, &TelegramQml::messagesReadHistory_slt);
     connect( p->telegram, &Telegram::messagesReadEncryptedHistoryAnswer, this, &TelegramQml::messagesReadEncryptedHistory_slt);
+    connect( p->telegram, &Telegram::channelsReadHistoryAnswer, this, &TelegramQml::channelsReadHistory_slt);
     connect( p->telegram, &Telegram::messagesGetMessagesAnswer, this, &TelegramQml::messagesGetMessages_slt);
 
     connect( p->telegram, &Telegram::messagesSendMessageAnswer, this, &TelegramQml::messagesSendMessage_slt);
@@ -3102,7 +3613,6 @@ void TelegramQml::try_init()
     connect( p->telegram, &Telegram::messagesGetAllStickersError, this, &TelegramQml::onServerError);
     connect( p->telegram, &Telegram::messagesGetChatsError, this, &TelegramQml::onServerError);
     connect( p->telegram, &Telegram::messagesGetDhConfigError, this, &TelegramQml::onServerError);
-    connect( p->telegram, &Telegram::messagesGetDialogsError, this, &TelegramQml::onServerError);
     connect( p->telegram, &Telegram::messagesGetDialogsError, this, &TelegramQml::removeDialogsLock);
     connect( p->telegram, &Telegram::messagesGetFullChatError, this, &TelegramQml::onServerError);
     connect( p->telegram, &Telegram::messagesGetHistoryError, this, &TelegramQml::onServerError);
@@ -3319,8 +3829,16 @@ void TelegramQml::authSignInError_slt(qint64 id, qint32 errorCode, QString error
 }
 
 void TelegramQml::onServerError(qint64 msgId, qint32 errorCode, const QString &errorText)
+{
+    handleServerError(msgId, errorCode, errorText);
+}
+
+bool TelegramQml::handleServerError(qint64 msgId, qint32 errorCode, const QString &errorText)
 {
     qWarning() << __FUNCTION__ << "msg: " << msgId << errorCode << errorText;
+    const bool requeued = p->requestScheduler->serverError(msgId, errorCode, errorText);
+    readFlushFinished(msgId, false, errorCode);
+    p->responseCache->finishRequest(msgId);
     if(errorCode == 401)
     {
         if(errorText == "AUTH_KEY_UNREGISTERED")
@@ -3328,6 +3846,8 @@ void TelegramQml::onServerError(qint64 msgId, qint32 errorCode, const QString &e
             authLogOut_slt(0, true);
         }
     }
+
+    return requeued;
 }
 
 void TelegramQml::removeReconnectLock(qint64 msgId, qint32 errorCode, const QString &errorText)
@@ -3340,9 +3860,53 @@ void TelegramQml::removeReconnectLock(qint64 msgId, qint32 errorCode, const QStr
 
 void TelegramQml::removeDialogsLock(qint64 msgId, qint32 errorCode, const QString &errorText)
 {
-    Q_UNUSED(msgId)
-    Q_UNUSED(errorCode)
+    // Not connected to onServerError(), the scheduler must only see the
+    // error once. A FLOOD_WAIT retry is still ours, its answer releases the lock.
+    if(handleServerError(msgId, errorCode, errorText))
+        return;
+
     qWarning() << "removeDialogsLock due to error:" << errorText;
+    cancelDialogsWalk();
+    releaseDialogsLock();
+}
+
+void TelegramQml::requestDropped(const QString &method)
+{
+    if(method == "messagesGetDialogs")
+    {
+        cancelDialogsWalk();
+        releaseDialogsLock();
+    }
+    else
+    if(method == "messagesGetFullChat")
+        p->responseCache->dropRequests("chat:");
+    else
+    if(method == "channelsGetFullChannel")
+        p->responseCache->dropRequests("channel:");
+    else
+    if(method == "usersGetFullUser")
+        p->responseCache->dropRequests("user:");
+    else
+    if(method == "messagesGetStickerSet")
+        p->responseCache->dropRequests("stickerset:");
+    else
+    if(method == "accountGetWallPapers")
+        p->responseCache->dropRequests("wallpapers");
+    else
+    if(method == "channelsGetParticipants")
+    {
+        // Drops don't say which channel, everyone waiting may ask again.
+        const QSet<qint64> &channels = p->participantsRequests.toSet();
+        p->participantsRequests.clear();
+        Q_FOREACH(qint64 channelId, channels)
+            p->participantsStore->fetchFailed(channelId);
+    }
+}
+
+void TelegramQml::releaseDialogsLock()
+{
+    // Drops can come after an answer already released it.
+    getDialogsLock.tryLock();
     getDialogsLock.unlock();
 }
 
@@ -3363,6 +3927,8 @@ void TelegramQml::authSignUpError_slt(qint64 id, qint32 errorCode, QString error
 
 void TelegramQml::error_slt(qint64 id, qint32 errorCode, QString errorText, QString functionName)
 {
+    p->requestScheduler->serverError(id, errorCode, errorText);
+    p->responseCache->finishRequest(id);
 
     p->error = errorText;
     Q_EMIT errorChanged();
@@ -3381,7 +3947,10 @@ void TelegramQml::error_slt(qint64 id, qint32 errorCode, QString errorText, QStr
 
 void TelegramQml::accountGetWallPapers_slt(qint64 id, const QList<WallPaper> &wallPapers)
 {
-    Q_UNUSED(id)
+    p->responseCache->finishRequest(id);
+    if(!p->replayingCache)
+        p->responseCache->insert(TelegramResponseCache::WallPapersType, "wallpapers", TelegramResponseCache::toData(wallPapers));
+
 
     Q_FOREACH( const WallPaper & wp, wallPapers )
     {
@@ -3453,12 +4022,14 @@ void TelegramQml::photosUpdateProfilePhoto_slt(qint64 id, const UserProfilePhoto
 void TelegramQml::contactsBlock_slt(qint64 id, bool ok)
 {
     qint64 userId = p->blockRequests.take(id);
+    p->responseCache->remove("user:" + QString::number(userId));
     if (ok) blockUser(userId);
 }
 
 void TelegramQml::contactsUnblock_slt(qint64 id, bool ok)
 {
     qint64 userId = p->unblockRequests.take(id);
+    p->responseCache->remove("user:" + QString::number(userId));
     if (ok) unblockUser(userId);
 }
 
@@ -3479,19 +4050,48 @@ void TelegramQml::contactsGetContacts_slt(qint64 id, const ContactsContacts &res
 {
     Q_UNUSED(id)
 
-    if (result.classType() == ContactsContacts::ContactsContactsClassType::typeContactsContacts)
+    ContactsContacts contacts = result;
+    if (result.classType() == ContactsContacts::typeContactsContactsNotModified)
     {
-    Q_FOREACH( const User & user, result.users() )
+        // Nothing changed, the list only has to be restored if it is not loaded yet.
+        const QByteArray &data = p->responseCache->value("contacts");
+        if(!p->contacts.isEmpty() || data.isEmpty())
+            return;
+
+        contacts = TelegramResponseCache::fromData<ContactsContacts>(data);
+    }
+    else
+        p->responseCache->insert(TelegramResponseCache::ContactsType, "contacts", TelegramResponseCache::toData(result));
+
+    if (contacts.classType() == ContactsContacts::typeContactsContacts)
+    {
+    Q_FOREACH( const User & user, contacts.users() )
         insertUser(user, false, false);
     Q_EMIT usersChanged();
-    Q_FOREACH( const Contact & contact, result.contacts() )
+    Q_FOREACH( const Contact & contact, contacts.contacts() )
         insertContact(contact);
     }
 }
 
 void TelegramQml::usersGetFullUser_slt(qint64 id, const UserFull &result)
 {
-    Q_UNUSED(id)
+    p->responseCache->finishRequest(id);
+    if(p->replayingCache)
+    {
+        // A replay only fills in what is not loaded yet, the live state is newer.
+        // Block changes drop the entry, so its block state is still current.
+        if(!p->users.contains(result.user().id()))
+            insertUser(result.user(), false, false);
+        if(result.blocked())
+            Q_EMIT userBlocked(result.user().id());
+        else
+            Q_EMIT userUnblocked(result.user().id());
+        return;
+    }
+
+    p->responseCache->insert(TelegramResponseCache::UserFullType, "user:" + QString::number(result.user().id()),
+                             TelegramResponseCache::toData(result));
+
     insertUser(result.user());
     if (result.blocked()) {
         blockUser(result.user().id());
@@ -3534,6 +4134,7 @@ void TelegramQml::messagesSendMessage_slt(qint64 id, const UpdatesType &result)
         msg.setReplyToMsgId(msgObj->replyToMsgId());
         msg.setMedia(result.media());
 
+        p->syncManager->advancePts(result.pts(), result.ptsCount());
         insertToGarbeges(p->messages.value(old_msgId));
         insertMessage(msg);
         Q_EMIT messageSent(id, p->messages.value(unifiedId));
@@ -3565,7 +4166,7 @@ void TelegramQml::messagesForwardMessages_slt(qint64 id, const UpdatesType &upda
 void TelegramQml::messagesDeleteMessages_slt(qint64 id, const MessagesAffectedMessages &deletedMessages)
 {
     Q_UNUSED(id)
-    Q_UNUSED(deletedMessages)
+    p->syncManager->advancePts(deletedMessages.pts(), deletedMessages.ptsCount());
     sortMessages();
     Q_EMIT messagesChanged(false);
     timerUpdateDialogs(3000);
@@ -3651,10 +4252,11 @@ void TelegramQml::messagesGetDialogs_slt(qint64 id, const MessagesDialogs &resul
     Q_FOREACH( const Chat & c, result.chats() )
         insertChat(c, false, ChatFull(), false);
     Q_EMIT chatsChanged();
+    qint32 minDate = 0;
     Q_FOREACH( const Message & m, result.messages() )
     {
-        if(p->dialogSliceOffset == 0 || m.date() < p->dialogSliceOffset)
-            p->dialogSliceOffset = m.date();
+        if(minDate == 0 || m.date() < minDate)
+            minDate = m.date();
         insertMessage(m, false, false, false, false);
     }
     sortMessages();
@@ -3663,57 +4265,107 @@ void TelegramQml::messagesGetDialogs_slt(qint64 id, const MessagesDialogs &resul
     Q_FOREACH( const Dialog & d, result.dialogs() )
     {
         insertDialog(d, false, false, false);
-        qint64 dialogId = d.peer().channelId()? d.peer().channelId() : d.peer().chatId()? d.peer().chatId() : d.peer().userId();
-        //Remove this dialog from deleted dialogs, it is still valid
-        p->deletedDialogs.remove(dialogId);
+        if(p->dialogsEnumerate)
+            p->dialogsSeen.insert(d.peer().channelId()? d.peer().channelId() : d.peer().chatId()? d.peer().chatId() : d.peer().userId());
     }
+
+    const bool last = result.classType() != MessagesDialogs::typeMessagesDialogsSlice ||
+                      result.dialogs().count() < DIALOGS_SLICE_SIZE;
+    if(last && p->dialogsEnumerate)
+        removeUnseenDialogs();
+
     refreshUnreadCount();
     sortDialogs();
     Q_EMIT dialogsChanged(false);
     refreshSecretChats();
-    if(result.classType() == MessagesDialogs::typeMessagesDialogsSlice)
+
+    if(last)
+        p->dialogsComplete = true;
+    else
+    if(p->dialogSliceOffset == 0 || minDate < p->dialogSliceOffset)
+        p->dialogSliceOffset = minDate;
+
+    if(p->database)
     {
-        if (result.dialogs().count() == DIALOGS_SLICE_SIZE)
-        {
-            p->telegram->messagesGetDialogs(p->dialogSliceOffset, 0, InputPeer(), DIALOGS_SLICE_SIZE);
-            return;
-        }
+        p->database->setValue("dialogsCursor", QString::number(p->dialogSliceOffset));
+        p->database->setValue("dialogsComplete", p->dialogsComplete? "1" : "0");
     }
-    p->dialogSliceOffset = 0;
-    //The remaining dialogs in deletedDialogs can now be safely deleted also locally
-    if(p->database) {
-        Q_FOREACH(qint64 dId, p->deletedDialogs)
-        {
-            if(p->dialogs[dId]->encrypted())
-                continue;
+    releaseDialogsLock();
 
-            p->database->deleteDialog(dId);
-            insertToGarbeges(p->dialogs.value(dId));
-        }
+    if(p->dialogsWalkPending && !p->dialogsEnumerate)
+        loadAllDialogs();
+    else
+    if(p->dialogsComplete)
+    {
+        p->dialogsEnumerate = false;
+        p->dialogsSeen.clear();
+    }
+    else
+    if(p->dialogsEnumerate)
+        requestDialogs(p->dialogSliceOffset, TelegramRequestScheduler::BackgroundSync);
+    else
+    {
+        if(p->dialogs_idle_timer)
+            killTimer(p->dialogs_idle_timer);
+        p->dialogs_idle_timer = startTimer(DIALOGS_IDLE_INTERVAL);
     }
-    getDialogsLock.unlock();
-
 }
 
 void TelegramQml::messagesGetHistory_slt(qint64 id, const MessagesMessages &result)
 {
     Q_UNUSED(id)
+    p->ingestor->ingest(result.messages(), result.users(), result.chats());
+}
+
+void TelegramQml::applyIngestBatch(const TelegramIngestBatch &batch)
+{
+    if(!batch.users.isEmpty())
+    {
+        Q_FOREACH( const User & u, batch.users )
+            insertUser(u, false, false);
+        Q_EMIT usersChanged();
+    }
+    if(!batch.chats.isEmpty())
+    {
+        Q_FOREACH( const Chat & c, batch.chats )
+            insertChat(c, false, ChatFull(), false);
+        Q_EMIT chatsChanged();
+    }
+    if(batch.records.isEmpty())
+        return;
+
+    if(p->background)
+    {
+        Q_FOREACH( const TelegramIngestRecord & r, batch.records )
+            insertBackgroundMessage(r.message, true);
+        return;
+    }
+
+    QHash<qint64, int> sortedCounts;
+    Q_FOREACH( const TelegramIngestRecord & r, batch.records )
+    {
+        if(!sortedCounts.contains(r.dialogId))
+            sortedCounts[r.dialogId] = p->messages_list.value(r.dialogId).count();
+        insertMessageRecord(r, false, false, false, false);
+    }
+
+    // New ids were appended in display order, merging them is linear.
+    telegramp_qml_tmp = p;
+    QHashIterator<qint64, int> i(sortedCounts);
+    while(i.hasNext())
+    {
+        i.next();
+        QList<qint64> &list = p->messages_list[i.key()];
+        std::inplace_merge(list.begin(), list.begin() + i.value(), list.end(), checkMessageLessThan);
+    }
 
-    Q_FOREACH( const User & u, result.users() )
-        insertUser(u, false, false);
-    Q_EMIT usersChanged();
-    Q_FOREACH( const Chat & c, result.chats() )
-        insertChat(c, false, ChatFull(), false);
-    Q_EMIT chatsChanged();
-    Q_FOREACH( const Message & m, result.messages() )
-        insertMessage(m, false, false, false, false);
-    sortMessages();
     Q_EMIT messagesChanged(false);
 }
 
 void TelegramQml::messagesReadHistory_slt(qint64 id, const MessagesAffectedMessages &result)
 {
-    Q_UNUSED(result);
+    p->syncManager->advancePts(result.pts(), result.ptsCount());
+    readFlushFinished(id, true);
 
     qint64 peerId = p->read_history_requests.take(id);
     if (peerId)
@@ -3738,11 +4390,21 @@ void TelegramQml::messagesReadEncryptedHistory_slt(qint64 id, bool ok)
 {
     if(ok)
         messagesReadHistory_slt(id, MessagesAffectedMessages());
+    else
+        readFlushFinished(id, false);
+}
+
+void TelegramQml::channelsReadHistory_slt(qint64 id, bool ok)
+{
+    if(ok)
+        messagesReadHistory_slt(id, MessagesAffectedMessages());
+    else
+        readFlushFinished(id, false);
 }
 
 void TelegramQml::messagesDeleteHistory_slt(qint64 id, const MessagesAffectedHistory &result)
 {
-    Q_UNUSED(result)
+    p->syncManager->advancePts(result.pts(), result.ptsCount());
     qint64 peerId = p->delete_history_requests.take(id);
     if (peerId)
     {
@@ -3775,20 +4437,33 @@ void TelegramQml::messagesSearch_slt(qint64 id, const MessagesMessages &result)
 
 void TelegramQml::messagesGetFullChat_slt(qint64 id, const MessagesChatFull &result)
 {
-    Q_UNUSED(id)
+    p->responseCache->finishRequest(id);
+    const bool replayed = p->replayingCache;
+    if(!replayed)
+    {
+        const bool channel = result.fullChat().classType() == ChatFull::typeChannelFull;
+        p->responseCache->insert(TelegramResponseCache::ChatFullType, (channel? "channel:" : "chat:") + QString::number(result.fullChat().id()),
+                                 TelegramResponseCache::toData(result));
+    }
+
+    // A replay only fills in what is not loaded yet, the live state is newer.
     Q_FOREACH( const User & u, result.users() )
-        insertUser(u, false, false);
+        if(!replayed || !p->users.contains(u.id()))
+            insertUser(u, false, false);
     Q_EMIT usersChanged();
     Q_FOREACH( const Chat & c, result.chats() )
-        insertChat(c, false, result.fullChat(), false);
+        if(!replayed || !p->chats.contains(c.id()))
+            insertChat(c, false, result.fullChat(), false);
     Q_EMIT chatsChanged();
     ChatFullObject *fullChat = p->chatfulls.value(result.fullChat().id());
+    const bool known = fullChat;
     if( !fullChat )
     {
         fullChat = new ChatFullObject(result.fullChat(), this);
         p->chatfulls.insert(result.fullChat().id(), fullChat);
     }
     else
+    if(!replayed)
         *fullChat = result.fullChat();
 
     //If we are coming from deletion of a conversation, execute additional steps
@@ -3815,17 +4490,7 @@ void TelegramQml::messagesGetFullChat_slt(qint64 id, const MessagesChatFull &res
             ChatParticipant myself;
             Q_FOREACH(const ChannelParticipant & participant, result.participants())
             {
-                ChatParticipant tempParticipant;
-                tempParticipant.setDate(participant.date());
-                tempParticipant.setUserId(participant.userId());
-                tempParticipant.setInviterId(participant.inviterId());
-                if(participant.classType() == ChannelParticipant::typeChannelParticipantCreator)
-                    tempParticipant.setClassType(ChatParticipant::typeChatParticipantCreator);
-                else if (participant.classType() == ChannelParticipant::typeChannelParticipantEditor ||
-                         participant.classType() == ChannelParticipant::typeChannelParticipantModerator)
-                    tempParticipant.setClassType(ChatParticipant::typeChatParticipantAdmin);
-                else
-                    tempParticipant.setClassType(ChatParticipant::typeChatParticipant);
+                const ChatParticipant &tempParticipant = TelegramParticipantsStore::fromChannelParticipant(participant);
                 if(participant.classType() == ChannelParticipant::typeChannelParticipantSelf)
                     myself = tempParticipant;
                 else
@@ -3838,6 +4503,8 @@ void TelegramQml::messagesGetFullChat_slt(qint64 id, const MessagesChatFull &res
             cp.setSelfParticipant(myself);
             cp.setVersion(0);
             (*fullChat->participants()) = cp;
+            p->participantsStore->insertChannelParticipants(fullChat->id(), TelegramParticipantsStore::AdminsFilter, 0,
+                                                            result.participants(), result.count());
             Q_EMIT chatFullsChanged();
         };
         ChannelParticipantsFilter filter = ChannelParticipantsFilter(ChannelParticipantsFilter::typeChannelParticipantsAdmins);
@@ -3849,6 +4516,8 @@ void TelegramQml::messagesGetFullChat_slt(qint64 id, const MessagesChatFull &res
         p->telegram->channelsGetParticipants(channel, filter, 0, 100, callback);
 
     }
+    else if(result.fullChat().classType() == ChatFull::typeChatFull && (!replayed || !known))
+        p->participantsStore->setChatParticipants(peerId, result.fullChat().participants().participants());
 
     Q_EMIT chatFullsChanged();
 }
@@ -4099,10 +4768,22 @@ void TelegramQml::messagesGetStickers_slt(qint64 msgId, const MessagesStickers &
         insertDocument(doc);
 }
 
-void TelegramQml::messagesGetAllStickers_slt(qint64 msgId, const MessagesAllStickers &stickers)
+void TelegramQml::messagesGetAllStickers_slt(qint64 msgId, const MessagesAllStickers &result)
 {
     Q_UNUSED(msgId)
 
+    MessagesAllStickers stickers = result;
+    if(result.classType() == MessagesAllStickers::typeMessagesAllStickersNotModified)
+    {
+        const QByteArray &data = p->responseCache->value("allstickers");
+        if(!p->installedStickerSets.isEmpty() || data.isEmpty())
+            return;
+
+        stickers = TelegramResponseCache::fromData<MessagesAllStickers>(data);
+    }
+    else
+        p->responseCache->insert(TelegramResponseCache::AllStickersType, "allstickers", TelegramResponseCache::toData(result));
+
     p->installedStickerSets.clear();
 
     const QList<StickerSet> &sets = stickers.sets();
@@ -4114,7 +4795,9 @@ void TelegramQml::messagesGetAllStickers_slt(qint64 msgId, const MessagesAllStic
         InputStickerSet iSet(InputStickerSet::typeInputStickerSetID);
         iSet.setAccessHash(set.accessHash());
         iSet.setId(set.id());
-        p->telegram->messagesGetStickerSet(iSet);
+        p->requestScheduler->schedule("messagesGetStickerSet", TelegramRequestScheduler::BackgroundSync, [this, iSet]() -> qint64 {
+            return p->telegram->messagesGetStickerSet(iSet);
+        });
     }
 
 
@@ -4123,7 +4806,14 @@ void TelegramQml::messagesGetAllStickers_slt(qint64 msgId, const MessagesAllStic
 
 void TelegramQml::messagesGetStickerSet_slt(qint64 msgId, const MessagesStickerSet &stickerset)
 {
-    Q_UNUSED(msgId)
+    p->responseCache->finishRequest(msgId);
+    if(!p->replayingCache)
+    {
+        const QByteArray &data = TelegramResponseCache::toData(stickerset);
+        p->responseCache->insert(TelegramResponseCache::StickerSetType, "stickerset:" + QString::number(stickerset.set().id()), data);
+        p->responseCache->insert(TelegramResponseCache::StickerSetType, "stickerset:" + stickerset.set().shortName(), data);
+    }
+
     const QList<Document> &documents = stickerset.documents();
     Q_FOREACH(const Document &doc, documents)
     {
@@ -4163,7 +4853,7 @@ void TelegramQml::messagesInstallStickerSet_slt(qint64 msgId, bool ok)
             Q_EMIT installedStickersChanged();
         }
         else
-            p->telegram->messagesGetAllStickers(0);
+            messagesGetAllStickers();
     }
 
     Q_EMIT stickerInstalled(shortId, ok);
@@ -4193,9 +4883,6 @@ void TelegramQml::updatesTooLong_slt()
 
 void TelegramQml::updateShortMessage_slt(qint32 id, qint32 userId, const QString &message, qint32 pts, qint32 pts_count, qint32 date, MessageFwdHeader fwdFrom, qint32 reply_to_msg_id, bool unread, bool out)
 {
-    Q_UNUSED(pts)
-    Q_UNUSED(pts_count)
-
     Peer to_peer(Peer::typePeerUser);
     to_peer.setUserId(out?userId:p->telegram->ourId());
 
@@ -4208,44 +4895,14 @@ void TelegramQml::updateShortMessage_slt(qint32 id, qint32 userId, const QString
     msg.setToId(to_peer);
     msg.setFwdFrom(fwdFrom);
     msg.setReplyToMsgId(reply_to_msg_id);
+    if(takeShortMessage(msg, pts, pts_count))
+        return;
 
-    requestReadMessage(id);
-
-    auto unifiedId = QmlUtils::getUnifiedMessageKey(msg.id(), msg.toId().channelId());
-    if( p->dialogs.contains(userId) )
-    {
-        DialogObject *dlg_o = p->dialogs.value(userId);
-        dlg_o->setTopMessage(id);
-        dlg_o->setUnreadCount( dlg_o->unreadCount()+1 );
-    }
-    else
-    {
-        Peer fr_peer(Peer::typePeerUser);
-        fr_peer.setUserId(userId);
-
-        Dialog dlg;
-        dlg.setPeer(fr_peer);
-        dlg.setTopMessage(id);
-        dlg.setUnreadCount(1);
-
-        insertDialog(dlg);
-    }
-
-    timerUpdateDialogs(3000);
-
-    Q_EMIT incomingMessage( p->messages.value(unifiedId) );
-
-    if (!out) {
-        Q_EMIT messagesReceived(1);
-    }    
-
+    insertShortMessage(msg);
 }
 
 void TelegramQml::updateShortChatMessage_slt(qint32 id, qint32 fromId, qint32 chatId, const QString &message, qint32 pts, qint32 pts_count, qint32 date, MessageFwdHeader fwdFrom, qint32 reply_to_msg_id, bool unread, bool out)
 {
-    Q_UNUSED(pts)
-    Q_UNUSED(pts_count)
-
     Peer to_peer(Peer::typePeerChat);
     to_peer.setChatId(chatId);
 
@@ -4258,20 +4915,44 @@ void TelegramQml::updateShortChatMessage_slt(qint32 id, qint32 fromId, qint32 ch
     msg.setToId(to_peer);
     msg.setFwdFrom(fwdFrom);
     msg.setReplyToMsgId(reply_to_msg_id);
+    if(takeShortMessage(msg, pts, pts_count))
+        return;
+
+    insertShortMessage(msg);
+}
+
+void TelegramQml::updateShort_slt(const Update &update, qint32 date)
+{
+    Q_UNUSED(date)
+    p->syncManager->pushUpdate(update);
+}
+
+void TelegramQml::insertShortMessage(const Message &msg)
+{
+    const qint32 id = msg.id();
+    const bool out = FLAG_TO_OUT(msg.flags());
+
+    Peer dlg_peer(Peer::typePeerUser);
+    if(msg.toId().classType() == Peer::typePeerChat)
+        dlg_peer = msg.toId();
+    else
+        dlg_peer.setUserId(out? msg.toId().userId() : msg.fromId());
+
+    const qint64 dId = dlg_peer.chatId()? dlg_peer.chatId() : dlg_peer.userId();
 
     requestReadMessage(id);
 
     auto unifiedId = QmlUtils::getUnifiedMessageKey(msg.id(), msg.toId().channelId());
-    if( p->dialogs.contains(chatId) )
+    if( p->dialogs.contains(dId) )
     {
-        DialogObject *dlg_o = p->dialogs.value(chatId);
+        DialogObject *dlg_o = p->dialogs.value(dId);
         dlg_o->setTopMessage(id);
         dlg_o->setUnreadCount( dlg_o->unreadCount()+1 );
     }
     else
     {
         Dialog dlg;
-        dlg.setPeer(to_peer);
+        dlg.setPeer(dlg_peer);
         dlg.setTopMessage(id);
         dlg.setUnreadCount(1);
 
@@ -4285,70 +4966,57 @@ void TelegramQml::updateShortChatMessage_slt(qint32 id, qint32 fromId, qint32 ch
     if (!out) {
         Q_EMIT messagesReceived(1);
     }
-    //checkUpdateSyncState(pts, date);
 }
 
-void TelegramQml::updateShort_slt(const Update &update, qint32 date)
+bool TelegramQml::takeShortMessage(const Message &msg, qint32 pts, qint32 ptsCount)
 {
-    Q_UNUSED(date)
-    insertUpdate(update);
-}
+    Update update(Update::typeUpdateNewMessage);
+    update.setMessage(msg);
+    update.setPts(pts);
+    update.setPtsCount(ptsCount);
 
-void TelegramQml::checkUpdateSyncState(qint32 seq, qint32 date)
-{
-    auto currentState = p->syncManager->getState();
-    if(currentState.seq() + 1 == seq)
-    {
-        currentState.setSeq(seq);
-        currentState.setDate(date);
-        p->syncManager->setState(currentState);
-    }
-    else
+    const qint32 local = p->syncManager->getState().pts();
+    if(local == 0 || local + ptsCount == pts)
     {
-        p->syncManager->requestSync();
+        p->syncManager->advancePts(pts, ptsCount);
+        if(!p->background)
+            return false;
+
+        insertBackgroundUpdate(update);
+        return true;
     }
+
+    // Out of order or already applied, the sync manager holds or drops it.
+    // Held ones come back through insertUpdate() and are applied as short
+    // messages again.
+    if(local + ptsCount < pts)
+        p->heldShortMessages.insert(msg.id());
+    p->syncManager->pushUpdate(update);
+    return true;
 }
 
 
 void TelegramQml::updatesCombined_slt(const QList<Update> & updates, const QList<User> & users, const QList<Chat> & chats, qint32 date, qint32 seqStart, qint32 seq)
 {
-    Q_UNUSED(date)
-    Q_UNUSED(seq)
-    Q_UNUSED(seqStart)
+    insertUpdateEntities(users, chats);
     Q_FOREACH( const Update & u, updates )
-        insertUpdate(u);
-    Q_FOREACH( const User & u, users )
-        insertUser(u, false, false);
-    Q_EMIT usersChanged();
-    Q_FOREACH( const Chat & c, chats )
-        insertChat(c, false, ChatFull(), false);
-    Q_EMIT chatsChanged();
-
-    if(seq > 0)
-        checkUpdateSyncState(seq, date);
+        p->syncManager->pushUpdate(u);
 
+    p->syncManager->checkSeq(seqStart, seq, date);
 }
 
 void TelegramQml::updates_slt(const QList<Update> & updates, const QList<User> & users, const QList<Chat> & chats, qint32 date, qint32 seq)
 {
-    Q_UNUSED(date)
-    Q_UNUSED(seq)
+    insertUpdateEntities(users, chats);
     Q_FOREACH( const Update & u, updates )
-        insertUpdate(u);
-    Q_FOREACH( const User & u, users )
-        insertUser(u, false, false);
-    Q_EMIT usersChanged();
-    Q_FOREACH( const Chat & c, chats )
-        insertChat(c, false, ChatFull(), false);
-    Q_EMIT chatsChanged();
+        p->syncManager->pushUpdate(u);
 
-    if(seq > 0)
-        checkUpdateSyncState(seq, date);
+    p->syncManager->checkSeq(seq, seq, date);
 }
 
 void TelegramQml::updateSecretChatMessage_slt(const SecretChatMessage &secretChatMessage, qint32 qts)
 {
-    Q_UNUSED(qts)
+    p->syncManager->checkQts(qts);
     insertSecretChatMessage(secretChatMessage);
 }
 
@@ -4356,19 +5024,26 @@ void TelegramQml::updatesGetDifference_slt(qint64 id, const QList<Message> &mess
 {
     Q_UNUSED(id)
 
+    // Short messages still held for a gap came with the difference instead.
+    Q_FOREACH( const Message & m, messages )
+        p->heldShortMessages.remove(m.id());
+
     Q_FOREACH( const Update & u, otherUpdates )
         insertUpdate(u);
-    Q_FOREACH( const User & u, users )
-        insertUser(u, false, false);
-    Q_EMIT usersChanged();
-    Q_FOREACH( const Chat & c, chats )
-        insertChat(c, false, ChatFull(), false);
-    Q_EMIT chatsChanged();
-    Q_FOREACH( const Message & m, messages ) {
-        insertMessage(m, false, false, false, false);
-    sortMessages();
-    Q_EMIT messagesChanged(false);
-
+    insertUpdateEntities(users, chats);
+    if(p->background)
+    {
+        Q_FOREACH( const Message & m, messages )
+            insertBackgroundMessage(m, true);
+    }
+    else
+    if(!messages.isEmpty())
+    {
+        // Applied before the new state, live updates must not overtake the
+        // older copies of these messages.
+        TelegramIngestBatch batch;
+        TelegramIngestor::normalize(batch, messages);
+        applyIngestBatch(batch);
     }
     Q_FOREACH( const SecretChatMessage & m, secretChatMessages )
         insertSecretChatMessage(m, true);
@@ -4400,6 +5075,12 @@ void TelegramQml::updatesGetState_slt(qint64 msgId, const UpdatesState &result)
     {
         p->syncManager->requestSync();
     }
+
+    // Deletions made elsewhere while we were away are only found by a full walk.
+    if(p->background)
+        p->dialogsWalkPending = true;
+    else
+        loadAllDialogs();
 }
 
 void TelegramQml::updatesGetState_err(qint64 msgId, qint32 errorCode, const QString &errorText)
@@ -4421,18 +5102,19 @@ void TelegramQml::uploadGetFile_slt(qint64 id, const StorageFileType &type, qint
 
     Q_UNUSED(type)
     DownloadObject *download = obj->download();
-    download->setMtime(mtime);
-    download->setPartId(partId);
-    download->setDownloaded(downloaded);
-
-    if(total)
-        download->setTotal(total);
-
     if( !download->file()->isOpen() )
     {
         download->file()->open();
     }
     download->file()->write(bytes);
+    download->file()->flush();
+
+    download->setMtime(mtime);
+    download->setPartId(partId);
+    if(total)
+        download->setTotal(total);
+
+    download->setDownloaded(downloaded);
 
     if( downloaded >= download->total() && total == downloaded )
     {
@@ -4514,19 +5196,100 @@ void TelegramQml::uploadCancelFile_slt(qint64 fileId, bool cancelled)
 
 void TelegramQml::getDialogs()
 {
-    if (getDialogsLock.tryLock())
+    // Only the newest slice, older ones are fetched as the list asks for them.
+    requestDialogs(std::numeric_limits<qint32>::max(), TelegramRequestScheduler::VisibleData);
+}
+
+bool TelegramQml::requestDialogs(qint32 offsetDate, int priority)
+{
+    if(!p->telegram)
+        return false;
+    if(!getDialogsLock.tryLock())
     {
-        p->deletedDialogs.clear();
-        //Initialize a list of all existing dialogs to check if one or more were deleted in the later response from server
-        for (QHash<qint64, DialogObject*>::iterator it = p->dialogs.begin(); it != p->dialogs.end(); ++it)
-        {
-            if(it.value()->classType() == Dialog::typeDialog)
-                p->deletedDialogs.insert(it.key());
-        }
-        p->telegram->messagesGetDialogs(std::numeric_limits<qint32>::max(), 0, InputPeer(), DIALOGS_SLICE_SIZE);
-    }
-    else
         qWarning() << "getMessageDialogs still in progress, dont call too often!";
+        return false;
+    }
+
+    if(!offsetDate)
+        offsetDate = std::numeric_limits<qint32>::max();
+
+    p->requestScheduler->schedule("messagesGetDialogs", static_cast<TelegramRequestScheduler::Priority>(priority), [this, offsetDate]() -> qint64 {
+        return p->telegram->messagesGetDialogs(offsetDate, 0, InputPeer(), DIALOGS_SLICE_SIZE);
+    });
+    return true;
+}
+
+void TelegramQml::removeUnseenDialogs()
+{
+    // Only a full walk from the top proves a dialog is gone. Dialogs that got
+    // a message since the walk started may have moved to a walked slice.
+    QList<qint64> removed;
+    QHashIterator<qint64, DialogObject*> i(p->dialogs);
+    while(i.hasNext())
+    {
+        i.next();
+        DialogObject *dialog = i.value();
+        if(dialog->classType() != Dialog::typeDialog || dialog->encrypted() || p->dialogsSeen.contains(i.key()))
+            continue;
+
+        MessageObject *topMessage = p->messages.value(QmlUtils::getUnifiedMessageKey(dialog->topMessage(), dialog->peer()->channelId()));
+        if(!topMessage || topMessage->date() >= p->dialogsEnumerateStart)
+            continue;
+
+        removed << i.key();
+    }
+
+    Q_FOREACH(qint64 dId, removed)
+    {
+        if(p->database)
+            p->database->deleteDialog(dId);
+        insertToGarbeges(p->dialogs.value(dId));
+    }
+}
+
+bool TelegramQml::dialogsHasMore() const
+{
+    return !p->dialogsComplete;
+}
+
+void TelegramQml::fetchMoreDialogs()
+{
+    if(!p->telegram || !p->telegram->isConnected() || p->dialogsComplete)
+        return;
+    // Views ask again on every scroll, a slice in flight already answers them.
+    if(!getDialogsLock.tryLock())
+        return;
+    getDialogsLock.unlock();
+
+    requestDialogs(p->dialogSliceOffset, TelegramRequestScheduler::UserInitiated);
+}
+
+void TelegramQml::loadAllDialogs()
+{
+    if(!p->telegram || !p->telegram->isConnected() || p->dialogsEnumerate)
+        return;
+
+    // A slice in flight would continue the walk from its own offset, the
+    // walk starts once it is answered.
+    if(!requestDialogs(0, TelegramRequestScheduler::BackgroundSync))
+    {
+        p->dialogsWalkPending = true;
+        return;
+    }
+
+    // Walks from the top again, so deletions in already known ranges are found too.
+    p->dialogsWalkPending = false;
+    p->dialogsEnumerate = true;
+    p->dialogsEnumerateStart = QDateTime::currentDateTime().toTime_t();
+    p->dialogsSeen.clear();
+    p->dialogsComplete = false;
+    p->dialogSliceOffset = 0;
+}
+
+void TelegramQml::cancelDialogsWalk()
+{
+    p->dialogsEnumerate = false;
+    p->dialogsSeen.clear();
 }
 
 void TelegramQml::onConnectedChanged()
@@ -4541,6 +5304,16 @@ void TelegramQml::onConnectedChanged()
         updatesGetState();
         updatesGetChannelDifference();
     }
+
+    // Answers of the old session never come, the marks go out again.
+    if (!p->telegram->isConnected())
+    {
+        p->readFlushPeers.clear();
+        p->readFlushMarks.clear();
+    }
+
+    if (p->telegram->isConnected() && p->authLoggedIn && !p->pendingReads.isEmpty())
+        flushReadHistory();
 }
 
 void TelegramQml::fatalError_slt()
@@ -4574,7 +5347,10 @@ void TelegramQml::insertDialog(const Dialog &d, bool encrypted, bool fromDb, boo
     }
 
     if(d.notifySettings().muteUntil() > 0 && p->globalMute)
+    {
         p->userdata->addMute(did);
+        scheduleMuteExpiry(did, d.notifySettings().muteUntil());
+    }
 
     p->dialogs_list = p->dialogs.keys();
 
@@ -4600,16 +5376,19 @@ void TelegramQml::sortDialogs()
 
 void TelegramQml::insertMessage(const Message &newMsg, bool encrypted, bool fromDb, bool tempMsg, bool announceChanges)
 {
-
-    if (newMsg.id() == 0 || newMsg.message().isEmpty()
-            && newMsg.action().classType() == MessageAction::typeMessageActionEmpty
-            && newMsg.media().classType() == MessageMedia::typeMessageMediaEmpty) {
+    TelegramIngestBatch batch;
+    TelegramIngestor::normalize(batch, QList<Message>() << newMsg);
+    if(batch.records.isEmpty())
         return;
-    }
 
-    Message m = newMsg;
-    auto unifiedId = QmlUtils::getUnifiedMessageKey(m.id(), m.toId().channelId());
-    auto replyToUnifiedId = QmlUtils::getUnifiedMessageKey(m.replyToMsgId(), m.toId().channelId());
+    insertMessageRecord(batch.records.first(), encrypted, fromDb, tempMsg, announceChanges);
+}
+
+void TelegramQml::insertMessageRecord(const TelegramIngestRecord &record, bool encrypted, bool fromDb, bool tempMsg, bool announceChanges)
+{
+    Message m = record.message;
+    const qint64 unifiedId = record.unifiedId;
+    const qint64 replyToUnifiedId = record.replyToUnifiedId;
 
     if(m.replyToMsgId() && !p->messages.contains(replyToUnifiedId))
     {
@@ -4626,13 +5405,13 @@ void TelegramQml::insertMessage(const Message &newMsg, bool encrypted, bool from
         m.setReplyToMsgId(0);
     }
 
-
-    qint64 did = m.toId().channelId();
-    if ( !did )
-        did = m.toId().chatId();
-    if( !did )
-        did = FLAG_TO_OUT(m.flags())? m.toId().userId() : m.fromId();
+    const qint64 did = record.dialogId;
     auto dialog = p->dialogs.value(did);
+
+    // Title, photo and member changes arrive as service messages.
+    if(!fromDb && m.action().classType() != MessageAction::typeMessageActionEmpty)
+        p->responseCache->remove((m.toId().channelId()? "channel:" : "chat:") + QString::number(did));
+
     MessageObject *currentMsg = p->messages.value(unifiedId);
     if( !currentMsg )
     {
@@ -4722,17 +5501,6 @@ void TelegramQml::insertUser(const User &newUser, bool fromDb, bool announceChan
     {
         userObj = new UserObject(newUser, this);
         p->users.insert(newUser.id(), userObj);
-
-        QStringList userNameKeys;
-        if(!newUser.username().isEmpty())
-        {
-            userNameKeys << stringToIndex(newUser.firstName());
-            userNameKeys << stringToIndex(newUser.lastName());
-            userNameKeys << stringToIndex(newUser.username());
-        }
-
-        Q_FOREACH(const QString &key, userNameKeys)
-            p->userNameIndexes.insertMulti(key.toLower(), newUser.id());
     }
     else
     if(fromDb)
@@ -4740,6 +5508,11 @@ void TelegramQml::insertUser(const User &newUser, bool fromDb, bool announceChan
     else
         *userObj = newUser;
 
+    p->userNameIndex.insert(newUser.id(), QStringList() << newUser.firstName() << newUser.lastName() << newUser.username());
+    p->userSortKeys.setText(newUser.id(), newUser.firstName() + " " + newUser.lastName());
+
+    if(!fromDb)
+        scheduleStatusExpiry(newUser.id(), newUser.status());
     if(!fromDb && p->database)
         p->database->insertUser(newUser);
 
@@ -4771,6 +5544,8 @@ void TelegramQml::insertChat(const Chat &c, bool fromDb, const ChatFull &chatFul
         if(obj->participantsCount() == 0)
             obj->setParticipantsCount(participantsCount);
     }
+
+    p->chatNameIndex.insert(tempChat.id(), QStringList() << tempChat.title());
     //Check for additional channel properties
     if (tempChat.classType() == Chat::typeChannel && participantsCount == 0)
     {
@@ -4800,14 +5575,20 @@ void TelegramQml::insertChat(const Chat &c, bool fromDb, const ChatFull &chatFul
             }
         };
         p->telegram->channelsGetParticipant(channel, user, callback1);
-        TelegramCore::Callback<MessagesChatFull> callback2 = [this, obj](TG_CHANNELS_GET_FULL_CHANNEL_CALLBACK) {
+        QPointer<ChatObject> objPtr = obj;
+        TelegramCore::Callback<MessagesChatFull> callback2 = [this, objPtr](TG_CHANNELS_GET_FULL_CHANNEL_CALLBACK) {
             if(!error.null)
             {
+                onServerError(msgId, error.errorCode, error.errorText);
                 return;
             }
-            obj->setParticipantsCount(result.fullChat().participantsCount());
+            p->requestScheduler->finished(msgId);
+            if(objPtr)
+                objPtr->setParticipantsCount(result.fullChat().participantsCount());
         };
-        p->telegram->channelsGetFullChannel(channel, callback2);
+        p->requestScheduler->schedule("channelsGetFullChannel", TelegramRequestScheduler::BackgroundSync, [this, channel, callback2]() -> qint64 {
+            return p->telegram->channelsGetFullChannel(channel, callback2);
+        });
     }
     if(!fromDb)
     {
@@ -4873,14 +5654,163 @@ void TelegramQml::insertUpdates(const UpdatesType &updates)
     Q_FOREACH( const Chat & c, updates.chats() )
         insertChat(c);
     Q_FOREACH( const Update & u, updates.updates() )
-        insertUpdate(u);
+        p->syncManager->pushUpdate(u);
 
-    insertUpdate(updates.update());
+    p->syncManager->pushUpdate(updates.update());
     timerUpdateDialogs(3000);
 }
 
+void TelegramQml::insertUpdateEntities(const QList<User> &users, const QList<Chat> &chats)
+{
+    if(p->background)
+    {
+        // Kept until the views come back, only the last state of each counts.
+        Q_FOREACH( const User & u, users )
+        {
+            p->backgroundUsers[u.id()] = u;
+            p->database->insertUser(u);
+        }
+        Q_FOREACH( const Chat & c, chats )
+        {
+            p->backgroundChats[c.id()] = c;
+            p->database->insertChat(c);
+        }
+        return;
+    }
+
+    Q_FOREACH( const User & u, users )
+        insertUser(u, false, false);
+    Q_EMIT usersChanged();
+    Q_FOREACH( const Chat & c, chats )
+        insertChat(c, false, ChatFull(), false);
+    Q_EMIT chatsChanged();
+}
+
+void TelegramQml::insertBackgroundUpdate(const Update &update)
+{
+    switch( static_cast<int>(update.classType()) )
+    {
+    case Update::typeUpdateNewChannelMessage:
+    case Update::typeUpdateNewMessage:
+        insertBackgroundMessage(update.message(), true);
+        break;
+
+    case Update::typeUpdateEditMessage:
+    case Update::typeUpdateEditChannelMessage:
+        insertBackgroundMessage(update.message(), false);
+        break;
+
+    case Update::typeUpdateDeleteChannelMessages:
+    case Update::typeUpdateDeleteMessages:
+        Q_FOREACH(qint32 msgId, update.messages())
+            p->database->deleteMessage(QmlUtils::getUnifiedMessageKey(msgId, update.channelId()));
+        p->backgroundUpdates << update;
+        break;
+
+    case Update::typeUpdateUserStatus:
+    case Update::typeUpdateUserTyping:
+    case Update::typeUpdateChatUserTyping:
+    case Update::typeUpdateEncryptedChatTyping:
+    case Update::typeUpdateChannelMessageViews:
+        // Stale by the time anybody looks.
+        break;
+
+    default:
+        p->backgroundUpdates << update;
+        break;
+    }
+}
+
+void TelegramQml::insertBackgroundMessage(const Message &message, bool isNew)
+{
+    const bool out = FLAG_TO_OUT(message.flags());
+    qint64 dId = message.toId().chatId();
+    if(!dId)
+        dId = message.toId().channelId();
+    if(!dId)
+        dId = out? message.toId().userId() : message.fromId();
+
+    p->database->insertMessage(message, false);
+    p->backgroundDialogs.insert(dId);
+    p->backgroundDialogsRefresh = true;
+    if(!isNew || out)
+        return;
+
+    p->backgroundUnread[dId]++;
+    if( !p->userdata || !(p->userdata->notify(dId) & UserData::DisableBadges) )
+    {
+        p->unreadCount++;
+        Q_EMIT unreadCountChanged();
+    }
+    Q_EMIT messagesReceived(1);
+}
+
+void TelegramQml::flushBackground()
+{
+    const QList<User> users = p->backgroundUsers.values();
+    const QList<Chat> chats = p->backgroundChats.values();
+    p->backgroundUsers.clear();
+    p->backgroundChats.clear();
+    if(!users.isEmpty() || !chats.isEmpty())
+        insertUpdateEntities(users, chats);
+
+    const QList<Update> updates = p->backgroundUpdates;
+    p->backgroundUpdates.clear();
+    Q_FOREACH( const Update & u, updates )
+        insertUpdate(u);
+
+    QHashIterator<qint64, int> i(p->backgroundUnread);
+    while(i.hasNext())
+    {
+        i.next();
+        DialogObject *dlg = p->dialogs.value(i.key());
+        if(dlg)
+            dlg->setUnreadCount(dlg->unreadCount() + i.value());
+    }
+    p->backgroundUnread.clear();
+
+    // One database read per changed dialog instead of one object per update.
+    Q_FOREACH(qint64 dId, p->backgroundDialogs)
+    {
+        Peer peer(getPeerType(dId));
+        if(peer.classType() == Peer::typePeerChannel)
+            peer.setChannelId(dId);
+        else
+        if(peer.classType() == Peer::typePeerChat)
+            peer.setChatId(dId);
+        else
+            peer.setUserId(dId);
+
+        p->database->readMessages(peer, 0, BACKGROUND_RELOAD_COUNT);
+    }
+    p->backgroundDialogs.clear();
+
+    refreshUnreadCount();
+    if(p->backgroundDialogsRefresh)
+    {
+        p->backgroundDialogsRefresh = false;
+        timerUpdateDialogs(100);
+    }
+
+    p->channelPoller->start(CHANNEL_UPDATE_TIME);
+    Q_EMIT dialogsChanged(false);
+}
+
 void TelegramQml::insertUpdate(const Update &update)
 {
+    const bool shortMessage = update.classType() == Update::typeUpdateNewMessage &&
+                              p->heldShortMessages.remove(update.message().id());
+    if(p->background)
+    {
+        insertBackgroundUpdate(update);
+        return;
+    }
+    if(shortMessage)
+    {
+        insertShortMessage(update.message());
+        return;
+    }
+
     UserObject *user = p->users.value(update.userId());
     ChatObject *chat = p->chats.value(update.chatId() ? update.chatId() : update.channelId());
 
@@ -4889,12 +5819,10 @@ void TelegramQml::insertUpdate(const Update &update)
     case Update::typeUpdateUserStatus:
         if( user )
         {
-            bool become_online = (user->status()->classType() == UserStatus::typeUserStatusOffline &&
-                    update.status().classType() == UserStatus::typeUserStatusOnline);
-
-            *(user->status()) = update.status();
-            if(become_online)
-                Q_EMIT userBecomeOnline(user->id());
+            // Only the last status of a user within a frame is applied.
+            p->pendingStatuses[user->id()] = update.status();
+            if( !p->presence_timer )
+                p->presence_timer = startTimer(PRESENCE_FLUSH_INTERVAL);
         }
         break;
 
@@ -4913,8 +5841,10 @@ void TelegramQml::insertUpdate(const Update &update)
 
             if (isMuted) {
                 p->userdata->addMute(peerId);
+                scheduleMuteExpiry(peerId, muteUntil);
             } else {
                 p->userdata->removeMute(peerId);
+                p->timerWheel->cancel(TelegramTimerWheel::MuteTimer, peerId, 0);
             }
         }
     }
@@ -4954,33 +5884,10 @@ void TelegramQml::insertUpdate(const Update &update)
 
     case Update::typeUpdateChatUserTyping:
     {
-        if(!chat)
-            return;
-        DialogObject *dlg = p->dialogs.value(chat->id());
-        if( !dlg )
+        if( !chat || !user )
             return;
-        if( !user )
-            return;
-
-        const QString & id_str = QString::number(user->id());
-        const QPair<qint64,qint64> & timer_pair = QPair<qint64,qint64>(chat->id(), user->id());
-        QStringList tusers = dlg->typingUsers();
 
-        if( tusers.contains(id_str) )
-        {
-            const int timer_id = p->typing_timers.key(timer_pair);
-            killTimer(timer_id);
-            p->typing_timers.remove(timer_id);
-        }
-        else
-        {
-            tusers << id_str;
-            dlg->setTypingUsers( tusers );
-            Q_EMIT userStartTyping(user->id(), chat->id());
-        }
-
-        int timer_id = startTimer(6000);
-        p->typing_timers.insert(timer_id, timer_pair);
+        startTyping(chat->id(), user->id());
     }
         break;
 
@@ -4989,11 +5896,17 @@ void TelegramQml::insertUpdate(const Update &update)
         {
             user->setFirstName(update.firstName());
             user->setLastName(update.lastName());
+            p->userNameIndex.insert(user->id(), QStringList() << user->firstName() << user->lastName() << user->username());
+            p->userSortKeys.setText(user->id(), user->firstName() + " " + user->lastName());
+            if(p->contacts.contains(user->id()))
+                Q_EMIT contactsChanged();
         }
+        p->responseCache->remove("user:" + QString::number(update.userId()));
         timerUpdateDialogs();
         break;
 
     case Update::typeUpdateUserBlocked:
+        p->responseCache->remove("user:" + QString::number(update.userId()));
         if (update.blocked()) {
             blockUser(update.userId());
         } else {
@@ -5015,11 +5928,13 @@ void TelegramQml::insertUpdate(const Update &update)
         break;
 
     case Update::typeUpdateChatParticipantDelete:
+        p->responseCache->remove("chat:" + QString::number(update.chatId()));
         if(chat)
             chat->setParticipantsCount( chat->participantsCount()-1 );
         break;
 
     case Update::typeUpdateChatParticipantAdd:
+        p->responseCache->remove("chat:" + QString::number(update.chatId()));
         if(chat)
             chat->setParticipantsCount( chat->participantsCount()+1 );
         break;
@@ -5045,63 +5960,21 @@ void TelegramQml::insertUpdate(const Update &update)
     {
         if(!user)
             return;
-        DialogObject *dlg = p->dialogs.value(user->id());
-        if( !dlg )
-            return;
-
-        const QString & id_str = QString::number(user->id());
-        const QPair<qint64,qint64> & timer_pair = QPair<qint64,qint64>(user->id(), user->id());
-        QStringList tusers = dlg->typingUsers();
-        if( tusers.contains(id_str) )
-        {
-            const int timer_id = p->typing_timers.key(timer_pair);
-            killTimer(timer_id);
-            p->typing_timers.remove(timer_id);
-        }
-        else
-        {
-            tusers << id_str;
-            dlg->setTypingUsers( tusers );
-            Q_EMIT userStartTyping(user->id(), user->id());
-        }
-
-        int timer_id = startTimer(6000);
-        p->typing_timers.insert(timer_id, timer_pair);
+        startTyping(user->id(), user->id());
     }
         break;
 
     case Update::typeUpdateEncryptedChatTyping:
     {
-        DialogObject *dlg = p->dialogs.value(update.chat().id());
-        if( !dlg )
-            return;
-
         qint64 userId = update.chat().adminId()==me()? update.chat().participantId() : update.chat().adminId();
-
-        const QString & id_str = QString::number(userId);
-        const QPair<qint64,qint64> & timer_pair = QPair<qint64,qint64>(userId, userId);
-        QStringList tusers = dlg->typingUsers();
-        if( tusers.contains(id_str) )
-        {
-            const int timer_id = p->typing_timers.key(timer_pair);
-            killTimer(timer_id);
-            p->typing_timers.remove(timer_id);
-        }
-        else
-        {
-            tusers << id_str;
-            dlg->setTypingUsers( tusers );
-            Q_EMIT userStartTyping(userId, userId);
-        }
-
-        int timer_id = startTimer(6000);
-        p->typing_timers.insert(timer_id, timer_pair);
+        startTyping(update.chat().id(), userId);
     }
         break;
 
     case Update::typeUpdateUserPhoto:
         if( user )
             *(user->photo()) = update.photo();
+        p->responseCache->remove("user:" + QString::number(update.userId()));
         timerUpdateDialogs();
         break;
 
@@ -5125,6 +5998,7 @@ void TelegramQml::insertUpdate(const Update &update)
         break;
 
     case Update::typeUpdateChatParticipants:
+        p->responseCache->remove("chat:" + QString::number(update.participants().chatId()));
         timerUpdateDialogs();
         break;
 
@@ -5196,17 +6070,29 @@ void TelegramQml::updateUnreadCount(qint32 dId, const qint32 maxId, const Peer &
 
 void TelegramQml::setReadFlag(qint32 dId, const qint32 maxId, const Peer &peer)
 {
+    const qint32 lastMaxId = p->outboxReadMaxId.value(dId);
+    if(maxId <= lastMaxId)
+        return;
+
+    p->outboxReadMaxId[dId] = maxId;
+
+    // Newest first, only the messages between the old and the new mark change.
     const QList<qint64> &msgs = p->messages_list.value(dId);
     auto unifiedId = QmlUtils::getUnifiedMessageKey(maxId, peer.channelId());
+    auto lastUnifiedId = lastMaxId? QmlUtils::getUnifiedMessageKey(lastMaxId, peer.channelId()) : 0;
     Q_FOREACH(qint64 msg, msgs)
-        if(msg <= unifiedId)
+    {
+        if(msg > unifiedId)
+            continue;
+        if(msg <= lastUnifiedId)
+            break;
+
+        MessageObject *obj = p->messages.value(msg);
+        if(obj && obj->out())
         {
-            MessageObject *obj = p->messages.value(msg);
-            if(obj && obj->out())
-            {
-                obj->setUnread(false);
-            }
+            obj->setUnread(false);
         }
+    }
     p->database->markMessagesAsRead(maxId, peer);
 }
 
@@ -5520,10 +6406,19 @@ void TelegramQml::timerEvent(QTimerEvent *e)
         p->upd_dialogs_timer = 0;
     }
     else
+    if( e->timerId() == p->dialogs_idle_timer )
+    {
+        killTimer(p->dialogs_idle_timer);
+        p->dialogs_idle_timer = 0;
+
+        if( p->telegram && p->telegram->isConnected() && !p->dialogsComplete && !p->background )
+            requestDialogs(p->dialogSliceOffset, TelegramRequestScheduler::BackgroundSync);
+    }
+    else
     if ( e->timerId() == p->update_contacts_timer)
     {
         if ( p->telegram )
-            p->telegram->contactsGetContacts();
+            contactsGetContacts();
 
         killTimer(p->update_contacts_timer);
         p->update_contacts_timer = 0;
@@ -5538,20 +6433,116 @@ void TelegramQml::timerEvent(QTimerEvent *e)
         p->garbage_checker_timer = 0;
     }
     else
-    if( p->typing_timers.contains(e->timerId()) )
+    if( e->timerId() == p->read_flush_timer )
+    {
+        flushReadHistory();
+    }
+    else
+    if( e->timerId() == p->presence_timer )
+    {
+        killTimer(p->presence_timer);
+        p->presence_timer = 0;
+        flushPresence();
+    }
+}
+
+void TelegramQml::startTyping(qint64 dId, qint64 userId)
+{
+    DialogObject *dlg = p->dialogs.value(dId);
+    if( !dlg )
+        return;
+
+    const QString & id_str = QString::number(userId);
+    QStringList tusers = dlg->typingUsers();
+    if( !tusers.contains(id_str) )
+    {
+        tusers << id_str;
+        dlg->setTypingUsers( tusers );
+        Q_EMIT userStartTyping(userId, dId);
+    }
+
+    p->timerWheel->schedule(TelegramTimerWheel::TypingTimer, dId, userId, TYPING_TIMEOUT);
+}
+
+void TelegramQml::flushPresence()
+{
+    QHashIterator<qint64, UserStatus> i(p->pendingStatuses);
+    while(i.hasNext())
     {
-        killTimer(e->timerId());
+        i.next();
+        UserObject *user = p->users.value(i.key());
+        if( !user )
+            continue;
+
+        const UserStatus &status = i.value();
+        UserStatusObject *obj = user->status();
+        bool become_online = (obj->classType() == UserStatus::typeUserStatusOffline &&
+                status.classType() == UserStatus::typeUserStatusOnline);
+
+        // The setters notify about actual changes only.
+        obj->setWasOnline(status.wasOnline());
+        obj->setExpires(status.expires());
+        obj->setClassType(status.classType());
+        scheduleStatusExpiry(user->id(), status);
+
+        if(become_online)
+            Q_EMIT userBecomeOnline(user->id());
+    }
+
+    p->pendingStatuses.clear();
+}
 
-        const QPair<qint64,qint64> & pair = p->typing_timers.take(e->timerId());
-        DialogObject *dlg = p->dialogs.value(pair.first);
+void TelegramQml::scheduleStatusExpiry(qint64 userId, const UserStatus &status)
+{
+    const qint64 now = QDateTime::currentDateTime().toTime_t();
+    if(status.classType() == UserStatus::typeUserStatusOnline && status.expires() > now)
+        p->timerWheel->schedule(TelegramTimerWheel::StatusTimer, userId, 0, (status.expires() - now)*1000);
+    else
+        p->timerWheel->cancel(TelegramTimerWheel::StatusTimer, userId, 0);
+}
+
+void TelegramQml::scheduleMuteExpiry(qint64 peerId, qint32 muteUntil)
+{
+    const qint64 now = QDateTime::currentDateTime().toTime_t();
+    if(muteUntil > now && muteUntil - now < MUTE_EXPIRY_HORIZON)
+        p->timerWheel->schedule(TelegramTimerWheel::MuteTimer, peerId, 0, (muteUntil - now)*1000);
+    else
+        p->timerWheel->cancel(TelegramTimerWheel::MuteTimer, peerId, 0);
+}
+
+void TelegramQml::timerWheelExpired(int type, qint64 first, qint64 second)
+{
+    switch(type)
+    {
+    case TelegramTimerWheel::TypingTimer:
+    {
+        DialogObject *dlg = p->dialogs.value(first);
         if( !dlg )
             return;
 
         QStringList typings = dlg->typingUsers();
-        typings.removeAll(QString::number(pair.second));
+        typings.removeAll(QString::number(second));
 
         dlg->setTypingUsers(typings);
     }
+        break;
+
+    case TelegramTimerWheel::StatusTimer:
+    {
+        UserObject *user = p->users.value(first);
+        if( !user || user->status()->classType() != UserStatus::typeUserStatusOnline )
+            return;
+
+        user->status()->setWasOnline(user->status()->expires());
+        user->status()->setClassType(UserStatus::typeUserStatusOffline);
+    }
+        break;
+
+    case TelegramTimerWheel::MuteTimer:
+        if(p->userdata && p->globalMute)
+            p->userdata->removeMute(first);
+        break;
+    }
 }
 
 void TelegramQml::startGarbageChecker()
@@ -5676,6 +6667,35 @@ void TelegramQml::dbMediaKeysFounded(qint64 mediaId, const QByteArray &key, cons
     msg->media()->setEncryptIv(iv);
 }
 
+void TelegramQml::dbValueFounded(const QString &key, const QString &value)
+{
+    if(key == "dialogsCursor")
+    {
+        if(!p->dialogSliceOffset)
+            p->dialogSliceOffset = value.toInt();
+    }
+    else
+    if(key == "dialogsComplete")
+        p->dialogsComplete = p->dialogsComplete || value == "1";
+    else
+    if(key == "pendingReads")
+    {
+        Q_FOREACH(const QString &item, value.split(",", QString::SkipEmptyParts))
+        {
+            const QStringList &parts = item.split(":");
+            if(parts.count() != 3)
+                continue;
+
+            QPair<qint32,qint32> &pending = p->pendingReads[parts.at(0).toLongLong()];
+            pending.first = qMax(pending.first, parts.at(1).toInt());
+            pending.second = qMax(pending.second, parts.at(2).toInt());
+        }
+
+        if(!p->pendingReads.isEmpty() && p->telegram && p->telegram->isConnected() && p->authLoggedIn)
+            flushReadHistory();
+    }
+}
+
 void TelegramQml::refreshUnreadCount()
 {
     int unreadCount = 0;
@@ -5846,11 +6866,6 @@ InputPeer::InputPeerClassType TelegramQml::getInputPeerType(qint64 pid)
     return res;
 }
 
-QStringList TelegramQml::stringToIndex(const QString &str)
-{
-    return QStringList() << str.toLower();
-}
-
 void TelegramQml::objectDestroyed(QObject *obj)
 {
     if(qobject_cast<UploadObject*>(obj))
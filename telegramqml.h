@@ -26,11 +26,15 @@
 #include <QObject>
 #include <QStringList>
 #include <QUrl>
+#include <QVariantMap>
 #include <QMutex>
+#include <QSet>
 
 #include <telegram/types/types.h>
 
 #include "telegramthumbnailer.h"
+#include "telegrammediapreparer.h"
+#include "telegramingestor.h"
 #include "telegramqml_global.h"
 #include "databaseabstractencryptor.h"
 
@@ -40,6 +44,9 @@ class DecryptedMessage;
 class PhotoSize;
 class TelegramSearchModel;
 class Database;
+class TelegramHistoryBackfill;
+class TelegramSortKeys;
+class TelegramParticipantsStore;
 class UserData;
 class TelegramMessagesModel;
 class DownloadObject;
@@ -92,6 +99,7 @@ class TELEGRAMQMLSHARED_EXPORT TelegramQml : public QObject
     Q_PROPERTY(int  autoRewakeInterval  READ autoRewakeInterval  WRITE setAutoRewakeInterval  NOTIFY autoRewakeIntervalChanged)
 
     Q_PROPERTY(bool  online               READ online WRITE setOnline NOTIFY onlineChanged)
+    Q_PROPERTY(bool  background           READ background WRITE setBackground NOTIFY backgroundChanged)
     Q_PROPERTY(int   unreadCount          READ unreadCount            NOTIFY unreadCountChanged)
     Q_PROPERTY(qreal totalUploadedPercent READ totalUploadedPercent   NOTIFY totalUploadedPercentChanged)
 
@@ -100,6 +108,7 @@ class TELEGRAMQMLSHARED_EXPORT TelegramQml : public QObject
     Q_PROPERTY(Telegram*   telegram    READ telegram    NOTIFY telegramChanged)
     Q_PROPERTY(UserData*   userData    READ userData    NOTIFY userDataChanged)
     Q_PROPERTY(Database*   database    READ database    NOTIFY databaseChanged)
+    Q_PROPERTY(TelegramHistoryBackfill* historyBackfill READ historyBackfill NOTIFY fakeSignal)
     Q_PROPERTY(qint64      me          READ me          NOTIFY meChanged)
     Q_PROPERTY(UserObject* myUser      READ myUser      NOTIFY myUserChanged)
     Q_PROPERTY(QString     homePath    READ homePath    NOTIFY fakeSignal)
@@ -196,6 +205,10 @@ public:
 
     UserData *userData() const;
     Database *database() const;
+    TelegramHistoryBackfill *historyBackfill() const;
+    TelegramThumbnailer *thumbnailer() const;
+    TelegramSortKeys *userSortKeys() const;
+    TelegramParticipantsStore *participantsStore() const;
     Telegram *telegram() const;
     qint64 me() const;
     UserObject *myUser() const;
@@ -203,6 +216,9 @@ public:
     bool online() const;
     void setOnline( bool stt );
 
+    bool background() const;
+    void setBackground( bool stt );
+
     void setInvisible( bool stt );
     bool invisible() const;
 
@@ -289,9 +305,15 @@ public:
     Q_INVOKABLE QString fileLocation( FileLocationObject *location );
     Q_INVOKABLE QString videoThumbLocation( const QString &path, TelegramThumbnailer_Callback callback );
     Q_INVOKABLE QString audioThumbLocation( const QString &path );
+    Q_INVOKABLE QString imageThumbLocation( const QString &path, TelegramThumbnailer_Callback callback );
+    // Call when a thumbnail location fails to load, it is created again on
+    // the next request.
+    Q_INVOKABLE void forgetThumbnail( const QString &path );
+    Q_INVOKABLE QUrl streamFile(FileLocationObject *location, qint64 type = InputFileLocation::typeInputFileLocation, qint32 fileSize = 0);
 
     QList<qint64> dialogs() const;
     QList<qint64> messages(qint64 did, qint64 maxId = 0) const;
+    QList<qint64> messagesWindow(qint64 did, qint64 anchor, int before, int after, qint64 maxId = 0) const;
     QList<qint64> wallpapers() const;
     QList<qint64> uploads() const;
     QList<qint64> contacts() const;
@@ -306,8 +328,14 @@ public:
     qint64 generateRandomId() const;
 
     QList<qint64> userIndex(const QString &keyword);
+    QList<qint64> chatIndex(const QString &keyword);
 
     Q_INVOKABLE void updatesGetDifference();
+    Q_INVOKABLE QVariantMap requestMetrics() const;
+
+    Q_INVOKABLE bool dialogsHasMore() const;
+    Q_INVOKABLE void fetchMoreDialogs();
+    Q_INVOKABLE void loadAllDialogs();
 
     QMutex getDialogsLock;
     QMutex getMessagesLock;
@@ -325,6 +353,9 @@ public Q_SLOTS:
     void accountRegisterDevice(const QString &token, const QString &appVersion = QString::null);
     void accountUnregisterDevice(const QString &token);
     void accountUpdateProfile(const QString &firstName, const QString &lastName);
+    void accountGetWallPapers();
+    void contactsGetContacts();
+    void messagesGetAllStickers();
     void usersGetFullUser(qint64 userId);
     void accountCheckUsername(const QString &username);
     void accountUpdateUsername(const QString &username);
@@ -350,7 +381,9 @@ public Q_SLOTS:
 
     void messagesDeleteHistory(qint64 peerId, bool deleteChat = false, bool userRemoved = false);
     void messagesSetTyping(qint64 peerId, bool stt);
-    qint64 messagesReadHistory(qint64 peerId, qint32 maxDate = 0);
+    qint64 messagesReadHistory(qint64 peerId, qint32 maxDate = 0, qint32 maxId = 0);
+    void readHistory(qint64 peerId, qint32 maxId, qint32 maxDate = 0);
+    void flushReadHistory(qint64 peerId = 0);
 
 
     void messagesCreateEncryptedChat(qint64 userId);
@@ -360,7 +393,8 @@ public Q_SLOTS:
     void messagesGetFullChat(qint32 chatId);
 
     void channelsGetFullChannel(qint32 peerId);
-    qint64 channelsReadHistory(qint32 channelId, qint64 accessHash);
+    void channelsGetParticipants(qint32 channelId, int filter, int offset, int limit);
+    qint64 channelsReadHistory(qint32 channelId, qint64 accessHash, qint32 maxId = 0);
     void channelsDeleteMessages(qint32 channelId, qint64 accessHash, QList<qint64> msgIds);
     void installStickerSet(const QString &shortName);
     void uninstallStickerSet(const QString &shortName);
@@ -370,6 +404,8 @@ public Q_SLOTS:
     void search(const QString &keyword);
     void searchContact(const QString &keyword);
 
+    // Returns a prepare handle, not a file id. Progress is reported through
+    // fileSendStageChanged() with the same handle.
     qint64 sendFile(qint64 dialogId, const QString & file , bool forceDocument = false, bool forceAudio = false);
     void getFile(FileLocationObject *location, qint64 type = InputFileLocation::typeInputFileLocation , qint32 fileSize = 0);
     void getFileJustCheck(FileLocationObject *location);
@@ -407,6 +443,7 @@ Q_SIGNALS:
     void userDataChanged();
     void databaseChanged();
     void onlineChanged();
+    void backgroundChanged();
     void downloadPathChanged();
     void tempPathChanged();
     void dialogsChanged(bool cachedData);
@@ -478,6 +515,8 @@ Q_SIGNALS:
     void contactsFounded(const QList<qint32> &contacts);
 
     void messageSent(qint32 reqId, MessageObject *msg);
+    void fileSendStageChanged(qint64 handle, int stage);
+    void fileSendStarted(qint64 handle, qint64 fileId);
     void messagesSent(qint32 count);
     void messagesReceived(qint32 count);
 
@@ -535,6 +574,7 @@ private Q_SLOTS:
     void messagesGetHistory_slt(qint64 id, const MessagesMessages &result);
     void messagesReadHistory_slt(qint64 id, const MessagesAffectedMessages &result);
     void messagesReadEncryptedHistory_slt(qint64 id, bool ok);
+    void channelsReadHistory_slt(qint64 id, bool ok);
     void messagesDeleteHistory_slt(qint64 id, const MessagesAffectedHistory &result);
 
     void messagesSearch_slt(qint64 id, const MessagesMessages &result);
@@ -554,13 +594,14 @@ private Q_SLOTS:
     void messagesSendEncryptedFile_slt(qint64 id, const MessagesSentEncryptedMessage &result);
 
     void messagesGetStickers_slt(qint64 msgId, const MessagesStickers &stickers);
-    void messagesGetAllStickers_slt(qint64 msgId, const MessagesAllStickers &stickers);
+    void messagesGetAllStickers_slt(qint64 msgId, const MessagesAllStickers &result);
     void messagesGetStickerSet_slt(qint64 msgId, const MessagesStickerSet &stickerset);
     void messagesInstallStickerSet_slt(qint64 msgId, bool ok);
     void messagesUninstallStickerSet_slt(qint64 msgId, bool ok);
 
     void onServerError(qint64 msgId, qint32 errorCode, const QString &errorText);
     void removeDialogsLock(qint64 msgId, qint32 errorCode, const QString &errorText);
+    void requestDropped(const QString &method);
     void removeReconnectLock(qint64 msgId, qint32 errorCode, const QString &errorText);
 
     void updatesTooLong_slt();
@@ -580,6 +621,11 @@ private Q_SLOTS:
     void uploadCancelFile_slt(qint64 fileId, bool cancelled);
 
     void getDialogs();
+    bool requestDialogs(qint32 offsetDate, int priority);
+    void removeUnseenDialogs();
+    void cancelDialogsWalk();
+    void releaseDialogsLock();
+    bool handleServerError(qint64 msgId, qint32 errorCode, const QString &errorText);
     void onConnectedChanged();
 
     void fatalError_slt();
@@ -594,6 +640,10 @@ private:
     void insertDocument(const Document &doc, bool fromDb = false);
     void insertUpdates(const UpdatesType &updates);
     void insertUpdate( const Update & update );
+    void insertUpdateEntities(const QList<User> &users, const QList<Chat> &chats);
+    void insertBackgroundUpdate(const Update &update);
+    void insertBackgroundMessage(const Message &message, bool isNew);
+    void flushBackground();
     void insertContact(const Contact & contact , bool fromDb = false);
     void insertEncryptedMessage(const EncryptedMessage & emsg);
     void insertEncryptedChat(const EncryptedChat & c);
@@ -611,8 +661,10 @@ private:
 
     QString fileLocation_old( FileLocationObject *location );
     QString fileLocation_old2( FileLocationObject *location );
+    QString thumbnailsPath() const;
 
     static QString localFilesPrePath();
+    static QString contactsHash(const QList<Contact> &contacts);
     static bool createAudioThumbnail(const QString &audio, const QString &output);
     QString publicKeyPath() const;
 
@@ -621,7 +673,18 @@ protected:
     Message newMessage(qint64 dId);
     SecretChat *getSecretChat(qint64 chatId);
 
+    bool takeCachedResponse(const QString &key);
+    bool takeShortMessage(const Message &msg, qint32 pts, qint32 ptsCount);
+    void insertShortMessage(const Message &msg);
+
     void startGarbageChecker();
+    void startTyping(qint64 dId, qint64 userId);
+    void insertMessageRecord(const TelegramIngestRecord &record, bool encrypted, bool fromDb, bool tempMsg, bool announceChanges);
+    void flushPresence();
+    void scheduleStatusExpiry(qint64 userId, const UserStatus &status);
+    void scheduleMuteExpiry(qint64 peerId, qint32 muteUntil);
+    void storePendingReads();
+    void readFlushFinished(qint64 requestId, bool ok, qint32 errorCode = 0);
     void insertToGarbeges(QObject *obj);
 
 private Q_SLOTS:
@@ -631,9 +694,15 @@ private Q_SLOTS:
     void dbContactFounded(const Contact &contact);
     void dbMessageFounded(const Message &message);
     void dbMediaKeysFounded(qint64 mediaId, const QByteArray &key, const QByteArray &iv);
+    void dbValueFounded(const QString &key, const QString &value);
+    void timerWheelExpired(int type, qint64 first, qint64 second);
+    void applyIngestBatch(const TelegramIngestBatch &batch);
 
     void refreshUnreadCount();
     void refreshTotalUploadedPercent();
+    void sendPreparedFile(const TelegramPreparedMedia &prepared);
+    void replayCachedResponse(const QString &key, qint64 msgId);
+    void syncChannel(qint32 channelId);
     void refreshSecretChats();
     void updateEncryptedTopMessage(const Message &message);
     void getMyUser();
@@ -641,8 +710,6 @@ private Q_SLOTS:
     InputPeer::InputPeerClassType getInputPeerType(qint64 pid);
     Peer::PeerClassType getPeerType(qint64 pid);
 
-    QStringList stringToIndex(const QString & str);
-
     void objectDestroyed(QObject *obj);
     void cleanUpMessages_prv();
 
@@ -655,7 +722,6 @@ private Q_SLOTS:
 
 private:
     TelegramQmlPrivate *p;
-    void checkUpdateSyncState(qint32 seq, qint32 date);
 };
 
 Q_DECLARE_METATYPE(TelegramQml*)
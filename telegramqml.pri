@@ -1,4 +1,4 @@
-QT += qml quick sql xml multimedia
+QT += qml quick sql xml multimedia network
 
 contains(DEFINES, UBUNTU_PHONE): CONFIG += c++11
 
@@ -62,6 +62,18 @@ SOURCES += \
     $$PWD/databaseabstractencryptor.cpp \
     $$PWD/utils.cpp \
     $$PWD/syncmanager.cpp \
+    $$PWD/telegramstreamdevice.cpp \
+    $$PWD/telegramstreamserver.cpp \
+    $$PWD/telegrammediapreparer.cpp \
+    $$PWD/telegramrequestscheduler.cpp \
+    $$PWD/telegramresponsecache.cpp \
+    $$PWD/telegramhistorybackfill.cpp \
+    $$PWD/telegramtimerwheel.cpp \
+    $$PWD/telegramingestor.cpp \
+    $$PWD/telegramnameindex.cpp \
+    $$PWD/telegramparticipantsstore.cpp \
+    $$PWD/telegramsortkeys.cpp \
+    $$PWD/audiocoverextractor.cpp \
     $$PWD/objects/types.cpp
 
 HEADERS += \
@@ -100,7 +112,20 @@ HEADERS += \
     $$PWD/tgabstractlistmodel.h \
     $$PWD/databaseabstractencryptor.h \
     $$PWD/utils.h \
-    $$PWD/syncmanager.h
+    $$PWD/syncmanager.h \
+    $$PWD/telegramstreamdevice.h \
+    $$PWD/telegramstreamserver.h \
+    $$PWD/telegrammediapreparer.h \
+    $$PWD/telegramrequestscheduler.h \
+    $$PWD/telegramresponsecache.h \
+    $$PWD/telegramhistorybackfill.h \
+    $$PWD/telegramtimerwheel.h \
+    $$PWD/telegramingestor.h \
+    $$PWD/telegramnameindex.h \
+    $$PWD/telegramparticipantsstore.h \
+    $$PWD/telegramnarrowingfilter.h \
+    $$PWD/telegramsortkeys.h \
+    $$PWD/audiocoverextractor.h
 
 RESOURCES += \
     $$PWD/tqmlresource.qrc
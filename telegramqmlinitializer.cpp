@@ -21,6 +21,7 @@
 #include "telegramfilehandler.h"
 #include "telegrammessagesmodel.h"
 #include "stickersmodel.h"
+#include "telegramhistorybackfill.h"
 #include "objects/types.h"
 
 #include <qqml.h>
@@ -58,6 +59,7 @@ void TelegramQmlInitializer::init(const char *uri)
     qmlRegisterType<TelegramFileHandler>(uri, 1, 0, "FileHandler");
     qmlRegisterType<TelegramMessagesModel>(uri, 1, 0, "MessagesModel");
     qmlRegisterUncreatableType<UserData>(uri, 1, 0, "UserData", "");
+    qmlRegisterUncreatableType<TelegramHistoryBackfill>(uri, 1, 0, "HistoryBackfill", "");
 
     initializeTypes(uri);
 }
@@ -0,0 +1,423 @@
+/*
+    Copyright (C) 2014 Aseman
+    http://aseman.co
+
+    This project is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This project is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define DEFAULT_MAX_IN_FLIGHT 6
+#define REQUEST_TIMEOUT 30000
+#define TIMEOUT_CHECK_INTERVAL 5000
+#define FLOOD_MAX_RETRIES 3
+
+#include "telegramrequestscheduler.h"
+
+#include <telegram.h>
+
+#include <QTimerEvent>
+#include <QDateTime>
+#include <QPointer>
+#include <QRegExp>
+#include <QStringList>
+#include <QList>
+#include <QHash>
+#include <QDebug>
+
+class TelegramRequestSchedulerItem
+{
+public:
+    TelegramRequestSchedulerItem(): priority(TelegramRequestScheduler::BackgroundSync),
+        queued(0), started(0), retries(0) {}
+
+    QString method;
+    int priority;
+    TelegramRequestScheduler_Request request;
+    qint64 queued;
+    qint64 started;
+    int retries;
+};
+
+class TelegramRequestSchedulerMetric
+{
+public:
+    TelegramRequestSchedulerMetric(): requests(0), failures(0), timeouts(0), floodWaits(0),
+        totalLatency(0), maxLatency(0), totalQueueTime(0), maxQueueTime(0) {}
+
+    qint64 requests;
+    qint64 failures;
+    qint64 timeouts;
+    qint64 floodWaits;
+    qint64 totalLatency;
+    qint64 maxLatency;
+    qint64 totalQueueTime;
+    qint64 maxQueueTime;
+};
+
+class TelegramRequestSchedulerPrivate
+{
+public:
+    QPointer<Telegram> telegram;
+    int maxInFlight;
+    bool dispatchPending;
+    int timeoutTimer;
+    int floodTimer;
+
+    QList<TelegramRequestSchedulerItem> queues[3];
+    QHash<qint64, TelegramRequestSchedulerItem> inFlight;
+    QHash<QString, qint64> floodUntil;
+    QHash<QString, TelegramRequestSchedulerMetric> metrics;
+    int userInFlight;
+};
+
+TelegramRequestScheduler::TelegramRequestScheduler(QObject *parent) :
+    QObject(parent)
+{
+    p = new TelegramRequestSchedulerPrivate;
+    p->maxInFlight = DEFAULT_MAX_IN_FLIGHT;
+    p->dispatchPending = false;
+    p->timeoutTimer = 0;
+    p->floodTimer = 0;
+    p->userInFlight = 0;
+}
+
+void TelegramRequestScheduler::setTelegram(Telegram *tg)
+{
+    if(p->telegram == tg)
+        return;
+
+    clear();
+    p->telegram = tg;
+    if(!tg)
+        return;
+
+    connect(tg, &Telegram::usersGetFullUserAnswer, this, [this](qint64 id){ finished(id); });
+    connect(tg, &Telegram::messagesGetFullChatAnswer, this, [this](qint64 id){ finished(id); });
+    connect(tg, &Telegram::channelsGetFullChannelAnswer, this, [this](qint64 id){ finished(id); });
+    connect(tg, &Telegram::messagesGetDialogsAnswer, this, [this](qint64 id){ finished(id); });
+    connect(tg, &Telegram::messagesGetMessagesAnswer, this, [this](qint64 id){ finished(id); });
+    connect(tg, &Telegram::channelsGetMessagesAnswer, this, [this](qint64 id){ finished(id); });
+    connect(tg, &Telegram::messagesGetStickerSetAnswer, this, [this](qint64 id){ finished(id); });
+    connect(tg, &Telegram::messagesGetAllStickersAnswer, this, [this](qint64 id){ finished(id); });
+    connect(tg, &Telegram::messagesSendMessageAnswer, this, [this](qint64 id){ finished(id); });
+    connect(tg, &Telegram::messagesSendEncryptedAnswer, this, [this](qint64 id){ finished(id); });
+    connect(tg, &Telegram::messagesForwardMessagesAnswer, this, [this](qint64 id){ finished(id); });
+    connect(tg, &Telegram::contactsGetContactsAnswer, this, [this](qint64 id){ finished(id); });
+    connect(tg, &Telegram::accountGetWallPapersAnswer, this, [this](qint64 id){ finished(id); });
+    connect(tg, &Telegram::connected, this, &TelegramRequestScheduler::dispatchLater);
+    connect(tg, &Telegram::disconnected, this, [this](){
+        // Answers of the old session never arrive, queued requests are kept.
+        dropInFlight();
+    });
+}
+
+void TelegramRequestScheduler::setMaxInFlight(int count)
+{
+    p->maxInFlight = qMax(1, count);
+    dispatchLater();
+}
+
+int TelegramRequestScheduler::maxInFlight() const
+{
+    return p->maxInFlight;
+}
+
+int TelegramRequestScheduler::inFlight() const
+{
+    return p->inFlight.count();
+}
+
+bool TelegramRequestScheduler::isIdle() const
+{
+    if(!p->queues[UserInitiated].isEmpty() || !p->queues[VisibleData].isEmpty())
+        return false;
+
+    Q_FOREACH(const TelegramRequestSchedulerItem &item, p->inFlight)
+        if(item.priority != BackgroundSync)
+            return false;
+
+    return true;
+}
+
+void TelegramRequestScheduler::schedule(const QString &method, int priority, TelegramRequestScheduler_Request request)
+{
+    TelegramRequestSchedulerItem item;
+    item.method = method;
+    item.priority = qBound<int>(UserInitiated, priority, BackgroundSync);
+    item.request = request;
+    item.queued = QDateTime::currentMSecsSinceEpoch();
+
+    p->queues[item.priority] << item;
+    dispatchLater();
+}
+
+void TelegramRequestScheduler::track(const QString &method, int priority, qint64 msgId)
+{
+    if(!msgId)
+        return;
+
+    TelegramRequestSchedulerItem item;
+    item.method = method;
+    item.priority = qBound<int>(UserInitiated, priority, BackgroundSync);
+    item.queued = item.started = QDateTime::currentMSecsSinceEpoch();
+
+    p->inFlight[msgId] = item;
+    p->metrics[method].requests++;
+    if(item.priority == UserInitiated)
+        p->userInFlight++;
+    if(!p->timeoutTimer)
+        p->timeoutTimer = startTimer(TIMEOUT_CHECK_INTERVAL);
+}
+
+QVariantMap TelegramRequestScheduler::metrics() const
+{
+    QHash<QString, int> queued;
+    for(int i=UserInitiated; i<=BackgroundSync; i++)
+        Q_FOREACH(const TelegramRequestSchedulerItem &item, p->queues[i])
+            queued[item.method]++;
+
+    QVariantMap result;
+    QHashIterator<QString, TelegramRequestSchedulerMetric> i(p->metrics);
+    while(i.hasNext())
+    {
+        i.next();
+        const TelegramRequestSchedulerMetric &m = i.value();
+        const qint64 answered = qMax<qint64>(1, m.requests - m.timeouts);
+
+        QVariantMap map;
+        map["requests"] = m.requests;
+        map["failures"] = m.failures;
+        map["timeouts"] = m.timeouts;
+        map["floodWaits"] = m.floodWaits;
+        map["averageLatency"] = m.totalLatency/answered;
+        map["maxLatency"] = m.maxLatency;
+        map["averageQueueTime"] = m.totalQueueTime/qMax<qint64>(1, m.requests);
+        map["maxQueueTime"] = m.maxQueueTime;
+        map["queued"] = queued.value(i.key());
+        result[i.key()] = map;
+    }
+
+    return result;
+}
+
+void TelegramRequestScheduler::finished(qint64 msgId)
+{
+    finish(msgId, false);
+}
+
+bool TelegramRequestScheduler::serverError(qint64 msgId, qint32 errorCode, const QString &errorText)
+{
+    if(!p->inFlight.contains(msgId))
+        return false;
+
+    const TelegramRequestSchedulerItem item = p->inFlight.value(msgId);
+    finish(msgId, true);
+
+    QRegExp rx("FLOOD_WAIT_(\\d+)");
+    if(errorCode != 420 && rx.indexIn(errorText) == -1)
+        return false;
+
+    const qint64 seconds = (rx.indexIn(errorText) != -1)? rx.cap(1).toLongLong() : 1;
+    p->floodUntil[item.method] = QDateTime::currentMSecsSinceEpoch() + seconds*1000;
+    p->metrics[item.method].floodWaits++;
+    qWarning() << __FUNCTION__ << item.method << "flood wait for" << seconds << "seconds";
+
+    bool requeued = false;
+    if(item.request && item.retries < FLOOD_MAX_RETRIES)
+    {
+        TelegramRequestSchedulerItem retry = item;
+        retry.retries++;
+        retry.queued = QDateTime::currentMSecsSinceEpoch();
+        p->queues[retry.priority].prepend(retry);
+        requeued = true;
+    }
+
+    restartFloodTimer();
+    return requeued;
+}
+
+void TelegramRequestScheduler::clear()
+{
+    QStringList methods;
+    for(int i=UserInitiated; i<=BackgroundSync; i++)
+    {
+        Q_FOREACH(const TelegramRequestSchedulerItem &item, p->queues[i])
+            methods << item.method;
+        p->queues[i].clear();
+    }
+
+    dropInFlight();
+    Q_FOREACH(const QString &method, methods)
+        Q_EMIT dropped(method);
+}
+
+void TelegramRequestScheduler::dropInFlight()
+{
+    const QList<TelegramRequestSchedulerItem> items = p->inFlight.values();
+    p->inFlight.clear();
+    p->userInFlight = 0;
+
+    Q_FOREACH(const TelegramRequestSchedulerItem &item, items)
+        Q_EMIT dropped(item.method);
+}
+
+void TelegramRequestScheduler::dispatch()
+{
+    p->dispatchPending = false;
+    if(!p->telegram || !p->telegram->isConnected())
+        return;
+
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    for(int priority=UserInitiated; priority<=BackgroundSync; priority++)
+    {
+        QList<TelegramRequestSchedulerItem> &queue = p->queues[priority];
+        for(int i=0; i<queue.count() && canDispatch(priority); )
+        {
+            if(p->floodUntil.value(queue.at(i).method) > now)
+            {
+                i++;
+                continue;
+            }
+
+            TelegramRequestSchedulerItem item = queue.takeAt(i);
+            const qint64 msgId = item.request();
+            if(!msgId)
+            {
+                Q_EMIT dropped(item.method);
+                continue;
+            }
+
+            item.started = QDateTime::currentMSecsSinceEpoch();
+            TelegramRequestSchedulerMetric &m = p->metrics[item.method];
+            m.requests++;
+            m.totalQueueTime += item.started - item.queued;
+            m.maxQueueTime = qMax(m.maxQueueTime, item.started - item.queued);
+
+            p->inFlight[msgId] = item;
+            if(priority == UserInitiated)
+                p->userInFlight++;
+        }
+    }
+
+    if(!p->inFlight.isEmpty() && !p->timeoutTimer)
+        p->timeoutTimer = startTimer(TIMEOUT_CHECK_INTERVAL);
+}
+
+void TelegramRequestScheduler::timerEvent(QTimerEvent *e)
+{
+    if(e->timerId() == p->floodTimer)
+    {
+        const qint64 now = QDateTime::currentMSecsSinceEpoch();
+        QMutableHashIterator<QString, qint64> i(p->floodUntil);
+        while(i.hasNext())
+            if(i.next().value() <= now)
+                i.remove();
+
+        restartFloodTimer();
+        dispatchLater();
+    }
+    else
+    if(e->timerId() == p->timeoutTimer)
+    {
+        // Answers can get lost on reconnects, don't let them hold a slot forever.
+        const qint64 now = QDateTime::currentMSecsSinceEpoch();
+        Q_FOREACH(qint64 msgId, p->inFlight.keys())
+        {
+            const TelegramRequestSchedulerItem &item = p->inFlight.value(msgId);
+            if(now - item.started < REQUEST_TIMEOUT)
+                continue;
+
+            const QString method = item.method;
+            p->metrics[method].timeouts++;
+            if(item.priority == UserInitiated)
+                p->userInFlight--;
+            p->inFlight.remove(msgId);
+            Q_EMIT dropped(method);
+        }
+
+        if(p->inFlight.isEmpty())
+        {
+            killTimer(p->timeoutTimer);
+            p->timeoutTimer = 0;
+        }
+
+        dispatchLater();
+    }
+    else
+        QObject::timerEvent(e);
+}
+
+void TelegramRequestScheduler::dispatchLater()
+{
+    if(p->dispatchPending)
+        return;
+
+    p->dispatchPending = true;
+    QMetaObject::invokeMethod(this, "dispatch", Qt::QueuedConnection);
+}
+
+void TelegramRequestScheduler::restartFloodTimer()
+{
+    if(p->floodTimer)
+        killTimer(p->floodTimer);
+    p->floodTimer = 0;
+    if(p->floodUntil.isEmpty())
+        return;
+
+    qint64 next = p->floodUntil.begin().value();
+    Q_FOREACH(qint64 until, p->floodUntil)
+        next = qMin(next, until);
+
+    p->floodTimer = startTimer(qMax<qint64>(1, next - QDateTime::currentMSecsSinceEpoch()));
+}
+
+bool TelegramRequestScheduler::canDispatch(int priority) const
+{
+    const int count = p->inFlight.count();
+    switch(priority)
+    {
+    case UserInitiated:
+        return true;
+    case VisibleData:
+        return count < p->maxInFlight;
+    default:
+        // Background sync keeps headroom for visible data and waits for
+        // anything the user is waiting on.
+        return p->userInFlight == 0 && count < qMax(1, p->maxInFlight/2);
+    }
+}
+
+void TelegramRequestScheduler::finish(qint64 msgId, bool failed)
+{
+    if(!p->inFlight.contains(msgId))
+        return;
+
+    const TelegramRequestSchedulerItem &item = p->inFlight.take(msgId);
+    const qint64 latency = QDateTime::currentMSecsSinceEpoch() - item.started;
+
+    TelegramRequestSchedulerMetric &m = p->metrics[item.method];
+    m.totalLatency += latency;
+    m.maxLatency = qMax(m.maxLatency, latency);
+    if(failed)
+        m.failures++;
+
+    if(item.priority == UserInitiated)
+        p->userInFlight--;
+
+    dispatchLater();
+}
+
+TelegramRequestScheduler::~TelegramRequestScheduler()
+{
+    delete p;
+}
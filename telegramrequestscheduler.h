@@ -0,0 +1,92 @@
+/*
+    Copyright (C) 2014 Aseman
+    http://aseman.co
+
+    This project is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This project is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TELEGRAMREQUESTSCHEDULER_H
+#define TELEGRAMREQUESTSCHEDULER_H
+
+#include <functional>
+
+#include <QObject>
+#include <QVariantMap>
+
+#include "telegramqml_global.h"
+
+typedef std::function<qint64 ()> TelegramRequestScheduler_Request;
+
+class Telegram;
+class TelegramRequestSchedulerPrivate;
+
+/*!
+ * Orders the non-interactive api calls of TelegramQml. Requests wait in one
+ * queue per priority and are dispatched while the number of calls in flight
+ * is below the cap, background sync yields to user initiated calls and a
+ * FLOOD_WAIT answer holds back the failing method until the wait is over.
+ * Requests that are discarded without an answer, on disconnects, timeouts
+ * or clear(), are reported through dropped() so their owners can recover.
+ */
+class TELEGRAMQMLSHARED_EXPORT TelegramRequestScheduler : public QObject
+{
+    Q_OBJECT
+public:
+    enum Priority {
+        UserInitiated,
+        VisibleData,
+        BackgroundSync
+    };
+
+    TelegramRequestScheduler(QObject *parent = 0);
+    ~TelegramRequestScheduler();
+
+    void setTelegram(Telegram *tg);
+
+    void setMaxInFlight(int count);
+    int maxInFlight() const;
+    int inFlight() const;
+    bool isIdle() const;
+
+    void schedule(const QString &method, int priority, TelegramRequestScheduler_Request request);
+    void track(const QString &method, int priority, qint64 msgId);
+
+    QVariantMap metrics() const;
+
+public Q_SLOTS:
+    void finished(qint64 msgId);
+    bool serverError(qint64 msgId, qint32 errorCode, const QString &errorText);
+    void clear();
+
+Q_SIGNALS:
+    void dropped(const QString &method);
+
+private Q_SLOTS:
+    void dispatch();
+    void dispatchLater();
+
+protected:
+    void timerEvent(QTimerEvent *e);
+
+private:
+    void restartFloodTimer();
+    bool canDispatch(int priority) const;
+    void finish(qint64 msgId, bool failed);
+    void dropInFlight();
+
+private:
+    TelegramRequestSchedulerPrivate *p;
+};
+
+#endif // TELEGRAMREQUESTSCHEDULER_H
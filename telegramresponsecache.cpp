@@ -0,0 +1,196 @@
+/*
+    Copyright (C) 2014 Aseman
+    http://aseman.co
+
+    This project is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This project is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define CHAT_FULL_TTL (10*60*1000)
+#define USER_FULL_TTL (10*60*1000)
+#define STICKER_SET_TTL (24*60*60*1000)
+#define WALLPAPERS_TTL (24*60*60*1000)
+// Hash checked lists are always revalidated, these only bound how long they are kept.
+#define CONTACTS_TTL (30LL*24*60*60*1000)
+#define ALL_STICKERS_TTL (30LL*24*60*60*1000)
+#define MAX_TTL CONTACTS_TTL
+#define IN_FLIGHT_TIMEOUT 30000
+
+#include "telegramresponsecache.h"
+#include "database.h"
+
+#include <QDateTime>
+#include <QHash>
+
+class TelegramResponseCacheItem
+{
+public:
+    TelegramResponseCacheItem(): type(0), date(0) {}
+    int type;
+    qint64 date;
+    QByteArray data;
+};
+
+class TelegramResponseCachePrivate
+{
+public:
+    QPointer<Database> database;
+    QHash<QString, TelegramResponseCacheItem> items;
+    QHash<QString, qint64> inFlight;
+    QHash<qint64, QString> requests;
+};
+
+TelegramResponseCache::TelegramResponseCache(QObject *parent) :
+    QObject(parent)
+{
+    p = new TelegramResponseCachePrivate;
+}
+
+void TelegramResponseCache::setDatabase(Database *db)
+{
+    if(p->database == db)
+        return;
+
+    if(p->database)
+        disconnect(p->database, SIGNAL(cacheFounded(int,QString,qint64,QByteArray)),
+                   this, SLOT(cacheFounded(int,QString,qint64,QByteArray)));
+
+    p->database = db;
+    if(p->database)
+        connect(p->database, SIGNAL(cacheFounded(int,QString,qint64,QByteArray)),
+                SLOT(cacheFounded(int,QString,qint64,QByteArray)));
+}
+
+void TelegramResponseCache::load()
+{
+    clear();
+    if(p->database)
+        p->database->readCache(QDateTime::currentMSecsSinceEpoch() - MAX_TTL);
+}
+
+qint64 TelegramResponseCache::ttl(int type)
+{
+    switch(type)
+    {
+    case ChatFullType:
+        return CHAT_FULL_TTL;
+    case UserFullType:
+        return USER_FULL_TTL;
+    case StickerSetType:
+        return STICKER_SET_TTL;
+    case WallPapersType:
+        return WALLPAPERS_TTL;
+    case ContactsType:
+        return CONTACTS_TTL;
+    case AllStickersType:
+        return ALL_STICKERS_TTL;
+    }
+
+    return 0;
+}
+
+bool TelegramResponseCache::contains(const QString &key) const
+{
+    if(!p->items.contains(key))
+        return false;
+
+    const TelegramResponseCacheItem &item = p->items.value(key);
+    return QDateTime::currentMSecsSinceEpoch() - item.date < ttl(item.type);
+}
+
+QByteArray TelegramResponseCache::value(const QString &key) const
+{
+    if(!contains(key))
+        return QByteArray();
+
+    return p->items.value(key).data;
+}
+
+void TelegramResponseCache::insert(int type, const QString &key, const QByteArray &data)
+{
+    TelegramResponseCacheItem item;
+    item.type = type;
+    item.date = QDateTime::currentMSecsSinceEpoch();
+    item.data = data;
+
+    p->items[key] = item;
+    if(p->database)
+        p->database->insertCache(type, key, item.date, data);
+}
+
+void TelegramResponseCache::remove(const QString &key)
+{
+    p->items.remove(key);
+    if(p->database)
+        p->database->deleteCache(key);
+}
+
+bool TelegramResponseCache::startRequest(const QString &key)
+{
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    if(now - p->inFlight.value(key, 0) < IN_FLIGHT_TIMEOUT)
+        return false;
+
+    p->inFlight[key] = now;
+    return true;
+}
+
+void TelegramResponseCache::setRequestId(qint64 msgId, const QString &key)
+{
+    p->requests[msgId] = key;
+}
+
+void TelegramResponseCache::finishRequest(qint64 msgId)
+{
+    if(!p->requests.contains(msgId))
+        return;
+
+    p->inFlight.remove(p->requests.take(msgId));
+}
+
+void TelegramResponseCache::dropRequests(const QString &keyPrefix)
+{
+    QMutableHashIterator<QString, qint64> i(p->inFlight);
+    while(i.hasNext())
+        if(i.next().key().startsWith(keyPrefix))
+            i.remove();
+
+    QMutableHashIterator<qint64, QString> r(p->requests);
+    while(r.hasNext())
+        if(r.next().value().startsWith(keyPrefix))
+            r.remove();
+}
+
+void TelegramResponseCache::clear()
+{
+    p->items.clear();
+    p->inFlight.clear();
+    p->requests.clear();
+}
+
+void TelegramResponseCache::cacheFounded(int type, const QString &key, qint64 date, const QByteArray &data)
+{
+    if(p->items.value(key).date >= date)
+        return;
+
+    TelegramResponseCacheItem item;
+    item.type = type;
+    item.date = date;
+    item.data = data;
+    p->items[key] = item;
+}
+
+TelegramResponseCache::~TelegramResponseCache()
+{
+    delete p;
+}
@@ -0,0 +1,95 @@
+/*
+    Copyright (C) 2014 Aseman
+    http://aseman.co
+
+    This project is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This project is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TELEGRAMRESPONSECACHE_H
+#define TELEGRAMRESPONSECACHE_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QDataStream>
+#include <QPointer>
+
+#include "telegramqml_global.h"
+
+class Database;
+class TelegramResponseCachePrivate;
+
+/*!
+ * Keeps the answers of full entity requests (chat and user info, sticker
+ * sets, wallpapers) for a per type time to live, mirrored to the database
+ * so they survive restarts. It also tracks requests in flight by key, so
+ * concurrent callers asking for the same entity share one request.
+ */
+class TELEGRAMQMLSHARED_EXPORT TelegramResponseCache : public QObject
+{
+    Q_OBJECT
+public:
+    enum Type {
+        ChatFullType,
+        UserFullType,
+        StickerSetType,
+        WallPapersType,
+        ContactsType,
+        AllStickersType
+    };
+
+    TelegramResponseCache(QObject *parent = 0);
+    ~TelegramResponseCache();
+
+    void setDatabase(Database *db);
+    void load();
+
+    static qint64 ttl(int type);
+
+    bool contains(const QString &key) const;
+    QByteArray value(const QString &key) const;
+    void insert(int type, const QString &key, const QByteArray &data);
+    void remove(const QString &key);
+
+    bool startRequest(const QString &key);
+    void setRequestId(qint64 msgId, const QString &key);
+    void finishRequest(qint64 msgId);
+    void dropRequests(const QString &keyPrefix);
+
+    template<typename T>
+    static QByteArray toData(const T &value) {
+        QByteArray data;
+        QDataStream stream(&data, QIODevice::WriteOnly);
+        stream << value;
+        return data;
+    }
+
+    template<typename T>
+    static T fromData(const QByteArray &data) {
+        T value;
+        QDataStream stream(data);
+        stream >> value;
+        return value;
+    }
+
+public Q_SLOTS:
+    void clear();
+
+private Q_SLOTS:
+    void cacheFounded(int type, const QString &key, qint64 date, const QByteArray &data);
+
+private:
+    TelegramResponseCachePrivate *p;
+};
+
+#endif // TELEGRAMRESPONSECACHE_H
@@ -0,0 +1,89 @@
+/*
+    Copyright (C) 2014 Aseman
+    http://aseman.co
+
+    This project is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This project is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "telegramsortkeys.h"
+
+TelegramSortKeys::TelegramSortKeys()
+{
+    collator.setCaseSensitivity(Qt::CaseInsensitive);
+    collator.setNumericMode(true);
+}
+
+void TelegramSortKeys::setLocale(const QLocale &locale)
+{
+    if(collator.locale() == locale)
+        return;
+
+    collator.setLocale(locale);
+    keys.clear();
+}
+
+QLocale TelegramSortKeys::locale() const
+{
+    return collator.locale();
+}
+
+bool TelegramSortKeys::setText(qint64 id, const QString &text)
+{
+    if(texts.contains(id) && texts.value(id) == text)
+        return false;
+
+    texts[id] = text;
+    keys.remove(id);
+    return true;
+}
+
+QString TelegramSortKeys::text(qint64 id) const
+{
+    return texts.value(id);
+}
+
+void TelegramSortKeys::remove(qint64 id)
+{
+    texts.remove(id);
+    keys.remove(id);
+}
+
+void TelegramSortKeys::clear()
+{
+    texts.clear();
+    keys.clear();
+}
+
+int TelegramSortKeys::compare(qint64 a, qint64 b) const
+{
+    const int res = key(a).compare(key(b));
+    if(res)
+        return res;
+
+    return a < b? -1 : (a > b? 1 : 0);
+}
+
+bool TelegramSortKeys::lessThan(qint64 a, qint64 b) const
+{
+    return compare(a, b) < 0;
+}
+
+const QCollatorSortKey &TelegramSortKeys::key(qint64 id) const
+{
+    QSharedPointer<QCollatorSortKey> &res = keys[id];
+    if(!res)
+        res = QSharedPointer<QCollatorSortKey>(new QCollatorSortKey(collator.sortKey(texts.value(id))));
+
+    return *res;
+}
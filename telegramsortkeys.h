@@ -0,0 +1,58 @@
+/*
+    Copyright (C) 2014 Aseman
+    http://aseman.co
+
+    This project is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This project is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TELEGRAMSORTKEYS_H
+#define TELEGRAMSORTKEYS_H
+
+#include <QCollator>
+#include <QSharedPointer>
+#include <QHash>
+
+#include "telegramqml_global.h"
+
+/*!
+ * Locale aware sort keys of names. A key is built by QCollator the first
+ * time the name takes part in a comparison and kept until the name changes,
+ * so ordering a list costs plain key compares.
+ */
+class TELEGRAMQMLSHARED_EXPORT TelegramSortKeys
+{
+public:
+    TelegramSortKeys();
+
+    void setLocale(const QLocale &locale);
+    QLocale locale() const;
+
+    bool setText(qint64 id, const QString &text);
+    QString text(qint64 id) const;
+    void remove(qint64 id);
+    void clear();
+
+    int compare(qint64 a, qint64 b) const;
+    bool lessThan(qint64 a, qint64 b) const;
+
+private:
+    const QCollatorSortKey &key(qint64 id) const;
+
+private:
+    QCollator collator;
+    QHash<qint64, QString> texts;
+    mutable QHash<qint64, QSharedPointer<QCollatorSortKey> > keys;
+};
+
+#endif // TELEGRAMSORTKEYS_H
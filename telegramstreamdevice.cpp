@@ -0,0 +1,210 @@
+/*
+    Copyright (C) 2014 Aseman
+    http://aseman.co
+
+    This project is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This project is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "telegramstreamdevice.h"
+#include "objects/types.h"
+
+#include <QPointer>
+#include <QFile>
+#include <QUrl>
+#include <QEventLoop>
+#include <QTimer>
+
+class TelegramStreamDevicePrivate
+{
+public:
+    QPointer<DownloadObject> download;
+    QFile file;
+    bool completed;
+};
+
+TelegramStreamDevice::TelegramStreamDevice(DownloadObject *download, QObject *parent) :
+    QIODevice(parent)
+{
+    p = new TelegramStreamDevicePrivate;
+    p->download = download;
+    p->completed = false;
+
+    if(p->download)
+    {
+        connect(p->download, SIGNAL(downloadedChanged()), SLOT(downloadedChanged()));
+        connect(p->download, SIGNAL(locationChanged()), SLOT(locationChanged()));
+        p->completed = !p->download->location().isEmpty() && !p->download->fileId();
+    }
+}
+
+DownloadObject *TelegramStreamDevice::download() const
+{
+    return p->download;
+}
+
+qint64 TelegramStreamDevice::available() const
+{
+    if(p->completed)
+        return p->file.isOpen()? p->file.size() : size();
+    if(!p->download)
+        return 0;
+
+    return p->download->downloaded();
+}
+
+bool TelegramStreamDevice::open(QIODevice::OpenMode mode)
+{
+    if(mode & QIODevice::WriteOnly)
+        return false;
+
+    // Reads are served straight from the file, so QIODevice must not
+    // buffer ahead of what is already downloaded.
+    if(!QIODevice::open(mode | QIODevice::Unbuffered))
+        return false;
+
+    openSource();
+    return true;
+}
+
+void TelegramStreamDevice::close()
+{
+    p->file.close();
+    QIODevice::close();
+}
+
+bool TelegramStreamDevice::isSequential() const
+{
+    return false;
+}
+
+qint64 TelegramStreamDevice::size() const
+{
+    if(p->completed && p->file.isOpen())
+        return p->file.size();
+    if(!p->download)
+        return 0;
+
+    return p->download->total();
+}
+
+qint64 TelegramStreamDevice::bytesAvailable() const
+{
+    // pos() is the logical position, QIODevice's read buffer is already part
+    // of the downloaded bytes past it.
+    return qMax<qint64>(0, available() - pos());
+}
+
+bool TelegramStreamDevice::seek(qint64 pos)
+{
+    if(pos < 0 || (size() && pos > size()))
+        return false;
+
+    return QIODevice::seek(pos);
+}
+
+bool TelegramStreamDevice::atEnd() const
+{
+    const qint64 total = size();
+    return total && pos() >= total;
+}
+
+bool TelegramStreamDevice::waitForReadyRead(int msecs)
+{
+    if(bytesAvailable() > 0)
+        return true;
+    if(atEnd() || !p->download)
+        return false;
+
+    QEventLoop loop;
+    connect(this, SIGNAL(readyRead()), &loop, SLOT(quit()));
+    connect(this, SIGNAL(aboutToClose()), &loop, SLOT(quit()));
+    connect(p->download, SIGNAL(destroyed()), &loop, SLOT(quit()));
+    if(msecs >= 0)
+        QTimer::singleShot(msecs, &loop, SLOT(quit()));
+
+    loop.exec();
+    return bytesAvailable() > 0;
+}
+
+qint64 TelegramStreamDevice::readData(char *data, qint64 maxlen)
+{
+    if(!p->file.isOpen() && !openSource())
+        return atEnd()? -1 : 0;
+
+    const qint64 readable = available() - pos();
+    if(readable <= 0)
+        return atEnd()? -1 : 0;
+
+    if(p->file.pos() != pos() && !p->file.seek(pos()))
+        return -1;
+
+    return p->file.read(data, qMin(maxlen, readable));
+}
+
+qint64 TelegramStreamDevice::writeData(const char *data, qint64 len)
+{
+    Q_UNUSED(data)
+    Q_UNUSED(len)
+    return -1;
+}
+
+void TelegramStreamDevice::downloadedChanged()
+{
+    if(!isOpen())
+        return;
+    if(!p->file.isOpen())
+        openSource();
+
+    Q_EMIT readyRead();
+}
+
+void TelegramStreamDevice::locationChanged()
+{
+    if(!p->download || p->download->location().isEmpty())
+        return;
+
+    // The temporary file is copied to its final place once the last part
+    // arrives. Switch over, so the device survives the temp file removal.
+    p->completed = true;
+    p->file.close();
+    if(isOpen())
+        openSource();
+
+    Q_EMIT readyRead();
+    Q_EMIT finished();
+}
+
+bool TelegramStreamDevice::openSource()
+{
+    if(!p->download)
+        return false;
+
+    QString path;
+    if(p->completed)
+        path = QUrl(p->download->location()).toLocalFile();
+    else
+    if(p->download->file()->isOpen())
+        path = p->download->file()->fileName();
+
+    if(path.isEmpty())
+        return false;
+
+    p->file.setFileName(path);
+    return p->file.open(QFile::ReadOnly);
+}
+
+TelegramStreamDevice::~TelegramStreamDevice()
+{
+    delete p;
+}
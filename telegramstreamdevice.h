@@ -0,0 +1,73 @@
+/*
+    Copyright (C) 2014 Aseman
+    http://aseman.co
+
+    This project is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This project is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TELEGRAMSTREAMDEVICE_H
+#define TELEGRAMSTREAMDEVICE_H
+
+#include <QIODevice>
+
+#include "telegramqml_global.h"
+
+class DownloadObject;
+class TelegramStreamDevicePrivate;
+
+/*!
+ * Read-only random access device over a download which is still in flight.
+ * Bytes become readable as soon as their part is written to the download's
+ * temporary file, reads past that point return 0 (or block in
+ * waitForReadyRead) until more parts land.
+ */
+class TELEGRAMQMLSHARED_EXPORT TelegramStreamDevice : public QIODevice
+{
+    Q_OBJECT
+public:
+    TelegramStreamDevice(DownloadObject *download, QObject *parent = 0);
+    ~TelegramStreamDevice();
+
+    DownloadObject *download() const;
+    qint64 available() const;
+
+    bool open(OpenMode mode);
+    void close();
+
+    bool isSequential() const;
+    qint64 size() const;
+    qint64 bytesAvailable() const;
+    bool seek(qint64 pos);
+    bool atEnd() const;
+    bool waitForReadyRead(int msecs);
+
+Q_SIGNALS:
+    void finished();
+
+protected:
+    qint64 readData(char *data, qint64 maxlen);
+    qint64 writeData(const char *data, qint64 len);
+
+private Q_SLOTS:
+    void downloadedChanged();
+    void locationChanged();
+
+private:
+    bool openSource();
+
+private:
+    TelegramStreamDevicePrivate *p;
+};
+
+#endif // TELEGRAMSTREAMDEVICE_H
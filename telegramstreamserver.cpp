@@ -0,0 +1,282 @@
+/*
+    Copyright (C) 2014 Aseman
+    http://aseman.co
+
+    This project is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This project is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define STREAM_CHUNK_SIZE 65536
+#define STREAM_SOCKET_BUFFER 262144
+
+#include "telegramstreamserver.h"
+#include "telegramstreamdevice.h"
+#include "objects/types.h"
+
+#include <QTcpSocket>
+#include <QHostAddress>
+#include <QPointer>
+#include <QHash>
+#include <QUuid>
+#include <QDebug>
+
+class TelegramStreamServerItem
+{
+public:
+    QPointer<DownloadObject> download;
+    QString mimeType;
+};
+
+class TelegramStreamServerClient
+{
+public:
+    TelegramStreamServerClient(): device(0), remain(-1) {}
+    QByteArray request;
+    TelegramStreamDevice *device;
+    qint64 remain;
+};
+
+class TelegramStreamServerPrivate
+{
+public:
+    QHash<QString, TelegramStreamServerItem> items;
+    QHash<DownloadObject*, QString> tokens;
+    QHash<QTcpSocket*, TelegramStreamServerClient*> clients;
+};
+
+TelegramStreamServer::TelegramStreamServer(QObject *parent) :
+    QTcpServer(parent)
+{
+    p = new TelegramStreamServerPrivate;
+    connect(this, SIGNAL(newConnection()), SLOT(newConnection_slt()));
+
+    if(!listen(QHostAddress::LocalHost))
+        qDebug() << __FUNCTION__ << errorString();
+}
+
+QUrl TelegramStreamServer::registerDownload(DownloadObject *download, const QString &mimeType, const QString &fileName)
+{
+    if(!download || !isListening())
+        return QUrl();
+
+    QString token = p->tokens.value(download);
+    if(token.isEmpty())
+    {
+        token = QUuid::createUuid().toString().remove('{').remove('}');
+        p->tokens[download] = token;
+        connect(download, SIGNAL(destroyed(QObject*)), SLOT(downloadDestroyed(QObject*)));
+    }
+
+    TelegramStreamServerItem &item = p->items[token];
+    item.download = download;
+    item.mimeType = mimeType;
+
+    QUrl url;
+    url.setScheme("http");
+    url.setHost(serverAddress().toString());
+    url.setPort(serverPort());
+    url.setPath("/" + token + "/" + (fileName.isEmpty()? token : fileName));
+    return url;
+}
+
+void TelegramStreamServer::unregisterDownload(DownloadObject *download)
+{
+    const QString &token = p->tokens.take(download);
+    if(token.isEmpty())
+        return;
+
+    p->items.remove(token);
+    disconnect(download, SIGNAL(destroyed(QObject*)), this, SLOT(downloadDestroyed(QObject*)));
+}
+
+void TelegramStreamServer::newConnection_slt()
+{
+    while(hasPendingConnections())
+    {
+        QTcpSocket *socket = nextPendingConnection();
+        p->clients[socket] = new TelegramStreamServerClient;
+
+        connect(socket, SIGNAL(readyRead()), SLOT(readRequest()));
+        connect(socket, SIGNAL(bytesWritten(qint64)), SLOT(writeResponse()));
+        connect(socket, SIGNAL(disconnected()), SLOT(socketDisconnected()));
+    }
+}
+
+void TelegramStreamServer::readRequest()
+{
+    QTcpSocket *socket = static_cast<QTcpSocket*>(sender());
+    TelegramStreamServerClient *client = p->clients.value(socket);
+    if(!client || client->device)
+        return;
+
+    client->request += socket->readAll();
+    const int headerEnd = client->request.indexOf("\r\n\r\n");
+    if(headerEnd == -1)
+    {
+        if(client->request.size() > 8192)
+            sendError(socket, 400, "Bad Request");
+        return;
+    }
+
+    const QList<QByteArray> &lines = client->request.left(headerEnd).split('\n');
+    const QList<QByteArray> &requestLine = lines.first().trimmed().split(' ');
+    if(requestLine.count() < 2 || (requestLine.first() != "GET" && requestLine.first() != "HEAD"))
+    {
+        sendError(socket, 405, "Method Not Allowed");
+        return;
+    }
+
+    const bool headOnly = (requestLine.first() == "HEAD");
+    const QString &path = QUrl::fromPercentEncoding(requestLine.at(1));
+    const QString &token = path.section('/', 1, 1);
+    const TelegramStreamServerItem &item = p->items.value(token);
+    if(!item.download)
+    {
+        sendError(socket, 404, "Not Found");
+        return;
+    }
+
+    const qint64 total = item.download->total();
+    qint64 start = 0;
+    qint64 end = total - 1;
+    bool partial = false;
+    for(int i=1; i<lines.count(); i++)
+    {
+        const QByteArray &line = lines.at(i).trimmed();
+        if(!line.toLower().startsWith("range:"))
+            continue;
+
+        const QByteArray &range = line.mid(6).trimmed();
+        if(!range.startsWith("bytes="))
+            continue;
+
+        const QList<QByteArray> &bounds = range.mid(6).split(',').first().split('-');
+        if(bounds.count() != 2)
+            continue;
+
+        if(bounds.first().isEmpty())
+            start = total - bounds.last().toLongLong();
+        else
+        {
+            start = bounds.first().toLongLong();
+            if(!bounds.last().isEmpty())
+                end = qMin(end, bounds.last().toLongLong());
+        }
+
+        partial = true;
+    }
+
+    if(total && (start < 0 || start > end))
+    {
+        socket->write("HTTP/1.1 416 Requested Range Not Satisfiable\r\n"
+                      "Content-Range: bytes */" + QByteArray::number(total) + "\r\n"
+                      "Content-Length: 0\r\nConnection: close\r\n\r\n");
+        socket->disconnectFromHost();
+        return;
+    }
+
+    QByteArray header;
+    if(partial && total)
+    {
+        header += "HTTP/1.1 206 Partial Content\r\n";
+        header += "Content-Range: bytes " + QByteArray::number(start) + "-" +
+                  QByteArray::number(end) + "/" + QByteArray::number(total) + "\r\n";
+    }
+    else
+        header += "HTTP/1.1 200 OK\r\n";
+
+    if(!item.mimeType.isEmpty())
+        header += "Content-Type: " + item.mimeType.toUtf8() + "\r\n";
+    if(total)
+        header += "Content-Length: " + QByteArray::number(end - start + 1) + "\r\n";
+
+    header += "Accept-Ranges: bytes\r\n";
+    header += "Connection: close\r\n\r\n";
+    socket->write(header);
+
+    if(headOnly)
+    {
+        socket->disconnectFromHost();
+        return;
+    }
+
+    client->remain = total? end - start + 1 : -1;
+    client->device = new TelegramStreamDevice(item.download, socket);
+    client->device->open(QIODevice::ReadOnly);
+    client->device->seek(start);
+    connect(client->device, SIGNAL(readyRead()), SLOT(writeResponse()));
+
+    writeResponse();
+}
+
+void TelegramStreamServer::writeResponse()
+{
+    QObject *obj = sender();
+    QTcpSocket *socket = qobject_cast<QTcpSocket*>(obj);
+    if(!socket && obj)
+        socket = qobject_cast<QTcpSocket*>(obj->parent());
+    if(!socket)
+        return;
+
+    TelegramStreamServerClient *client = p->clients.value(socket);
+    if(!client || !client->device)
+        return;
+
+    QByteArray buffer;
+    while(client->remain != 0 && socket->bytesToWrite() < STREAM_SOCKET_BUFFER)
+    {
+        const qint64 chunk = client->remain > 0? qMin<qint64>(client->remain, STREAM_CHUNK_SIZE) : STREAM_CHUNK_SIZE;
+        buffer.resize(chunk);
+
+        const qint64 len = client->device->read(buffer.data(), chunk);
+        if(len <= 0)
+        {
+            if(client->device->atEnd())
+                client->remain = 0;
+            break;
+        }
+
+        socket->write(buffer.constData(), len);
+        if(client->remain > 0)
+            client->remain -= len;
+    }
+
+    if(client->remain == 0 && socket->bytesToWrite() == 0)
+        socket->disconnectFromHost();
+}
+
+void TelegramStreamServer::socketDisconnected()
+{
+    QTcpSocket *socket = static_cast<QTcpSocket*>(sender());
+    delete p->clients.take(socket);
+    socket->deleteLater();
+}
+
+void TelegramStreamServer::downloadDestroyed(QObject *obj)
+{
+    const QString &token = p->tokens.take(static_cast<DownloadObject*>(obj));
+    p->items.remove(token);
+}
+
+void TelegramStreamServer::sendError(QTcpSocket *socket, int code, const QByteArray &status)
+{
+    socket->write("HTTP/1.1 " + QByteArray::number(code) + " " + status + "\r\n"
+                  "Content-Length: 0\r\nConnection: close\r\n\r\n");
+    socket->disconnectFromHost();
+}
+
+TelegramStreamServer::~TelegramStreamServer()
+{
+    qDeleteAll(p->clients);
+    delete p;
+}
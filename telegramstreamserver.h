@@ -0,0 +1,60 @@
+/*
+    Copyright (C) 2014 Aseman
+    http://aseman.co
+
+    This project is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This project is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TELEGRAMSTREAMSERVER_H
+#define TELEGRAMSTREAMSERVER_H
+
+#include <QTcpServer>
+#include <QUrl>
+
+#include "telegramqml_global.h"
+
+class QTcpSocket;
+class DownloadObject;
+class TelegramStreamServerPrivate;
+
+/*!
+ * Minimal HTTP server on the loopback interface which serves in-flight
+ * downloads through TelegramStreamDevice, so QtMultimedia can start playing
+ * before the whole file is downloaded. Range requests are supported.
+ */
+class TELEGRAMQMLSHARED_EXPORT TelegramStreamServer : public QTcpServer
+{
+    Q_OBJECT
+public:
+    TelegramStreamServer(QObject *parent = 0);
+    ~TelegramStreamServer();
+
+    QUrl registerDownload(DownloadObject *download, const QString &mimeType, const QString &fileName);
+    void unregisterDownload(DownloadObject *download);
+
+private Q_SLOTS:
+    void newConnection_slt();
+    void readRequest();
+    void writeResponse();
+    void socketDisconnected();
+    void downloadDestroyed(QObject *obj);
+
+private:
+    void sendError(QTcpSocket *socket, int code, const QByteArray &status);
+
+private:
+    TelegramStreamServerPrivate *p;
+};
+
+#endif // TELEGRAMSTREAMSERVER_H
@@ -20,31 +20,84 @@
 #include <QDebug>
 #include <QDir>
 #include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QThread>
 #include <QString>
 #include <QMetaMethod>
 #include "telegramthumbnailer.h"
 
 TelegramThumbnailer::TelegramThumbnailer(QObject *parent) : QObject(parent)
 {
-    core = new TelegramThumbnailerCore();
-    thread = new QThread(this);
-    thread->start();
-
-    core->moveToThread(thread);
-
-    connect(core, SIGNAL(thumbnailCreated(QString)), SLOT(thumbnailCreated(QString)), Qt::QueuedConnection);
+    pool = new QThreadPool(this);
+    pool->setMaxThreadCount(qMax(1, QThread::idealThreadCount()));
 }
 
 TelegramThumbnailer::~TelegramThumbnailer()
 {
-    thread->quit();
-    thread->wait();
+    QHashIterator<QString, TelegramThumbnailerRequest> i(requests);
+    while(i.hasNext())
+    {
+        i.next();
+        i.value().core->cancel();
+    }
 
-    thread->deleteLater();
-    thread = 0;
-    
-    core->deleteLater();
-    core = 0;
+    pool->waitForDone();
+    requests.clear();
+}
+
+void TelegramThumbnailer::setMaxThreads(int count) {
+    pool->setMaxThreadCount(qMax(1, count));
+}
+
+int TelegramThumbnailer::maxThreads() const {
+    return pool->maxThreadCount();
+}
+
+void TelegramThumbnailer::setIndexPath(const QString &path) {
+    if (index_path == path)
+        return;
+
+    index_path = path;
+    index.clear();
+    if (index_path.isEmpty())
+        return;
+
+    QFile file(index_path);
+    if (!file.open(QFile::ReadOnly))
+        return;
+
+    while (!file.atEnd()) {
+        const QString &line = QString::fromUtf8(file.readLine()).trimmed();
+        if (!line.isEmpty())
+            index.insert(line);
+    }
+}
+
+QString TelegramThumbnailer::indexPath() const {
+    return index_path;
+}
+
+void TelegramThumbnailer::forgetThumbnails(const QString &thumbnailDirPath) {
+    // Entries of thumbnails deleted behind our back are dropped here too.
+    const QString prefix = QDir(thumbnailDirPath).absolutePath() + "/";
+    bool changed = false;
+    QMutableSetIterator<QString> i(index);
+    while (i.hasNext()) {
+        const QString &path = i.next();
+        if (!path.startsWith(prefix) && QFile::exists(path))
+            continue;
+        i.remove();
+        changed = true;
+    }
+
+    QMutableHashIterator<QString, QString> f(failed);
+    while (f.hasNext())
+        if (f.next().key().startsWith(prefix))
+            f.remove();
+
+    if (changed)
+        writeIndex();
 }
 
 QString TelegramThumbnailer::getThumbFilename(const QString &filePath) const {
@@ -60,35 +113,134 @@ QString TelegramThumbnailer::getThumbPath(const QString &thumbnailDirPath, const
     return thumbPath;
 }
 
+QString TelegramThumbnailer::getFingerprintThumbPath(const QString &thumbnailDirPath, const QString &filePath) const {
+    // Content identity without reading the file: the same file keeps its
+    // thumbnail while a replaced one with the same name gets a new one.
+    const QFileInfo info(filePath);
+    const QString fingerprint = QString("%1:%2:%3").arg(info.absoluteFilePath())
+                                                   .arg(info.size())
+                                                   .arg(info.lastModified().toMSecsSinceEpoch());
+    return getThumbPath(thumbnailDirPath, fingerprint);
+}
+
 bool TelegramThumbnailer::hasThumbnail(const QString &thumbnailDirPath, const QString &filePath) const {
     QString thumbPath = getThumbPath(thumbnailDirPath, filePath);
     return hasThumbnail(thumbPath);
 }
 
 bool TelegramThumbnailer::hasThumbnail(const QString &thumbPath) const {
-    QFile thumbnail(thumbPath);
-    return thumbnail.exists();
+    const QString &path = QFileInfo(thumbPath).absoluteFilePath();
+    if (index.contains(path))
+        return true;
+
+    // Thumbnails created before the index existed are picked up once.
+    if (!QFile::exists(path))
+        return false;
+
+    insertToIndex(path);
+    return true;
+}
+
+void TelegramThumbnailer::forgetThumbnail(const QString &thumbPath) {
+    if (index.remove(QFileInfo(thumbPath).absoluteFilePath()))
+        writeIndex();
 }
 
-void TelegramThumbnailer::createThumbnail(const QString &source, const QString &dest, TelegramThumbnailer_Callback callback) {
+void TelegramThumbnailer::createThumbnail(const QString &source, const QString &dest, TelegramThumbnailer_Callback callback, int size) {
+    // Sources that could not be decoded are not tried again, their callers
+    // would ask for them on every refresh.
+    if (hasFailed(source, dest))
+        return;
+
+    TelegramThumbnailerRequest &request = requests[dest];
+    if (request.core && request.core->source() != source) {
+        request.callbacks.clear();
+        request.core->cancel();
+    }
+
+    request.callbacks << callback;
+    if (request.core && !request.core->isCancelled())
+        return;
+
     qDebug() << "thumbnailer: creating thumbnail";
-    requests.insert(source, callback);
+    request.core = new TelegramThumbnailerCore(source, dest, size, this);
+    connect(request.core, SIGNAL(thumbnailCreated(QString)), SLOT(thumbnailCreated(QString)), Qt::QueuedConnection);
+
+    pool->start(request.core);
+}
 
-    QMetaObject::invokeMethod(core, "createThumbnail", Qt::QueuedConnection,
-            Q_ARG(QString,source), Q_ARG(QString,dest));
+void TelegramThumbnailer::cancelThumbnail(const QString &source) {
+    QMutableHashIterator<QString, TelegramThumbnailerRequest> i(requests);
+    while (i.hasNext()) {
+        TelegramThumbnailerRequest &request = i.next().value();
+        if (request.core->source() != source)
+            continue;
+
+        request.callbacks.clear();
+        request.core->cancel();
+    }
 }
 
 void TelegramThumbnailer::thumbnailCreated(QString path) {
+    Q_UNUSED(path)
     qDebug() << "thumbnailer: finished";
-    TelegramThumbnailer_Callback callback = requests.take(path);
+    TelegramThumbnailerCore *core = static_cast<TelegramThumbnailerCore*>(sender());
+    core->deleteLater();
+
+    // A cancelled job may have been replaced by a new one for the same output.
+    const QString &dest = core->dest();
+    if (requests.value(dest).core != core)
+        return;
+
+    const TelegramThumbnailerRequest request = requests.take(dest);
+    if (core->isCancelled())
+        return;
+
+    // Audio files without a cover and undecodable images produce no
+    // thumbnail at all.
+    if (QFile::exists(dest))
+        insertToIndex(QFileInfo(dest).absoluteFilePath());
+    else
+        failed.insert(QFileInfo(dest).absoluteFilePath(), core->source());
+    Q_FOREACH (const TelegramThumbnailer_Callback &callback, request.callbacks) {
 #ifdef TG_THUMBNAILER_CPP11
-    if (callback) {
-        callback();
-    }
+        if (callback) {
+            callback();
+        }
 #else
-    if(callback.object)
-        call(callback.object, callback.method, Qt::DirectConnection, callback.args);
+        if(callback.object)
+            call(callback.object, callback.method, Qt::DirectConnection, callback.args);
 #endif
+    }
+}
+
+bool TelegramThumbnailer::hasFailed(const QString &source, const QString &dest) const {
+    return failed.contains(QFileInfo(dest).absoluteFilePath(), source);
+}
+
+void TelegramThumbnailer::insertToIndex(const QString &thumbPath) const {
+    if (index.contains(thumbPath))
+        return;
+
+    index.insert(thumbPath);
+    if (index_path.isEmpty())
+        return;
+
+    QFile file(index_path);
+    if (file.open(QFile::WriteOnly | QFile::Append))
+        file.write(thumbPath.toUtf8() + "\n");
+}
+
+void TelegramThumbnailer::writeIndex() const {
+    if (index_path.isEmpty())
+        return;
+
+    QFile file(index_path);
+    if (!file.open(QFile::WriteOnly | QFile::Truncate))
+        return;
+
+    Q_FOREACH (const QString &path, index)
+        file.write(path.toUtf8() + "\n");
 }
 
 QVariant TelegramThumbnailer::call(QObject *obj, const QString &member, Qt::ConnectionType ctype, QVariantList vals)
@@ -20,8 +20,9 @@
 #include <functional>
 
 #include <QObject>
-#include <QThread>
+#include <QThreadPool>
 #include <QHash>
+#include <QSet>
 #include <QPointer>
 
 #include "telegramthumbnailercore.h"
@@ -42,29 +43,56 @@ public:
 };
 #endif
 
+class TelegramThumbnailerRequest
+{
+public:
+    TelegramThumbnailerRequest() : core(0) {}
+    TelegramThumbnailerCore *core;
+    QList<TelegramThumbnailer_Callback> callbacks;
+};
+
 class TelegramThumbnailer : public QObject
 {
     Q_OBJECT
 
 public:
+    enum {
+        DocumentThumbSize = 90
+    };
+
     TelegramThumbnailer(QObject *parent = 0);
     ~TelegramThumbnailer();
 
+    void setMaxThreads(int count);
+    int maxThreads() const;
+
+    void setIndexPath(const QString &path);
+    QString indexPath() const;
+    void forgetThumbnails(const QString &thumbnailDirPath);
+    void forgetThumbnail(const QString &thumbPath);
+
     QString getThumbFilename(const QString &filePath) const;
     QString getThumbPath(const QString &thumbnailDirPath, const QString &filePath) const;
+    QString getFingerprintThumbPath(const QString &thumbnailDirPath, const QString &filePath) const;
     bool hasThumbnail(const QString &thumbnailDirPath, const QString &filePath) const;
     bool hasThumbnail(const QString &thumbPath) const;
-    void createThumbnail(const QString &source, const QString &dest, TelegramThumbnailer_Callback callback);
+    bool hasFailed(const QString &source, const QString &dest) const;
+    void createThumbnail(const QString &source, const QString &dest, TelegramThumbnailer_Callback callback, int size = 0);
+    void cancelThumbnail(const QString &source);
 
 private Q_SLOTS:
     void thumbnailCreated(QString path);
 
 private:
+    void insertToIndex(const QString &thumbPath) const;
+    void writeIndex() const;
     static QVariant call( QObject *obj, const QString & member, Qt::ConnectionType type, QVariantList vals);
 
 private:
-    QHash<QString, TelegramThumbnailer_Callback> requests;
+    QHash<QString, TelegramThumbnailerRequest> requests;
 
-    QThread *thread;
-    TelegramThumbnailerCore *core;
+    QThreadPool *pool;
+    QString index_path;
+    mutable QSet<QString> index;
+    QMultiHash<QString, QString> failed;
 };
@@ -16,11 +16,16 @@
 */
 
 #include "telegramthumbnailercore.h"
+#include "audiocoverextractor.h"
 
 #include <QFileInfo>
 #include <QProcess>
 #include <QStringList>
 #include <QImage>
+#include <QImageReader>
+#include <QPainter>
+#include <QMimeDatabase>
+#include <QMimeType>
 #include <QCoreApplication>
 
 #ifdef UBUNTU_PHONE
@@ -36,12 +41,126 @@
 const int THUMB_QUAILTY = 55;
 const int THUMB_SIZE    = 90;
 
-TelegramThumbnailerCore::TelegramThumbnailerCore(QObject *parent) : QObject(parent) {
+// Gallery tiles are shown much larger than the protocol thumbnails.
+const int IMAGE_THUMB_QUALITY = 80;
+const int IMAGE_THUMB_SIZE    = 256;
+
+TelegramThumbnailerCore::TelegramThumbnailerCore(const QString &source, const QString &dest, int size, QObject *parent) :
+    QObject(parent),
+    _source(source),
+    _dest(dest),
+    _size(size? size : IMAGE_THUMB_SIZE),
+    _cancelled(0) {
+    setAutoDelete(false);
 }
 
 TelegramThumbnailerCore::~TelegramThumbnailerCore() {
 }
 
+QString TelegramThumbnailerCore::source() const {
+    return _source;
+}
+
+QString TelegramThumbnailerCore::dest() const {
+    return _dest;
+}
+
+void TelegramThumbnailerCore::cancel() {
+    _cancelled.storeRelease(1);
+}
+
+bool TelegramThumbnailerCore::isCancelled() const {
+    return _cancelled.loadAcquire();
+}
+
+void TelegramThumbnailerCore::run() {
+    // Jobs cancelled while still queued in the pool never start the encoder.
+    if (isCancelled()) {
+        Q_EMIT thumbnailCreated(_source);
+        return;
+    }
+
+    if (isImage(_source))
+        createImageThumbnail(_source, _dest);
+    else
+    if (isAudio(_source))
+        createAudioThumbnail(_source, _dest);
+    else
+        createThumbnail(_source, _dest);
+}
+
+bool TelegramThumbnailerCore::isImage(const QString &path) {
+    return !QImageReader::imageFormat(path).isEmpty();
+}
+
+bool TelegramThumbnailerCore::isAudio(const QString &path) {
+    QMimeDatabase mime_db;
+    return mime_db.mimeTypeForFile(path).name().startsWith("audio/");
+}
+
+QImage TelegramThumbnailerCore::readScaledImage(const QString &path, const QSize &bound) {
+    QImageReader reader(path);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 5, 0)
+    reader.setAutoTransform(true);
+#endif
+
+    const QSize &size = reader.size();
+    if (size.isValid() && (size.width() > bound.width() || size.height() > bound.height())) {
+        // EXIF rotation is applied after decoding, so fit the rotated bound too.
+        const QSize &box = size.width() > size.height()? QSize(qMax(bound.width(), bound.height()), qMin(bound.width(), bound.height())) :
+                                                         QSize(qMin(bound.width(), bound.height()), qMax(bound.width(), bound.height()));
+        // JPEG decodes straight into the smaller size (DCT scaling), others
+        // are decoded fully and downscaled below.
+        if (reader.supportsOption(QImageIOHandler::ScaledSize))
+            reader.setScaledSize(size.scaled(box, Qt::KeepAspectRatio));
+    }
+
+    QImage image = reader.read();
+    if (image.isNull())
+        return image;
+
+    if (image.width() > bound.width() || image.height() > bound.height())
+        image = image.scaled(bound, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+
+    return image;
+}
+
+void TelegramThumbnailerCore::createAudioThumbnail(QString source, QString dest) {
+    // No cover means no file, the caller checks the result like for videos.
+    QImage image = AudioCoverExtractor::extractImage(source);
+    if (!image.isNull()) {
+        if (image.width() > _size || image.height() > _size)
+            image = image.scaled(_size, _size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        image.save(dest, "JPEG", IMAGE_THUMB_QUALITY);
+    }
+
+    Q_EMIT thumbnailCreated(source);
+}
+
+void TelegramThumbnailerCore::createImageThumbnail(QString source, QString dest) {
+    // A failed decode writes nothing, a placeholder would be shown as the image.
+    QImage image = readScaledImage(source, QSize(_size, _size));
+    const bool png = dest.endsWith(".png", Qt::CaseInsensitive);
+    if (!image.isNull() && image.hasAlphaChannel() && !png) {
+        // JPEG has no alpha, flatten transparent stickers and PNGs on white.
+        QImage flat(image.size(), QImage::Format_RGB32);
+        flat.fill(Qt::white);
+        QPainter painter(&flat);
+        painter.drawImage(0, 0, image);
+        painter.end();
+        image = flat;
+    }
+
+    if (!image.isNull()) {
+        if (png)
+            image.save(dest, "PNG");
+        else
+            image.save(dest, "JPEG", IMAGE_THUMB_QUALITY);
+    }
+
+    Q_EMIT thumbnailCreated(source);
+}
+
 #ifdef UBUNTU_PHONE
 void TelegramThumbnailerCore::createThumbnail(QString source, QString dest) {
     try {
@@ -18,18 +18,42 @@
 #pragma once
 
 #include <QObject>
+#include <QRunnable>
+#include <QAtomicInt>
+#include <QImage>
+#include <QSize>
 
-class TelegramThumbnailerCore : public QObject
+class TelegramThumbnailerCore : public QObject, public QRunnable
 {
     Q_OBJECT
 
 public:
-    TelegramThumbnailerCore(QObject *parent = 0);
+    TelegramThumbnailerCore(const QString &source, const QString &dest, int size = 0, QObject *parent = 0);
     ~TelegramThumbnailerCore();
 
+    QString source() const;
+    QString dest() const;
+
+    void cancel();
+    bool isCancelled() const;
+
+    void run();
+
+    static bool isImage(const QString &path);
+    static bool isAudio(const QString &path);
+    static QImage readScaledImage(const QString &path, const QSize &bound);
+
 public Q_SLOTS:
     void createThumbnail(QString source, QString dest);
+    void createImageThumbnail(QString source, QString dest);
+    void createAudioThumbnail(QString source, QString dest);
 
 Q_SIGNALS:
     void thumbnailCreated(QString path);
+
+private:
+    QString _source;
+    QString _dest;
+    int _size;
+    QAtomicInt _cancelled;
 };
@@ -0,0 +1,162 @@
+/*
+    Copyright (C) 2014 Aseman
+    http://aseman.co
+
+    This project is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This project is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define WHEEL_TICK 250
+#define WHEEL_SIZE 64
+
+#include "telegramtimerwheel.h"
+
+#include <QTimerEvent>
+#include <QVector>
+#include <QHash>
+#include <QSet>
+#include <QPair>
+
+typedef QPair<int, QPair<qint64,qint64> > TelegramTimerWheelKey;
+
+class TelegramTimerWheelEntry
+{
+public:
+    TelegramTimerWheelEntry(): slot(0), rounds(0) {}
+    int slot;
+    int rounds;
+};
+
+class TelegramTimerWheelPrivate
+{
+public:
+    QVector< QSet<TelegramTimerWheelKey> > wheel;
+    QHash<TelegramTimerWheelKey, TelegramTimerWheelEntry> entries;
+    int cursor;
+    int timer;
+};
+
+TelegramTimerWheel::TelegramTimerWheel(QObject *parent) :
+    QObject(parent)
+{
+    p = new TelegramTimerWheelPrivate;
+    p->wheel.resize(WHEEL_SIZE);
+    p->cursor = 0;
+    p->timer = 0;
+}
+
+void TelegramTimerWheel::schedule(int type, qint64 first, qint64 second, qint64 msecs)
+{
+    const TelegramTimerWheelKey key(type, QPair<qint64,qint64>(first, second));
+    if(p->entries.contains(key))
+        p->wheel[p->entries.value(key).slot].remove(key);
+
+    // Rounded up, an entry never fires before its deadline.
+    const qint64 ticks = qMax<qint64>(1, (msecs + WHEEL_TICK - 1) / WHEEL_TICK);
+
+    TelegramTimerWheelEntry entry;
+    entry.slot = (p->cursor + ticks) % WHEEL_SIZE;
+    entry.rounds = (ticks - 1) / WHEEL_SIZE;
+
+    p->entries[key] = entry;
+    p->wheel[entry.slot].insert(key);
+
+    if(!p->timer)
+        p->timer = startTimer(WHEEL_TICK);
+}
+
+void TelegramTimerWheel::cancel(int type, qint64 first, qint64 second)
+{
+    const TelegramTimerWheelKey key(type, QPair<qint64,qint64>(first, second));
+    if(!p->entries.contains(key))
+        return;
+
+    p->wheel[p->entries.take(key).slot].remove(key);
+    if(p->entries.isEmpty() && p->timer)
+    {
+        killTimer(p->timer);
+        p->timer = 0;
+    }
+}
+
+bool TelegramTimerWheel::contains(int type, qint64 first, qint64 second) const
+{
+    return p->entries.contains(TelegramTimerWheelKey(type, QPair<qint64,qint64>(first, second)));
+}
+
+int TelegramTimerWheel::count() const
+{
+    return p->entries.count();
+}
+
+void TelegramTimerWheel::clear()
+{
+    for(int i=0; i<p->wheel.count(); i++)
+        p->wheel[i].clear();
+
+    p->entries.clear();
+    if(p->timer)
+    {
+        killTimer(p->timer);
+        p->timer = 0;
+    }
+}
+
+void TelegramTimerWheel::tick()
+{
+    p->cursor = (p->cursor + 1) % WHEEL_SIZE;
+
+    QList<TelegramTimerWheelKey> expiredKeys;
+    QSet<TelegramTimerWheelKey> &slot = p->wheel[p->cursor];
+    QMutableSetIterator<TelegramTimerWheelKey> i(slot);
+    while(i.hasNext())
+    {
+        const TelegramTimerWheelKey &key = i.next();
+        TelegramTimerWheelEntry &entry = p->entries[key];
+        if(entry.rounds > 0)
+        {
+            entry.rounds--;
+            continue;
+        }
+
+        expiredKeys << key;
+        p->entries.remove(key);
+        i.remove();
+    }
+
+    if(p->entries.isEmpty() && p->timer)
+    {
+        killTimer(p->timer);
+        p->timer = 0;
+    }
+
+    // Emitted last, receivers may schedule again.
+    Q_FOREACH(const TelegramTimerWheelKey &key, expiredKeys)
+        Q_EMIT expired(key.first, key.second.first, key.second.second);
+}
+
+void TelegramTimerWheel::timerEvent(QTimerEvent *e)
+{
+    if(e->timerId() == p->timer)
+    {
+        tick();
+        return;
+    }
+
+    QObject::timerEvent(e);
+}
+
+TelegramTimerWheel::~TelegramTimerWheel()
+{
+    delete p;
+}
@@ -0,0 +1,69 @@
+/*
+    Copyright (C) 2014 Aseman
+    http://aseman.co
+
+    This project is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This project is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TELEGRAMTIMERWHEEL_H
+#define TELEGRAMTIMERWHEEL_H
+
+#include <QObject>
+
+#include "telegramqml_global.h"
+
+class TelegramTimerWheelPrivate;
+
+/*!
+ * Hashed timer wheel for the many short lived expirations of the client,
+ * like typing indicators, online statuses and mute periods. All entries
+ * share a single coarse timer which only runs while something is
+ * scheduled. An entry is identified by its type and a pair of ids,
+ * scheduling it again moves the deadline.
+ */
+class TELEGRAMQMLSHARED_EXPORT TelegramTimerWheel : public QObject
+{
+    Q_OBJECT
+public:
+    enum TimerType {
+        TypingTimer,
+        StatusTimer,
+        MuteTimer
+    };
+
+    TelegramTimerWheel(QObject *parent = 0);
+    ~TelegramTimerWheel();
+
+    void schedule(int type, qint64 first, qint64 second, qint64 msecs);
+    void cancel(int type, qint64 first, qint64 second);
+    bool contains(int type, qint64 first, qint64 second) const;
+    int count() const;
+
+public Q_SLOTS:
+    void clear();
+
+Q_SIGNALS:
+    void expired(int type, qint64 first, qint64 second);
+
+protected:
+    void timerEvent(QTimerEvent *e);
+
+private:
+    void tick();
+
+private:
+    TelegramTimerWheelPrivate *p;
+};
+
+#endif // TELEGRAMTIMERWHEEL_H
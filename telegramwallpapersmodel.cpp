@@ -123,9 +123,7 @@ void TelegramWallpapersModel::recheck()
 {
     if(!p->telegram || !p->telegram->authLoggedIn())
         return;
-    Telegram *tgObject = p->telegram->telegram();
-    if(tgObject)
-        tgObject->accountGetWallPapers();
+    p->telegram->accountGetWallPapers();
 }
 
 void TelegramWallpapersModel::wallpapersChanged()
@@ -3,6 +3,9 @@
 
 #include <QAbstractListModel>
 #include <QStringList>
+#include <QSet>
+#include <QHash>
+#include <QVector>
 
 #include "telegramqml_global.h"
 
@@ -18,6 +21,109 @@ public:
 public Q_SLOTS:
     QVariant get(int index, int role) const;
     QVariantMap get(int index) const;
+
+protected:
+    /*!
+     * Turns current into next with as few row signals as possible:
+     * removals and insertions in contiguous runs, and one move for each
+     * row outside the longest run of rows that kept their relative order.
+     */
+    template<typename T>
+    void updateRows(QList<T> &current, const QList<T> &next)
+    {
+        const QSet<T> &nextSet = next.toSet();
+        for(int i=current.count()-1; i>=0; )
+        {
+            if(nextSet.contains(current.at(i)))
+            {
+                i--;
+                continue;
+            }
+
+            const int last = i;
+            while(i>=0 && !nextSet.contains(current.at(i)))
+                i--;
+
+            beginRemoveRows(QModelIndex(), i+1, last);
+            current.erase(current.begin()+i+1, current.begin()+last+1);
+            endRemoveRows();
+        }
+
+        const QSet<T> &currentSet = current.toSet();
+        QList<T> kept;
+        Q_FOREACH(const T &item, next)
+            if(currentSet.contains(item))
+                kept << item;
+
+        if(current != kept)
+        {
+            QHash<T,int> positions;
+            for(int i=0; i<current.count(); i++)
+                positions[current.at(i)] = i;
+
+            // Longest increasing run of current positions, in kept order.
+            QList<int> tails;
+            QVector<int> parents(kept.count(), -1);
+            for(int i=0; i<kept.count(); i++)
+            {
+                const int pos = positions.value(kept.at(i));
+                int lo = 0, hi = tails.count();
+                while(lo < hi)
+                {
+                    const int mid = (lo+hi)/2;
+                    if(positions.value(kept.at(tails.at(mid))) < pos)
+                        lo = mid+1;
+                    else
+                        hi = mid;
+                }
+                if(lo > 0)
+                    parents[i] = tails.at(lo-1);
+                if(lo == tails.count())
+                    tails << i;
+                else
+                    tails[lo] = i;
+            }
+
+            QSet<T> stable;
+            for(int i = tails.isEmpty()? -1 : tails.last(); i >= 0; i = parents.at(i))
+                stable.insert(kept.at(i));
+
+            // Everything else is moved right behind its predecessor.
+            for(int i=0; i<kept.count(); i++)
+            {
+                if(stable.contains(kept.at(i)))
+                    continue;
+
+                const int from = current.indexOf(kept.at(i));
+                const int dest = i? current.indexOf(kept.at(i-1))+1 : 0;
+                if(dest == from || dest == from+1)
+                    continue;
+
+                beginMoveRows(QModelIndex(), from, from, QModelIndex(), dest);
+                current.move(from, from < dest? dest-1 : dest);
+                endMoveRows();
+            }
+        }
+
+        for(int i=0; i<next.count(); )
+        {
+            if(i < current.count() && current.at(i) == next.at(i))
+            {
+                i++;
+                continue;
+            }
+
+            int last = i;
+            while(last < next.count() && !currentSet.contains(next.at(last)))
+                last++;
+
+            beginInsertRows(QModelIndex(), i, last-1);
+            for(int j=i; j<last; j++)
+                current.insert(j, next.at(j));
+            endInsertRows();
+            i = last;
+        }
+    }
 };
 
 #endif // TGABSTRACTLISTMODEL_H
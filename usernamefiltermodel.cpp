@@ -3,6 +3,7 @@
 #include "objects/types.h"
 
 #include <QPointer>
+#include <QSet>
 
 class UserNameFilterModelPrivate
 {
@@ -135,7 +136,7 @@ void UserNameFilterModel::listChanged()
     if(p->telegram)
         list = p->telegram->userIndex(p->keyword);
 
-    QList<qint64> dialogList;
+    QSet<qint64> dialogList;
     if(p->telegram && p->dialog)
     {
         qint64 chatId = p->dialog->peer()->chatId();
@@ -145,7 +146,7 @@ void UserNameFilterModel::listChanged()
         {
             ChatFullObject *chatFull = p->telegram->chatFull(chatId);
             if(chatFull)
-                dialogList = chatFull->participants()->participants()->userIds();
+                dialogList = chatFull->participants()->participants()->userIds().toSet();
             else
             {
                 if (p->dialog->peer()->classType() == Peer::typePeerChat)
@@ -161,64 +162,15 @@ void UserNameFilterModel::listChanged()
     }
 
     if(!dialogList.isEmpty())
-        for( int i=0 ; i<list.count() ; i++ )
-        {
-            const qint64 uId = list.at(i);
-            if( dialogList.contains(uId) )
-                continue;
-
-            list.removeAt(i);
-            i--;
-        }
-
-    for( int i=0 ; i<p->list.count() ; i++ )
-    {
-        const qint64 uId = p->list.at(i);
-        if( list.contains(uId) )
-            continue;
-
-        beginRemoveRows(QModelIndex(), i, i);
-        p->list.removeAt(i);
-        i--;
-        endRemoveRows();
-    }
-
-
-    QList<qint64> temp_list = list;
-    for( int i=0 ; i<temp_list.count() ; i++ )
     {
-        const qint64 uId = temp_list.at(i);
-        if( p->list.contains(uId) )
-            continue;
-
-        temp_list.removeAt(i);
-        i--;
-    }
-    while( p->list != temp_list )
-        for( int i=0 ; i<p->list.count() ; i++ )
-        {
-            const qint64 uId = p->list.at(i);
-            int nw = temp_list.indexOf(uId);
-            if( i == nw )
-                continue;
-
-            beginMoveRows( QModelIndex(), i, i, QModelIndex(), nw>i?nw+1:nw );
-            p->list.move( i, nw );
-            endMoveRows();
-        }
-
-
-    for( int i=0 ; i<list.count() ; i++ )
-    {
-        const qint64 uId = list.at(i);
-        if( p->list.contains(uId) )
-            continue;
-
-        beginInsertRows(QModelIndex(), i, i );
-        p->list.insert( i, uId );
-        endInsertRows();
+        QList<qint64> filtered;
+        Q_FOREACH(qint64 uId, list)
+            if( dialogList.contains(uId) )
+                filtered << uId;
+        list = filtered;
     }
 
+    updateRows(p->list, list);
     Q_EMIT countChanged();
 }
 